@@ -1,16 +1,21 @@
 #include "load_scene.h"
 
 #include <glm/glm/glm.hpp>
-#include <glm/gtc/random.hpp>
+#include <raytracer/Sampler.h>
+#include <raytracer/Timeline.h>
 
 #include <random>
+#include <vector>
 
 // Create a bunch of small balls
 void load_small_balls(raytracer::Scene &scene, std::mt19937 &rng);
+// Metal ground plane
+void load_ground(raytracer::Scene &scene);
 
 // Load entities into scene
-void load_scene(raytracer::Scene &scene)
+void load_scene(raytracer::Scene &scene, raytracer::Animation *animation)
 {
+    raytracer::TimelineScope scope("Load scene", "scene");
     // TODO: Replace this with a memory pool system
     // Right now there is no way to enforce the vector from resizing and changing the location of the objects
     // If a vector resizes, the entity vector will point to material/shapes/sub_entities in the wrong location causing an illegal memory access
@@ -18,10 +23,20 @@ void load_scene(raytracer::Scene &scene)
     scene.m_lambertian.reserve(600);
     scene.m_metal.reserve(600);
     scene.m_spheres.reserve(600);
+    scene.m_planes.reserve(10);
+    scene.m_boxes.reserve(50);
+    scene.m_oriented_boxes.reserve(50);
+    scene.m_cylinders.reserve(50);
+    scene.m_cones.reserve(50);
+    scene.m_discs.reserve(50);
     scene.m_entities.reserve(600);
     scene.m_basic_entities.reserve(600);
+    scene.m_union_entities.reserve(50);
     scene.m_intersection_entities.reserve(50);
     scene.m_difference_entities.reserve(50);
+    scene.m_checker_textures.reserve(10);
+    scene.m_noise_textures.reserve(10);
+    scene.m_image_textures.reserve(10);
 
     // Scene layout based on: https://github.com/valerioformato/RTIAW
     std::mt19937 rng{};
@@ -29,11 +44,12 @@ void load_scene(raytracer::Scene &scene)
     load_small_balls(scene, rng);
     #endif
 
-    // Reflective metal ball
+    // Reflective metal ground
     {
         // auto& material = scene.m_lambertian.emplace_back(glm::vec3{0.3, 0.3, 0.3});
-        auto& material = scene.m_metal.emplace_back(glm::vec3(0.4, 0.4, 0.4), 0.1f);
-        auto& shape = scene.m_spheres.emplace_back(glm::vec3{0,-5000,0}, 5000.0f);
+        auto& texture = scene.m_checker_textures.emplace_back(glm::vec3{1.0, 1.0, 1.0}, glm::vec3{0.5, 0.5, 0.5}, 0.5f);
+        auto& material = scene.m_metal.emplace_back(glm::vec3(0.4, 0.4, 0.4), 0.1f, &texture);
+        auto& shape = scene.m_planes.emplace_back(glm::vec3{0,0,0}, glm::vec3{0,1,0});
         auto& entity = scene.m_basic_entities.emplace_back(&shape, &material);
         scene.m_entities.push_back(&entity);
     }
@@ -44,11 +60,21 @@ void load_scene(raytracer::Scene &scene)
         auto& shape = scene.m_spheres.emplace_back(glm::vec3{0, 1, 0}, 1.0f);
         auto& entity = scene.m_basic_entities.emplace_back(&shape, &material);
         scene.m_entities.push_back(&entity);
+
+        // bounces once
+        if (animation) {
+            raytracer::Track<glm::vec3> offset{raytracer::Interpolation::SMOOTH};
+            offset.AddKey(0.0f, glm::vec3{0, 0, 0});
+            offset.AddKey(1.0f, glm::vec3{0, 1.5, 0});
+            offset.AddKey(2.0f, glm::vec3{0, 0, 0});
+            animation->AddEntityTrack(scene, &entity, offset);
+        }
     }
 
     // Diffuse ball
     {
-        auto& material = scene.m_lambertian.emplace_back(glm::vec3(0.4, 0.2, 0.1));
+        auto& texture = scene.m_noise_textures.emplace_back(glm::vec3{0.5, 0.5, 0.5}, glm::vec3{1.5, 1.5, 1.5}, 0.1f);
+        auto& material = scene.m_lambertian.emplace_back(glm::vec3(0.4, 0.2, 0.1), &texture);
         auto& shape = scene.m_spheres.emplace_back(glm::vec3{-4, 1, 0}, 1.0f);
         auto& entity = scene.m_basic_entities.emplace_back(&shape, &material);
         scene.m_entities.push_back(&entity);
@@ -70,6 +96,14 @@ void load_scene(raytracer::Scene &scene)
 
         auto& entity = scene.m_intersection_entities.emplace_back(&left_entity, &right_entity);
         scene.m_entities.push_back(&entity);
+
+        // sinks down to the ground
+        if (animation) {
+            raytracer::Track<glm::vec3> offset{raytracer::Interpolation::SMOOTH};
+            offset.AddKey(0.0f, glm::vec3{0, 0, 0});
+            offset.AddKey(2.0f, glm::vec3{0, -1, 0});
+            animation->AddEntityTrack(scene, &entity, offset);
+        }
     }
 
     // Spherical mirror with matte backing
@@ -119,22 +153,42 @@ void load_scene(raytracer::Scene &scene)
         auto& ball_shape = scene.m_spheres.emplace_back(ball_pos, ball_radius);
 
         auto& ball_entity = scene.m_basic_entities.emplace_back(&ball_shape, &ball_material);
-        raytracer::IEntity* root_entity = &ball_entity;
-        
 
         float hole_radius = 0.15f;
+        // use our own sampler instead of std::rand so every process builds the same ball
+        raytracer::Sampler hole_sampler(0, 0, 0);
 
+        std::vector<raytracer::IEntity*> holes;
         for (int i = 0; i < 20; i++) {
-            glm::vec3 hole_pos = ball_pos + (ball_radius-0.05f)*glm::sphericalRand(1.0f);
+            glm::vec3 hole_pos = ball_pos + (ball_radius-0.05f)*hole_sampler.UnitSphere();
 
             auto& hole_shape = scene.m_spheres.emplace_back(hole_pos, hole_radius);
             auto& hole_entity = scene.m_basic_entities.emplace_back(&hole_shape, &hole_material);
+            holes.push_back(&hole_entity);
+        }
 
-            auto& entity = scene.m_difference_entities.emplace_back(root_entity, &hole_entity);
-            root_entity = &entity;
+        // join the holes in pairs so the tree stays shallow, then cut them all out at once
+        while (holes.size() > 1) {
+            std::vector<raytracer::IEntity*> joined;
+            for (size_t i = 0; i+1 < holes.size(); i += 2) {
+                joined.push_back(&scene.m_union_entities.emplace_back(holes[i], holes[i+1]));
+            }
+            if (holes.size() % 2 == 1) {
+                joined.push_back(holes.back());
+            }
+            holes = joined;
         }
+        raytracer::IEntity* root_entity = &scene.m_difference_entities.emplace_back(&ball_entity, holes[0]);
 
         scene.m_entities.push_back(root_entity);
+
+        // rolls towards the camera, the holes move with it
+        if (animation) {
+            raytracer::Track<glm::vec3> offset;
+            offset.AddKey(0.0f, glm::vec3{0, 0, 0});
+            offset.AddKey(2.0f, glm::vec3{1, 0, -1.5});
+            animation->AddEntityTrack(scene, root_entity, offset);
+        }
     }
 }
 
@@ -186,4 +240,125 @@ void load_small_balls(raytracer::Scene &scene, std::mt19937 &rng)
         }
       }
     }
-}
\ No newline at end of file
+}
+
+// Metal ground plane
+void load_ground(raytracer::Scene &scene)
+{
+    auto& material = scene.m_metal.emplace_back(glm::vec3(0.4, 0.4, 0.4), 0.1f);
+    auto& shape = scene.m_planes.emplace_back(glm::vec3{0,0,0}, glm::vec3{0,1,0});
+    auto& entity = scene.m_basic_entities.emplace_back(&shape, &material);
+    scene.m_entities.push_back(&entity);
+}
+
+// Grid of CSG entities of every kind of operation
+void load_csg_scene(raytracer::Scene &scene)
+{
+    raytracer::TimelineScope scope("Load scene", "scene");
+    const int grid_size = 6;
+    const int total_cells = grid_size*grid_size;
+    scene.m_lambertian.reserve(total_cells);
+    scene.m_metal.reserve(total_cells+1);
+    scene.m_dielectric.reserve(total_cells);
+    scene.m_spheres.reserve(4*total_cells);
+    scene.m_planes.reserve(1);
+    scene.m_boxes.reserve(total_cells);
+    scene.m_cylinders.reserve(2*total_cells);
+    scene.m_cones.reserve(total_cells);
+    scene.m_entities.reserve(total_cells+1);
+    scene.m_basic_entities.reserve(4*total_cells+1);
+    scene.m_union_entities.reserve(total_cells);
+    scene.m_intersection_entities.reserve(total_cells);
+    scene.m_difference_entities.reserve(2*total_cells);
+
+    load_ground(scene);
+
+    raytracer::Sampler sampler(1, 0, 0);
+    for (int a = 0; a < grid_size; a++) {
+      for (int b = 0; b < grid_size; b++) {
+        const glm::vec3 center{1.6f*(a - grid_size/2) + 0.8f, 0.6f, 1.6f*(b - grid_size/2) + 0.8f};
+        const glm::vec3 color = glm::vec3{0.2f, 0.2f, 0.2f} + 0.7f*glm::vec3{sampler.Next1D(), sampler.Next1D(), sampler.Next1D()};
+        raytracer::IEntity *entity = nullptr;
+        switch ((a + b) % 3) {
+        case 0:
+          {
+            // ball with two holes drilled through it
+            auto& material = scene.m_lambertian.emplace_back(color);
+            auto& hole_material = scene.m_metal.emplace_back(glm::vec3{0.9, 0.9, 0.9}, 0.05f);
+            auto& ball = scene.m_basic_entities.emplace_back(&scene.m_spheres.emplace_back(center, 0.6f), &material);
+            auto& drill_x = scene.m_basic_entities.emplace_back(
+                &scene.m_cylinders.emplace_back(center - glm::vec3{0.7, 0, 0}, center + glm::vec3{0.7, 0, 0}, 0.25f), &hole_material);
+            auto& drill_z = scene.m_basic_entities.emplace_back(
+                &scene.m_cylinders.emplace_back(center - glm::vec3{0, 0, 0.7}, center + glm::vec3{0, 0, 0.7}, 0.25f), &hole_material);
+            auto& holes = scene.m_union_entities.emplace_back(&drill_x, &drill_z);
+            entity = &scene.m_difference_entities.emplace_back(&ball, &holes);
+          }
+          break;
+        case 1:
+          {
+            // rounded glass cube
+            auto& material = scene.m_dielectric.emplace_back(1.5f, color);
+            auto& box = scene.m_basic_entities.emplace_back(
+                &scene.m_boxes.emplace_back(center - glm::vec3{0.5, 0.5, 0.5}, center + glm::vec3{0.5, 0.5, 0.5}), &material);
+            auto& ball = scene.m_basic_entities.emplace_back(&scene.m_spheres.emplace_back(center, 0.65f), &material);
+            entity = &scene.m_intersection_entities.emplace_back(&box, &ball);
+          }
+          break;
+        default:
+          {
+            // cone with a bite taken out of it
+            auto& material = scene.m_metal.emplace_back(color, 0.2f);
+            auto& cone = scene.m_basic_entities.emplace_back(
+                &scene.m_cones.emplace_back(center - glm::vec3{0, 0.6, 0}, center + glm::vec3{0, 0.6, 0}, 0.6f), &material);
+            auto& bite = scene.m_basic_entities.emplace_back(
+                &scene.m_spheres.emplace_back(center + glm::vec3{0.4, 0, 0.4}, 0.35f), &material);
+            entity = &scene.m_difference_entities.emplace_back(&cone, &bite);
+          }
+          break;
+        }
+        scene.m_entities.push_back(entity);
+      }
+    }
+}
+
+// Thousands of small spheres spread over the ground
+void load_sphere_scene(raytracer::Scene &scene)
+{
+    raytracer::TimelineScope scope("Load scene", "scene");
+    const int grid_size = 80;
+    const int total_spheres = grid_size*grid_size;
+    scene.m_lambertian.reserve(total_spheres);
+    scene.m_metal.reserve(total_spheres+1);
+    scene.m_dielectric.reserve(total_spheres);
+    scene.m_spheres.reserve(total_spheres);
+    scene.m_planes.reserve(1);
+    scene.m_entities.reserve(total_spheres+1);
+    scene.m_basic_entities.reserve(total_spheres+1);
+
+    load_ground(scene);
+
+    raytracer::Sampler sampler(2, 0, 0);
+    for (int a = 0; a < grid_size; a++) {
+      for (int b = 0; b < grid_size; b++) {
+        const float radius = 0.05f + 0.1f*sampler.Next1D();
+        const glm::vec3 center{
+            0.25f*(a - grid_size/2) + 0.1f*sampler.Next1D(), 
+            radius, 
+            0.25f*(b - grid_size/2) + 0.1f*sampler.Next1D()};
+        const glm::vec3 color{sampler.Next1D(), sampler.Next1D(), sampler.Next1D()};
+        const float choose_material = sampler.Next1D();
+
+        raytracer::IMaterial *material;
+        if (choose_material < 0.6f) {
+            material = &scene.m_lambertian.emplace_back(color*color);
+        } else if (choose_material < 0.9f) {
+            material = &scene.m_metal.emplace_back(0.5f*(glm::vec3{1, 1, 1} + color), 0.3f*sampler.Next1D());
+        } else {
+            material = &scene.m_dielectric.emplace_back(1.5f);
+        }
+        auto& shape = scene.m_spheres.emplace_back(center, radius);
+        auto& entity = scene.m_basic_entities.emplace_back(&shape, material);
+        scene.m_entities.push_back(&entity);
+      }
+    }
+}
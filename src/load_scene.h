@@ -2,6 +2,12 @@
 
 #include <raytracer/Scene.h>
 #include <raytracer/Entity.h>
+#include <raytracer/Animation.h>
 
 // load the scene programatically
-void load_scene(raytracer::Scene &scene);
\ No newline at end of file
+// when animation is given, keyframes that move some of the entities are added to it
+void load_scene(raytracer::Scene &scene, raytracer::Animation *animation=nullptr);
+// grid of CSG entities of every kind of operation, for testing CSG performance
+void load_csg_scene(raytracer::Scene &scene);
+// thousands of small spheres, for testing how the renderer scales with the number of entities
+void load_sphere_scene(raytracer::Scene &scene);
\ No newline at end of file
@@ -8,11 +8,16 @@
 
 #include <chrono>
 #include <cmath>
+#include <vector>
 
 #include <raytracer/Renderer.h>
 #include <raytracer/Scene.h>
 #include <raytracer/Camera.h>
 #include <raytracer/Entity.h>
+#include <raytracer/ImageWriter.h>
+#include <raytracer/AsyncWriter.h>
+#include <raytracer/CpuFeatures.h>
+#include <raytracer/Timeline.h>
 
 #include <glm/glm/glm.hpp>
 
@@ -84,10 +89,20 @@ int main(int, char**)
     // we can scale the image using opengl
     float scale = 1.0f;
 
-    // create image buffer
-    const unsigned int image_width = 1280;
-    const unsigned int image_height = 720;
-    uint8_t *image_data = new uint8_t[image_width*image_height*4];
+    // display size, which can be changed between renders
+    const int resolutions[][2] = {{640, 360}, {1280, 720}, {1920, 1080}};
+    const char *resolution_names[] = {"640x360", "1280x720", "1920x1080"};
+    int resolution_index = 1;
+    int image_width = resolutions[resolution_index][0];
+    int image_height = resolutions[resolution_index][1];
+
+    // setup the renderer
+    auto renderer = new raytracer::Renderer();
+    renderer->m_total_bounces = 8;
+    renderer->m_total_samples = 10;
+    // the renderer owns the image, we only upload the parts that changed
+    auto &framebuffer = renderer->GetFramebuffer();
+    framebuffer.Resize(image_width, image_height);
 
     // create opengl texture
     GLuint texture_id;
@@ -97,12 +112,7 @@ int main(int, char**)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_width, image_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-
-    // setup the renderer
-    auto renderer = new raytracer::Renderer();
-    renderer->m_total_bounces = 8;
-    renderer->m_total_samples = 10;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_width, image_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer.GetFrontBuffer());
     
     // default camera setup
     auto camera = new raytracer::Camera();
@@ -117,6 +127,9 @@ int main(int, char**)
     auto scene = new raytracer::Scene();
     load_scene(*scene);
 
+    // saving images happens in the background
+    auto writer = new raytracer::AsyncWriter();
+
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
@@ -146,10 +159,16 @@ int main(int, char**)
         if (show_camera_window) {
             ImGui::Begin("Camera Controls", &show_camera_window);
             // camera settings
-            ImGui::SliderFloat3("Look From", &(camera->m_look_from.x), -30.0f, 30.0f);
-            ImGui::SliderFloat3("Look At", &(camera->m_look_at.x), -30.0f, 30.0f);
-            ImGui::SliderFloat("Plane distance", &(camera->m_plane_distance), 1.0f, 100.0f);
-            ImGui::SliderFloat("Vertical FOV", &(camera->m_vertical_fov), 1.0f, 100.0f);
+            bool is_camera_changed = false;
+            is_camera_changed |= ImGui::SliderFloat3("Look From", &(camera->m_look_from.x), -30.0f, 30.0f);
+            is_camera_changed |= ImGui::SliderFloat3("Look At", &(camera->m_look_at.x), -30.0f, 30.0f);
+            is_camera_changed |= ImGui::SliderFloat("Plane distance", &(camera->m_plane_distance), 1.0f, 100.0f);
+            is_camera_changed |= ImGui::SliderFloat("Vertical FOV", &(camera->m_vertical_fov), 1.0f, 100.0f);
+            // with a frame budget renders are quick enough to follow the camera
+            if (is_camera_changed && renderer->m_frame_budget > 0.0f) {
+                camera->RecalculateVirtualPlane();
+                renderer->Start(*camera, *scene, image_width, image_height);
+            }
             ImGui::End();
         }
 
@@ -163,9 +182,13 @@ int main(int, char**)
                 ImGui::BeginDisabled();
             }
             if (ImGui::Button("Start!")) {
-                memset(image_data, 0, static_cast<size_t>(image_width*image_height*4));
                 camera->RecalculateVirtualPlane();
-                renderer->Start(*camera, *scene, image_data, image_width, image_height);
+                renderer->Start(*camera, *scene, image_width, image_height);
+            }
+            // continue a render that was stopped or interrupted
+            ImGui::SameLine();
+            if (ImGui::Button("Resume")) {
+                renderer->Resume(*camera, *scene, image_width, image_height, "render.ckpt");
             }
             if (startDisable) {
                 ImGui::EndDisabled();
@@ -179,13 +202,158 @@ int main(int, char**)
                 }
             }
 
+            // resizing reuses the renderer's buffers, only the texture is recreated
+            if (startDisable) {
+                ImGui::BeginDisabled();
+            }
+            if (ImGui::Combo("Resolution", &resolution_index, resolution_names, IM_ARRAYSIZE(resolution_names))) {
+                image_width = resolutions[resolution_index][0];
+                image_height = resolutions[resolution_index][1];
+                camera->m_aspect_ratio = (float)image_width/(float)image_height;
+                // waits for any tonemapping still writing to the framebuffer
+                renderer->Stop();
+                framebuffer.Resize(image_width, image_height);
+                glBindTexture(GL_TEXTURE_2D, texture_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image_width, image_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer.GetFrontBuffer());
+            }
+            if (startDisable) {
+                ImGui::EndDisabled();
+            }
+
             // renderer settings
             ImGui::SliderFloat("Scale", &scale, 1.0f, 4.0f);            
             ImGui::SliderInt("Max Bounces", &(renderer->m_total_bounces), 1, 20);
             ImGui::SliderInt("Total samples", &(renderer->m_total_samples), 1, 50);
+            ImGui::SliderInt("Samples per pass", &(renderer->m_samples_per_pass), 1, 10);
+            // lowers the resolution and samples to keep renders near the budget, 0 turns it off
+            ImGui::SliderFloat("Frame budget (s)", &(renderer->m_frame_budget), 0.0f, 2.0f);
+            ImGui::Text(
+                "Rendering %dx%d at %d spp, %.2f Mpaths/s, last render %.3f s", 
+                renderer->GetRenderWidth(), renderer->GetRenderHeight(), renderer->GetRenderSamples(),
+                renderer->GetPathsPerSecond()*1e-6f, renderer->GetLastFrameTime());
+            {
+                bool is_wavefront = renderer->m_mode == raytracer::Renderer::WAVEFRONT;
+                if (ImGui::Checkbox("Wavefront", &is_wavefront)) {
+                    renderer->m_mode = is_wavefront ? raytracer::Renderer::WAVEFRONT : raytracer::Renderer::MEGAKERNEL;
+                }
+                ImGui::SameLine();
+                ImGui::Checkbox("Specialised kernels", &(renderer->m_is_specialised));
+                ImGui::SameLine();
+                ImGui::Checkbox("Path guiding", &(renderer->m_is_guided));
+            }
+            {
+                int order = static_cast<int>(renderer->m_traversal);
+                const char *order_names[static_cast<int>(raytracer::TraversalOrder::TOTAL_ORDERS)];
+                for (int i = 0; i < static_cast<int>(raytracer::TraversalOrder::TOTAL_ORDERS); i++) {
+                    order_names[i] = raytracer::GetTraversalName(static_cast<raytracer::TraversalOrder>(i));
+                }
+                if (ImGui::Combo("Pixel order", &order, order_names, IM_ARRAYSIZE(order_names))) {
+                    renderer->m_traversal = static_cast<raytracer::TraversalOrder>(order);
+                }
+                ImGui::SliderInt("Tile size", &(renderer->m_tile_size), 16, 128);
+            }
             {
+                // only the instruction sets this CPU supports are listed, the kernels are picked again at the next render
+                int isa = static_cast<int>(raytracer::GetActiveIsa());
+                const char *isa_names[static_cast<int>(raytracer::CpuIsa::TOTAL_ISAS)];
+                const int total_isas = static_cast<int>(raytracer::DetectIsa()) + 1;
+                for (int i = 0; i < total_isas; i++) {
+                    isa_names[i] = raytracer::GetIsaName(static_cast<raytracer::CpuIsa>(i));
+                }
+                if (ImGui::Combo("Instruction set", &isa, isa_names, total_isas)) {
+                    raytracer::SetActiveIsa(static_cast<raytracer::CpuIsa>(isa));
+                }
+            }
+            {
+                bool is_pinned = renderer->IsPinned();
+                if (ImGui::Checkbox("Pin threads", &is_pinned)) {
+                    renderer->PinThreads(is_pinned);
+                }
+                ImGui::SameLine();
+                ImGui::Text("%d NUMA nodes", static_cast<int>(renderer->GetTopology().nodes.size()));
+            }
+            {
+                bool write_checkpoint = !renderer->m_checkpoint_path.empty();
+                if (ImGui::Checkbox("Checkpoint", &write_checkpoint)) {
+                    renderer->m_checkpoint_path = write_checkpoint ? "render.ckpt" : "";
+                }
+                ImGui::SameLine();
+                ImGui::SliderFloat("Interval (s)", &(renderer->m_checkpoint_interval), 1.0f, 600.0f);
+            }
+            {
+                bool write_aov = renderer->m_aov_mask != 0;
+                if (ImGui::Checkbox("Write AOVs", &write_aov)) {
+                    renderer->m_aov_mask = write_aov ? raytracer::AOVBuffer::ALL : 0;
+                }
+            }
+            {
+                // open in https://ui.perfetto.dev or chrome://tracing
+                bool is_recording = raytracer::IsTimelineEnabled();
+                if (ImGui::Checkbox("Record timeline", &is_recording)) {
+                    if (is_recording) {
+                        raytracer::SetTimelineThreadName("Main");
+                        raytracer::ClearTimeline();
+                    }
+                    raytracer::SetTimelineEnabled(is_recording);
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Save timeline")) {
+                    writer->Submit([]() {
+                        raytracer::WriteTimeline("timeline.json");
+                    });
+                }
+            }
+            {
+                // image textures are read a tile at a time into a fixed memory budget
+                const auto stats = scene->m_texture_cache.GetStats();
+                ImGui::Text(
+                    "Texture cache: %d MB budget, %llu tiles loaded, %llu replaced", 
+                    static_cast<int>(scene->m_texture_cache.GetMemoryBudget() >> 20),
+                    static_cast<unsigned long long>(stats.total_loads), 
+                    static_cast<unsigned long long>(stats.total_evictions));
+            }
+
+            // tonemapping settings can be changed after rendering
+            {
+                auto &tonemapper = renderer->m_tonemapper;
+                bool is_changed = false;
+                int op = static_cast<int>(tonemapper.m_operator);
+                const char *op_names[raytracer::Tonemapper::TOTAL_OPERATORS];
+                for (int i = 0; i < raytracer::Tonemapper::TOTAL_OPERATORS; i++) {
+                    op_names[i] = raytracer::Tonemapper::GetName(static_cast<raytracer::Tonemapper::Operator>(i));
+                }
+                is_changed |= ImGui::Combo("Tonemapping", &op, op_names, raytracer::Tonemapper::TOTAL_OPERATORS);
+                tonemapper.m_operator = static_cast<raytracer::Tonemapper::Operator>(op);
+                is_changed |= ImGui::SliderFloat("Exposure", &tonemapper.m_exposure, 0.1f, 8.0f);
+                is_changed |= ImGui::SliderFloat("Gamma", &tonemapper.m_gamma, 1.0f, 3.0f);
+                if (is_changed && !startDisable) {
+                    renderer->Tonemap();
+                }
+            }
+
+            // copy the outputs so we can keep rendering while they are written
+            if (!startDisable && ImGui::Button("Save")) {
+                raytracer::HDRBuffer hdr = renderer->GetHDRBuffer();
+                std::vector<uint8_t> ldr = framebuffer.Snapshot();
+                const int width = framebuffer.GetWidth();
+                const int height = framebuffer.GetHeight();
+                writer->Submit([hdr = std::move(hdr), ldr = std::move(ldr), width, height]() {
+                    raytracer::WriteEXR("render.exr", hdr);
+                    raytracer::WritePNG("render.png", ldr.data(), width, height);
+                });
+            }
+
+            // upload the tiles that changed since the last frame
+            {
+                const auto &rects = framebuffer.Present();
+                const uint8_t *front = framebuffer.GetFrontBuffer();
                 glBindTexture(GL_TEXTURE_2D, texture_id);
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image_width, image_height, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, framebuffer.GetWidth());
+                for (const auto &rect: rects) {
+                    const size_t offset = (rect.x + static_cast<size_t>(rect.y)*framebuffer.GetWidth())*raytracer::Framebuffer::TOTAL_CHANNELS;
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE, front + offset);
+                }
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
             }
             ImGui::Image((void*)(intptr_t)texture_id, ImVec2(std::floor(image_width*scale), std::floor(image_height*scale)));
             ImGui::End();
@@ -204,6 +372,7 @@ int main(int, char**)
     }
 
     renderer->Stop();
+    delete writer;
 
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
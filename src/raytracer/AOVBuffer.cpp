@@ -0,0 +1,69 @@
+#include "AOVBuffer.h"
+
+#include <algorithm>
+
+namespace raytracer
+{
+
+int AOVBuffer::GetComponents(Type type) {
+    switch (type) {
+    case NORMAL: 
+    case ALBEDO: 
+        return 3;
+    default: 
+        return 1;
+    }
+}
+
+const char *AOVBuffer::GetName(Type type) {
+    switch (type) {
+    case DEPTH:         return "depth";
+    case NORMAL:        return "normal";
+    case ALBEDO:        return "albedo";
+    case ENTITY_ID:     return "entity_id";
+    case MATERIAL_ID:   return "material_id";
+    case SAMPLE_COUNT:  return "sample_count";
+    case TIME:          return "time";
+    default:            return "unknown";
+    }
+}
+
+void AOVBuffer::Resize(int width, int height, uint32_t mask) {
+    m_mask = mask & ALL;
+    m_width = width;
+    m_height = height;
+    m_plane_size = static_cast<size_t>(width)*static_cast<size_t>(height);
+
+    for (int i = 0; i < TOTAL_TYPES; i++) {
+        Type type = static_cast<Type>(i);
+        // keep the memory of disabled outputs around so toggling them is cheap
+        if (!IsEnabled(type)) {
+            continue;
+        }
+        m_planes[i].resize(m_plane_size * GetComponents(type));
+    }
+}
+
+void AOVBuffer::Clear() {
+    for (int i = 0; i < TOTAL_TYPES; i++) {
+        if (IsEnabled(static_cast<Type>(i))) {
+            std::fill(m_planes[i].begin(), m_planes[i].end(), 0.0f);
+        }
+    }
+}
+
+float *AOVBuffer::GetPlane(Type type, int component) {
+    if (!IsEnabled(type)) {
+        return nullptr;
+    }
+    return m_planes[type].data() + static_cast<size_t>(component)*m_plane_size;
+}
+
+const float *AOVBuffer::GetPlane(Type type, int component) const {
+    if (!IsEnabled(type)) {
+        return nullptr;
+    }
+    return m_planes[type].data() + static_cast<size_t>(component)*m_plane_size;
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace raytracer
+{
+
+// Arbitrary output variables that are written in the same pass as the final colour
+// Each component of each output is stored as its own float plane of width*height
+class AOVBuffer {
+    public:
+        enum Type {
+            DEPTH,          // distance along the camera ray to the first hit
+            NORMAL,         // world space normal at the first hit (3 components)
+            ALBEDO,         // material albedo at the first hit (3 components)
+            ENTITY_ID,      // index into Scene::m_entities, -1 if nothing was hit
+            MATERIAL_ID,    // see Scene::GetMaterialID, -1 if nothing was hit
+            SAMPLE_COUNT,   // number of samples taken for the pixel
+            TIME,           // total time spent rendering the pixel in milliseconds
+            TOTAL_TYPES
+        };
+        static constexpr uint32_t ALL = (1u << TOTAL_TYPES) - 1u;
+        static constexpr uint32_t Flag(Type type) { return 1u << type; }
+        static int GetComponents(Type type);
+        static const char *GetName(Type type);
+    public:
+        AOVBuffer() {}
+        // reuses the previous allocations if they are large enough
+        void Resize(int width, int height, uint32_t mask);
+        // zero every enabled output
+        void Clear();
+        inline bool IsEnabled(Type type) const { return (m_mask & Flag(type)) != 0; }
+        inline uint32_t GetMask() const { return m_mask; }
+        inline int GetWidth() const { return m_width; }
+        inline int GetHeight() const { return m_height; }
+        // returns nullptr if the output is disabled
+        float *GetPlane(Type type, int component=0);
+        const float *GetPlane(Type type, int component=0) const;
+        inline void Write(Type type, int x, int y, float value, int component=0) {
+            m_planes[type][static_cast<size_t>(component)*m_plane_size + x + y*m_width] = value;
+        }
+        inline void Accumulate(Type type, int x, int y, float value, int component=0) {
+            m_planes[type][static_cast<size_t>(component)*m_plane_size + x + y*m_width] += value;
+        }
+    private:
+        uint32_t m_mask{0};
+        int m_width{0}, m_height{0};
+        size_t m_plane_size{0};
+        std::vector<float> m_planes[TOTAL_TYPES];
+};
+
+}
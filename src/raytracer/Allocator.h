@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <new>
+
+namespace raytracer
+{
+
+// Leaves elements uninitialised when a vector grows, instead of zeroing them
+// Pages of a large buffer are then only placed in memory when a thread first writes to them,
+// so they end up on the NUMA node of the thread that renders that part of the image
+template <typename T>
+class DefaultInitAllocator: public std::allocator<T> {
+    public:
+        template <typename U>
+        struct rebind { using other = DefaultInitAllocator<U>; };
+
+        DefaultInitAllocator() noexcept {}
+        template <typename U>
+        DefaultInitAllocator(const DefaultInitAllocator<U> &) noexcept {}
+
+        template <typename U>
+        void construct(U *ptr) noexcept {
+            ::new(static_cast<void*>(ptr)) U;
+        }
+        template <typename U, typename... Args>
+        void construct(U *ptr, Args&&... args) {
+            ::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+        }
+};
+
+}
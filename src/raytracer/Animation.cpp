@@ -0,0 +1,112 @@
+#include "Animation.h"
+
+namespace raytracer
+{
+
+// shapes of an entity tree, each only once
+static bool GetShapes(const Scene &scene, const IEntity *entity, std::vector<IShape*> &shapes) {
+    const Scene::EntityType type = scene.GetEntityType(entity);
+    if (type == Scene::EntityType::BASIC) {
+        IShape *shape = static_cast<const BasicEntity*>(entity)->GetShape();
+        if (std::find(shapes.begin(), shapes.end(), shape) == shapes.end()) {
+            shapes.push_back(shape);
+        }
+        return true;
+    }
+    if (type == Scene::EntityType::UNKNOWN) {
+        return false;
+    }
+    const ICompositeEntity *composite = static_cast<const ICompositeEntity*>(entity);
+    return GetShapes(scene, composite->GetLeft(), shapes) && GetShapes(scene, composite->GetRight(), shapes);
+}
+
+template <typename T>
+static std::unique_ptr<IShape> CopyShapeAs(const IShape &shape) {
+    return std::make_unique<T>(static_cast<const T&>(shape));
+}
+
+static std::unique_ptr<IShape> CopyShape(const IShape &shape) {
+    switch (shape.GetType()) {
+    case ShapeType::SPHERE:         return CopyShapeAs<Sphere>(shape);
+    case ShapeType::PLANE:          return CopyShapeAs<Plane>(shape);
+    case ShapeType::BOX:            return CopyShapeAs<Box>(shape);
+    case ShapeType::ORIENTED_BOX:   return CopyShapeAs<OrientedBox>(shape);
+    case ShapeType::CYLINDER:       return CopyShapeAs<Cylinder>(shape);
+    case ShapeType::CONE:           return CopyShapeAs<Cone>(shape);
+    case ShapeType::DISC:           return CopyShapeAs<Disc>(shape);
+    default:                        return nullptr;
+    }
+}
+
+template <typename T>
+static void AssignShapeAs(IShape &shape, const IShape &source) {
+    static_cast<T&>(shape) = static_cast<const T&>(source);
+}
+
+static void AssignShape(IShape &shape, const IShape &source) {
+    switch (shape.GetType()) {
+    case ShapeType::SPHERE:         AssignShapeAs<Sphere>(shape, source); break;
+    case ShapeType::PLANE:          AssignShapeAs<Plane>(shape, source); break;
+    case ShapeType::BOX:            AssignShapeAs<Box>(shape, source); break;
+    case ShapeType::ORIENTED_BOX:   AssignShapeAs<OrientedBox>(shape, source); break;
+    case ShapeType::CYLINDER:       AssignShapeAs<Cylinder>(shape, source); break;
+    case ShapeType::CONE:           AssignShapeAs<Cone>(shape, source); break;
+    case ShapeType::DISC:           AssignShapeAs<Disc>(shape, source); break;
+    default:                        break;
+    }
+}
+
+bool Animation::AddEntityTrack(const Scene &scene, const IEntity *entity, const Track<glm::vec3> &offset) {
+    EntityTrack track;
+    if (!GetShapes(scene, entity, track.shapes)) {
+        return false;
+    }
+    for (IShape *shape: track.shapes) {
+        std::unique_ptr<IShape> original = CopyShape(*shape);
+        if (!original) {
+            return false;
+        }
+        track.original_shapes.push_back(std::move(original));
+    }
+    track.offset = offset;
+    m_entity_tracks.push_back(std::move(track));
+    return true;
+}
+
+Animation::Frame Animation::Evaluate(float time) const {
+    Frame frame;
+    frame.look_from = m_look_from.Evaluate(time);
+    frame.look_at = m_look_at.Evaluate(time);
+    frame.vertical_fov = m_vertical_fov.Evaluate(time);
+    frame.offsets.reserve(m_entity_tracks.size());
+    for (const EntityTrack &track: m_entity_tracks) {
+        frame.offsets.push_back(track.offset.Evaluate(time));
+    }
+    return frame;
+}
+
+void Animation::Apply(const Frame &frame, Camera &camera) {
+    // always start from the original shapes, so rounding doesn't build up over the frames
+    for (size_t i = 0; i < m_entity_tracks.size() && i < frame.offsets.size(); i++) {
+        EntityTrack &track = m_entity_tracks[i];
+        for (size_t j = 0; j < track.shapes.size(); j++) {
+            AssignShape(*track.shapes[j], *track.original_shapes[j]);
+            track.shapes[j]->Translate(frame.offsets[i]);
+        }
+    }
+
+    if (!m_look_from.IsEmpty()) camera.m_look_from = frame.look_from;
+    if (!m_look_at.IsEmpty()) camera.m_look_at = frame.look_at;
+    if (!m_vertical_fov.IsEmpty()) camera.m_vertical_fov = frame.vertical_fov;
+    camera.RecalculateVirtualPlane();
+}
+
+void Animation::Reset() {
+    for (EntityTrack &track: m_entity_tracks) {
+        for (size_t j = 0; j < track.shapes.size(); j++) {
+            AssignShape(*track.shapes[j], *track.original_shapes[j]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Shape.h"
+#include "Entity.h"
+
+#include <glm/glm/glm.hpp>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+namespace raytracer
+{
+
+// LINEAR moves at a constant speed between keys, SMOOTH follows a Catmull-Rom spline through them
+enum class Interpolation { LINEAR, SMOOTH };
+
+// Values of a parameter at points in time, in seconds
+// before the first key and after the last the value is held
+template <typename T>
+class Track {
+    public:
+        struct Key {
+            public:
+                float time;
+                T value;
+        };
+    public:
+        Track(Interpolation interpolation=Interpolation::LINEAR): m_interpolation(interpolation) {}
+        // keys can be added in any order, a key at the same time as another replaces it
+        void AddKey(float time, const T &value);
+        T Evaluate(float time) const;
+        bool IsEmpty() const { return m_keys.empty(); }
+    private:
+        std::vector<Key> m_keys;
+        Interpolation m_interpolation;
+};
+
+// Keyframed camera and entity positions
+// Entities are moved by translating their shapes from where they were when their track was added
+// so evaluating a time always gives the same scene, whatever order the frames are rendered in
+class Animation {
+    public:
+        // everything that changes between frames, evaluated ahead of time so it can be applied quickly
+        struct Frame {
+            public:
+                glm::vec3 look_from;
+                glm::vec3 look_at;
+                float vertical_fov;
+                // for each entity track
+                std::vector<glm::vec3> offsets;
+        };
+    public:
+        // tracks left empty don't change the camera
+        Track<glm::vec3> m_look_from;
+        Track<glm::vec3> m_look_at;
+        Track<float> m_vertical_fov;
+    public:
+        Animation() {}
+        Animation(const Animation&) = delete;
+        Animation& operator=(const Animation&) = delete;
+        // offset of an entity from its current position over time
+        // the entity is built from the scene's entities, every shape in its tree is moved
+        // returns false if it holds an entity of an unknown type
+        bool AddEntityTrack(const Scene &scene, const IEntity *entity, const Track<glm::vec3> &offset);
+        Frame Evaluate(float time) const;
+        // move the shapes and camera to a frame, which must have come from this animation
+        // nothing may be rendering the scene while this runs
+        void Apply(const Frame &frame, Camera &camera);
+        // put every shape back where it was when its track was added
+        void Reset();
+    private:
+        struct EntityTrack {
+            public:
+                std::vector<IShape*> shapes;
+                // copies of the shapes when the track was added
+                std::vector<std::unique_ptr<IShape>> original_shapes;
+                Track<glm::vec3> offset;
+        };
+        std::vector<EntityTrack> m_entity_tracks;
+};
+
+template <typename T>
+void Track<T>::AddKey(float time, const T &value) {
+    auto it = std::lower_bound(m_keys.begin(), m_keys.end(), time, [](const Key &key, float t) { return key.time < t; });
+    if (it != m_keys.end() && it->time == time) {
+        it->value = value;
+        return;
+    }
+    m_keys.insert(it, Key{time, value});
+}
+
+template <typename T>
+T Track<T>::Evaluate(float time) const {
+    if (m_keys.empty()) {
+        return T{};
+    }
+    if (time <= m_keys.front().time) {
+        return m_keys.front().value;
+    }
+    if (time >= m_keys.back().time) {
+        return m_keys.back().value;
+    }
+
+    // first key after the time, which isn't the first key
+    auto it = std::upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const Key &key) { return t < key.time; });
+    const size_t i = static_cast<size_t>(it - m_keys.begin());
+    const Key &k1 = m_keys[i-1];
+    const Key &k2 = m_keys[i];
+    const float u = (time - k1.time) / (k2.time - k1.time);
+    if (m_interpolation == Interpolation::LINEAR) {
+        return k1.value + (k2.value - k1.value)*u;
+    }
+
+    // the ends repeat the first and last keys, so the spline stops at them
+    const T &p0 = m_keys[(i >= 2) ? i-2 : i-1].value;
+    const T &p1 = k1.value;
+    const T &p2 = k2.value;
+    const T &p3 = m_keys[std::min(i+1, m_keys.size()-1)].value;
+    const float u2 = u*u;
+    const float u3 = u2*u;
+    return 0.5f*(
+        p1*2.0f +
+        (p2 - p0)*u +
+        (p0*2.0f - p1*5.0f + p2*4.0f - p3)*u2 +
+        (p1*3.0f - p0 - p2*3.0f + p3)*u3);
+}
+
+}
@@ -0,0 +1,62 @@
+#include "AsyncWriter.h"
+
+namespace raytracer
+{
+
+AsyncWriter::AsyncWriter() 
+: m_thread([this]() { Run(); })
+{}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_is_stop = true;
+    }
+    m_cv_job.notify_all();
+    m_thread.join();
+}
+
+void AsyncWriter::Submit(std::function<void()> job) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobs.push(std::move(job));
+    }
+    m_cv_job.notify_one();
+}
+
+void AsyncWriter::Wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv_done.wait(lock, [this]() { return m_jobs.empty() && (m_total_running == 0); });
+}
+
+int AsyncWriter::GetPending() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_jobs.size()) + m_total_running;
+}
+
+void AsyncWriter::Run() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv_job.wait(lock, [this]() { return m_is_stop || !m_jobs.empty(); });
+            // finish writing everything that was submitted before shutting down
+            if (m_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop();
+            m_total_running++;
+        }
+
+        job();
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_total_running--;
+        }
+        m_cv_done.notify_all();
+    }
+}
+
+}
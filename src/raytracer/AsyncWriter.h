@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+
+namespace raytracer
+{
+
+// Runs output jobs, such as writing images to disk, on a background thread
+// This lets file I/O overlap with the next render instead of stalling it
+// Jobs should capture copies of the data they write, since the renderer will reuse its buffers
+class AsyncWriter {
+    public:
+        AsyncWriter();
+        ~AsyncWriter();
+        AsyncWriter(const AsyncWriter&) = delete;
+        AsyncWriter& operator=(const AsyncWriter&) = delete;
+        void Submit(std::function<void()> job);
+        // block until all submitted jobs have finished
+        void Wait();
+        int GetPending();
+    private:
+        void Run();
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_cv_job;
+        std::condition_variable m_cv_done;
+        std::queue<std::function<void()>> m_jobs;
+        int m_total_running{0};
+        bool m_is_stop{false};
+        // started last so the state above exists before it runs
+        std::thread m_thread;
+};
+
+}
@@ -0,0 +1,269 @@
+#include "Bvh.h"
+
+#include <limits>
+
+namespace raytracer
+{
+
+// bins the centroids are sorted into when looking for a split
+static constexpr int TOTAL_BINS = 16;
+// cost of visiting a node relative to testing an item
+static constexpr float TRAVERSAL_COST = 0.5f;
+
+static Bounds GetEmptyBounds() {
+    const float infinity = std::numeric_limits<float>::infinity();
+    return {glm::vec3{infinity}, glm::vec3{-infinity}};
+}
+
+void CompressedBvh::Build(const std::vector<Bounds> &bounds) {
+    nodes.clear();
+    items.clear();
+    m_build_nodes.clear();
+    m_build_items.clear();
+    m_centroids.resize(bounds.size());
+    for (size_t i = 0; i < bounds.size(); i++) {
+        if (!bounds[i].IsFinite()) {
+            continue;
+        }
+        m_build_items.push_back(static_cast<uint32_t>(i));
+        m_centroids[i] = 0.5f*(bounds[i].min + bounds[i].max);
+    }
+    if (m_build_items.empty()) {
+        return;
+    }
+    const int root = BuildBinary(bounds, 0, static_cast<int>(m_build_items.size()), 0);
+
+    nodes.resize(1);
+    items.reserve(m_build_items.size());
+    Collapse(bounds, root, 0);
+}
+
+int CompressedBvh::BuildBinary(const std::vector<Bounds> &bounds, int first, int count, int depth) {
+    BuildNode node;
+    node.bounds = GetEmptyBounds();
+    Bounds centroid_bounds = GetEmptyBounds();
+    for (int i = first; i < first+count; i++) {
+        node.bounds = Bounds::Union(node.bounds, bounds[m_build_items[i]]);
+        const glm::vec3 &centroid = m_centroids[m_build_items[i]];
+        centroid_bounds = Bounds::Union(centroid_bounds, {centroid, centroid});
+    }
+    node.left = node.right = -1;
+    node.first = first;
+    node.count = count;
+
+    const int index = static_cast<int>(m_build_nodes.size());
+    m_build_nodes.push_back(node);
+    if (count <= 1) {
+        return index;
+    }
+
+    // binned surface area heuristic along the longest axis of the centroids
+    const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    const int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+    int split = first + count/2;
+    bool is_leaf = false;
+    if (extent[axis] > 0.0f && depth < MAX_SAH_DEPTH) {
+        Bounds bin_bounds[TOTAL_BINS];
+        int bin_counts[TOTAL_BINS] = {0};
+        for (int b = 0; b < TOTAL_BINS; b++) {
+            bin_bounds[b] = GetEmptyBounds();
+        }
+        const float bin_scale = static_cast<float>(TOTAL_BINS) / extent[axis];
+        auto get_bin = [&](uint32_t item) {
+            const int bin = static_cast<int>((m_centroids[item][axis] - centroid_bounds.min[axis]) * bin_scale);
+            return std::min(std::max(bin, 0), TOTAL_BINS-1);
+        };
+        for (int i = first; i < first+count; i++) {
+            const int bin = get_bin(m_build_items[i]);
+            bin_counts[bin]++;
+            bin_bounds[bin] = Bounds::Union(bin_bounds[bin], bounds[m_build_items[i]]);
+        }
+
+        // area and count to the right of each split
+        float right_area[TOTAL_BINS];
+        int right_count[TOTAL_BINS];
+        Bounds right = GetEmptyBounds();
+        int total_right = 0;
+        for (int b = TOTAL_BINS-1; b > 0; b--) {
+            right = Bounds::Union(right, bin_bounds[b]);
+            total_right += bin_counts[b];
+            right_area[b] = right.GetSurfaceArea();
+            right_count[b] = total_right;
+        }
+
+        float best_cost = std::numeric_limits<float>::infinity();
+        int best_bin = -1;
+        Bounds left = GetEmptyBounds();
+        int total_left = 0;
+        for (int b = 1; b < TOTAL_BINS; b++) {
+            left = Bounds::Union(left, bin_bounds[b-1]);
+            total_left += bin_counts[b-1];
+            if (total_left == 0 || right_count[b] == 0) {
+                continue;
+            }
+            const float cost = left.GetSurfaceArea()*total_left + right_area[b]*right_count[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_bin = b;
+            }
+        }
+
+        const float area = node.bounds.GetSurfaceArea();
+        const float split_cost = TRAVERSAL_COST + ((area > 0.0f) ? best_cost / area : static_cast<float>(count));
+        is_leaf = count <= MAX_LEAF_ITEMS && split_cost >= static_cast<float>(count);
+        if (best_bin > 0) {
+            auto middle = std::partition(m_build_items.begin() + first, m_build_items.begin() + first + count,
+                [&](uint32_t item) { return get_bin(item) < best_bin; });
+            split = static_cast<int>(middle - m_build_items.begin());
+        }
+    } else {
+        // items on top of each other can't be split by position
+        is_leaf = count <= MAX_LEAF_ITEMS;
+    }
+    if (is_leaf) {
+        return index;
+    }
+
+    // splits that the heuristic can't make, and ones past its depth, fall back to halving the items
+    const int total_left = split - first;
+    const int left = BuildBinary(bounds, first, total_left, depth+1);
+    const int right = BuildBinary(bounds, split, count - total_left, depth+1);
+    m_build_nodes[index].left = left;
+    m_build_nodes[index].right = right;
+    return index;
+}
+
+void CompressedBvh::Collapse(const std::vector<Bounds> &bounds, int binary, uint32_t index) {
+    // open up the largest inner child until there are WIDTH of them
+    int children[WIDTH];
+    int total_children = 0;
+    const BuildNode &root = m_build_nodes[binary];
+    if (root.left < 0) {
+        children[total_children++] = binary;
+    } else {
+        children[total_children++] = root.left;
+        children[total_children++] = root.right;
+    }
+    while (total_children < WIDTH) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < total_children; i++) {
+            const BuildNode &child = m_build_nodes[children[i]];
+            if (child.left >= 0 && child.bounds.GetSurfaceArea() > best_area) {
+                best = i;
+                best_area = child.bounds.GetSurfaceArea();
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        const BuildNode &child = m_build_nodes[children[best]];
+        children[best] = child.left;
+        children[total_children++] = child.right;
+    }
+
+    Node node;
+    node.inner_mask = 0;
+    node.first_node = static_cast<uint32_t>(nodes.size());
+    node.first_item = static_cast<uint32_t>(items.size());
+    int total_inner = 0;
+    Bounds child_bounds[WIDTH];
+    for (int i = 0; i < total_children; i++) {
+        const BuildNode &child = m_build_nodes[children[i]];
+        child_bounds[i] = child.bounds;
+        if (child.left >= 0) {
+            node.inner_mask |= static_cast<uint8_t>(1 << i);
+            node.meta[i] = static_cast<uint8_t>(total_inner++);
+            continue;
+        }
+        const uint32_t offset = static_cast<uint32_t>(items.size()) - node.first_item;
+        node.meta[i] = static_cast<uint8_t>(offset*8 + static_cast<uint32_t>(child.count));
+        for (int k = child.first; k < child.first + child.count; k++) {
+            items.push_back(m_build_items[k]);
+        }
+    }
+    for (int i = total_children; i < WIDTH; i++) {
+        node.meta[i] = 0;
+    }
+    Quantize(node, child_bounds, total_children);
+    nodes.resize(nodes.size() + total_inner);
+    nodes[index] = node;
+
+    // inner children after this node's, so a node is always before its children
+    for (int i = 0; i < total_children; i++) {
+        if (node.inner_mask & (1 << i)) {
+            Collapse(bounds, children[i], node.first_node + node.meta[i]);
+        }
+    }
+}
+
+void CompressedBvh::Quantize(Node &node, const Bounds *child_bounds, int total_children) {
+    Bounds parent = GetEmptyBounds();
+    for (int i = 0; i < total_children; i++) {
+        parent = Bounds::Union(parent, child_bounds[i]);
+    }
+
+    float inv_scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        // smallest power of two that covers the bounds in 255 steps
+        const float extent = parent.max[axis] - parent.min[axis];
+        int exponent = 0;
+        std::frexp(std::max(extent / 255.0f, std::numeric_limits<float>::min()), &exponent);
+        exponent = std::min(std::max(exponent, -126), 127);
+        node.exponent[axis] = static_cast<int8_t>(exponent);
+        inv_scale[axis] = 1.0f / GetBvhScale(node.exponent[axis]);
+    }
+    node.origin = parent.min;
+
+    for (int i = 0; i < WIDTH; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (i >= total_children) {
+                node.lower[axis][i] = node.upper[axis][i] = 0;
+                continue;
+            }
+            // rounded outwards, so the child is always inside its quantized bounds
+            const float lower = std::floor((child_bounds[i].min[axis] - node.origin[axis]) * inv_scale[axis]);
+            const float upper = std::ceil((child_bounds[i].max[axis] - node.origin[axis]) * inv_scale[axis]);
+            node.lower[axis][i] = static_cast<uint8_t>(std::min(std::max(lower, 0.0f), 255.0f));
+            node.upper[axis][i] = static_cast<uint8_t>(std::min(std::max(upper, 0.0f), 255.0f));
+        }
+    }
+}
+
+void CompressedBvh::Refit(const std::vector<Bounds> &bounds) {
+    if (!nodes.empty()) {
+        RefitNode(bounds, 0);
+    }
+}
+
+Bounds CompressedBvh::RefitNode(const std::vector<Bounds> &bounds, uint32_t index) {
+    Node &node = nodes[index];
+    Bounds child_bounds[WIDTH];
+    int total_children = 0;
+    for (int i = 0; i < WIDTH; i++) {
+        if (node.inner_mask & (1 << i)) {
+            child_bounds[i] = RefitNode(bounds, node.first_node + node.meta[i]);
+            total_children = i+1;
+            continue;
+        }
+        const int count = node.meta[i] & 7;
+        if (count == 0) {
+            continue;
+        }
+        child_bounds[i] = GetEmptyBounds();
+        const uint32_t first = node.first_item + node.meta[i]/8;
+        for (uint32_t k = first; k < first + static_cast<uint32_t>(count); k++) {
+            child_bounds[i] = Bounds::Union(child_bounds[i], bounds[items[k]]);
+        }
+        total_children = i+1;
+    }
+
+    Quantize(node, child_bounds, total_children);
+    Bounds result = GetEmptyBounds();
+    for (int i = 0; i < total_children; i++) {
+        result = Bounds::Union(result, child_bounds[i]);
+    }
+    return result;
+}
+
+}
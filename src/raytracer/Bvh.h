@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Shape.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <string.h>
+
+namespace raytracer
+{
+
+// Bounding volume hierarchy with 8 children per node, whose bounds are quantized to 8 bits
+// Each node stores its bounds as an origin and a power of two scale per axis,
+// and each child's bounds as a number of steps of that scale from the origin, rounded outwards
+// so a node takes 80 bytes instead of the 200 for 8 children in floats
+// Inner children of a node are stored next to each other, as are the items of its leaf children,
+// so a child is found from an offset instead of a full index
+class CompressedBvh {
+    public:
+        static constexpr int WIDTH = 8;
+        static constexpr int MAX_LEAF_ITEMS = 4;
+        // below this depth the items are halved instead of split by area, so the tree is never deeper than
+        // MAX_SAH_DEPTH + 32 and traversal can use a fixed size stack
+        static constexpr int MAX_SAH_DEPTH = 24;
+        static constexpr int MAX_DEPTH = MAX_SAH_DEPTH + 32;
+        static constexpr int STACK_SIZE = MAX_DEPTH*(WIDTH-1) + 1;
+        struct Node {
+            public:
+                glm::vec3 origin;
+                // log2 of the size of a step along each axis
+                int8_t exponent[3];
+                // bit i is set if child i is a node, otherwise it is a leaf
+                uint8_t inner_mask;
+                // index of the first inner child in nodes, and of the first item of the leaves in items
+                uint32_t first_node;
+                uint32_t first_item;
+                // for a leaf, the offset of its items from first_item and its count as offset*8 + count
+                // empty children are leaves with a count of 0
+                uint8_t meta[WIDTH];
+                // child bounds in steps from the origin
+                uint8_t lower[3][WIDTH];
+                uint8_t upper[3][WIDTH];
+        };
+    public:
+        // nodes[0] is the root, there are no nodes if there are no items
+        std::vector<Node> nodes;
+        // indices into the bounds the tree was built over
+        std::vector<uint32_t> items;
+    public:
+        // bounds that aren't finite are left out, their items have to be tested separately
+        void Build(const std::vector<Bounds> &bounds);
+        // update the bounds after the items have moved, keeping the tree as it is
+        // bounds must have the same size as when it was built
+        void Refit(const std::vector<Bounds> &bounds);
+        bool IsEmpty() const { return nodes.empty(); }
+        size_t GetMemoryUsage() const { return nodes.size()*sizeof(Node) + items.size()*sizeof(uint32_t); }
+    private:
+        struct BuildNode {
+            public:
+                Bounds bounds;
+                // children, or -1 for a leaf of items [first, first+count) in m_build_items
+                int left, right;
+                int first, count;
+        };
+        int BuildBinary(const std::vector<Bounds> &bounds, int first, int count, int depth);
+        // write a node from a binary node and its descendants, into nodes[index]
+        void Collapse(const std::vector<Bounds> &bounds, int binary, uint32_t index);
+        void Quantize(Node &node, const Bounds *child_bounds, int total_children);
+        Bounds RefitNode(const std::vector<Bounds> &bounds, uint32_t index);
+    private:
+        std::vector<BuildNode> m_build_nodes;
+        std::vector<uint32_t> m_build_items;
+        std::vector<glm::vec3> m_centroids;
+};
+
+// A ray prepared for testing against the nodes of a CompressedBvh
+struct BvhRay {
+    public:
+        glm::vec3 origin;
+        glm::vec3 inv_direction;
+    public:
+        explicit BvhRay(const Ray &ray);
+};
+
+// 2 to the power of exponent, which is in [-126, 127]
+inline float GetBvhScale(int8_t exponent) {
+    const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// distance along the ray to each child of a node, with bit i of the result set if child i was hit within [t_min, t_max]
+// empty children are not masked out, their meta has to be checked
+int IntersectBvhNode(const CompressedBvh::Node &node, const BvhRay &ray, float t_min, float t_max, float *t_near);
+
+inline BvhRay::BvhRay(const Ray &ray)
+: origin(ray.origin)
+{
+    // a tiny direction instead of 0 gives huge slabs instead of the NaN of 0 times infinity
+    for (int axis = 0; axis < 3; axis++) {
+        float d = ray.direction[axis];
+        if (std::abs(d) < 1e-20f) {
+            d = (d < 0.0f) ? -1e-20f : 1e-20f;
+        }
+        inv_direction[axis] = 1.0f / d;
+    }
+}
+
+inline int IntersectBvhNode(const CompressedBvh::Node &node, const BvhRay &ray, float t_min, float t_max, float *t_near) {
+    // the bounds of child i along an axis are origin + lower*scale to origin + upper*scale
+    // which along the ray is a fixed offset plus steps of scale*inv_direction
+    float step[3], offset[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const float scale = GetBvhScale(node.exponent[axis]);
+        step[axis] = scale * ray.inv_direction[axis];
+        offset[axis] = (node.origin[axis] - ray.origin[axis]) * ray.inv_direction[axis];
+    }
+
+    int hit_mask = 0;
+    for (int i = 0; i < CompressedBvh::WIDTH; i++) {
+        float t0 = t_min;
+        float t1 = t_max;
+        for (int axis = 0; axis < 3; axis++) {
+            const float ta = offset[axis] + step[axis]*static_cast<float>(node.lower[axis][i]);
+            const float tb = offset[axis] + step[axis]*static_cast<float>(node.upper[axis][i]);
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        t_near[i] = t0;
+        hit_mask |= (t0 <= t1) ? (1 << i) : 0;
+    }
+    return hit_mask;
+}
+
+}
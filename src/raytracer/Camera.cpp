@@ -18,6 +18,9 @@ void Camera::RecalculateVirtualPlane() {
     glm::vec3 w = glm::normalize(m_look_from - m_look_at);
     glm::vec3 u = glm::normalize(glm::cross(m_up, w));
     glm::vec3 v = glm::cross(w, u);
+    m_u = u;
+    m_v = v;
+    m_w = w;
 
     // set the virtual camera image plane
     m_origin = m_look_from;
@@ -26,10 +29,20 @@ void Camera::RecalculateVirtualPlane() {
     m_lower_left = m_origin - m_horizontal/2.0f - m_vertical/2.0f - m_plane_distance*w;
 }
 
-Ray Camera::GetRay(float s, float t) {
+Ray Camera::GetRay(float s, float t) const {
     Ray ray;
     ray.color = glm::vec3{0, 0, 0};
     ray.origin = m_origin;
+    ray.cone_width = 0.0f;
+    ray.cone_spread = 0.0f;
+
+    if (m_projection == EQUIRECTANGULAR) {
+        float longitude = (s - 0.5f) * 2.0f*3.1415f;
+        float latitude = (t - 0.5f) * 3.1415f;
+        glm::vec3 horizontal = std::sin(longitude)*m_u - std::cos(longitude)*m_w;
+        ray.direction = glm::normalize(std::cos(latitude)*horizontal + std::sin(latitude)*m_v);
+        return ray;
+    }
 
     glm::vec3 screen_pos = m_lower_left + m_horizontal*s + m_vertical*t;
     ray.direction = glm::normalize(screen_pos - m_origin);
@@ -37,4 +50,12 @@ Ray Camera::GetRay(float s, float t) {
     return ray;
 }
 
+float Camera::GetPixelSpread(int height) const {
+    if (m_projection == EQUIRECTANGULAR) {
+        return 3.1415f / static_cast<float>(height);
+    }
+    float theta = m_vertical_fov * 3.1415f/180.0f;
+    return theta / static_cast<float>(height);
+}
+
 }
\ No newline at end of file
@@ -6,9 +6,16 @@
 namespace raytracer {
 
 class Camera {
+    public:
+        // equirectangular cameras see the whole sphere around them, with s as the longitude and t the latitude
+        // the centre of the image looks towards m_look_at, and m_vertical_fov and m_aspect_ratio are unused
+        enum Projection { PERSPECTIVE, EQUIRECTANGULAR };
     public:
         Camera() {};
-        Ray GetRay(float s, float t);
+        // the ray's cone starts with no width or spread, see GetPixelSpread
+        Ray GetRay(float s, float t) const;
+        // angle covered by one pixel of an image of this height, to use as the spread of primary rays
+        float GetPixelSpread(int height) const;
         // before usage, run this to update virtual plane parameters
         void RecalculateVirtualPlane();
     
@@ -20,11 +27,14 @@ class Camera {
         glm::vec3 m_look_from{0,0,0};
         glm::vec3 m_look_at{1,1,1};
         glm::vec3 m_up{0,1,0};
+        Projection m_projection{PERSPECTIVE};
     private:
         // virtual plane parameters
         glm::vec3 m_horizontal, m_vertical;
         glm::vec3 m_origin;
         glm::vec3 m_lower_left;
+        // right, up and backwards axes of the camera
+        glm::vec3 m_u, m_v, m_w;
 
 };
 
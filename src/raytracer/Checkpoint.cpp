@@ -0,0 +1,88 @@
+#include "Checkpoint.h"
+
+#include <stdio.h>
+#include <memory>
+
+namespace raytracer
+{
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *fp) const { fclose(fp); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+constexpr uint32_t CHECKPOINT_MAGIC = 0x4B434352;
+constexpr uint32_t CHECKPOINT_VERSION = 1;
+
+struct CheckpointHeader {
+    public:
+        uint32_t magic;
+        uint32_t version;
+        RenderJob job;
+};
+
+}
+
+bool WriteCheckpoint(const std::string &filename, const Checkpoint &checkpoint) {
+    const std::string temp_filename = filename + ".tmp";
+    {
+        FilePtr fp(fopen(temp_filename.c_str(), "wb"));
+        if (!fp) {
+            return false;
+        }
+
+        CheckpointHeader header;
+        header.magic = CHECKPOINT_MAGIC;
+        header.version = CHECKPOINT_VERSION;
+        header.job = checkpoint.job;
+
+        const size_t total_pixels = static_cast<size_t>(checkpoint.job.width)*checkpoint.job.height;
+        bool is_success = fwrite(&header, sizeof(header), 1, fp.get()) == 1;
+        for (int c = 0; c < 3 && is_success; c++) {
+            is_success = fwrite(checkpoint.sums.GetPlane(c), sizeof(float), total_pixels, fp.get()) == total_pixels;
+        }
+        is_success = is_success && fwrite(checkpoint.sample_counts.data(), sizeof(uint32_t), total_pixels, fp.get()) == total_pixels;
+        is_success = is_success && fflush(fp.get()) == 0;
+        if (!is_success) {
+            return false;
+        }
+    }
+
+    // rename won't replace an existing file on windows
+    remove(filename.c_str());
+    return rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool ReadCheckpoint(const std::string &filename, Checkpoint &checkpoint) {
+    FilePtr fp(fopen(filename.c_str(), "rb"));
+    if (!fp) {
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (fread(&header, sizeof(header), 1, fp.get()) != 1) {
+        return false;
+    }
+    if (header.magic != CHECKPOINT_MAGIC || header.version != CHECKPOINT_VERSION) {
+        return false;
+    }
+    if (header.job.width <= 0 || header.job.height <= 0) {
+        return false;
+    }
+
+    checkpoint.job = header.job;
+    const size_t total_pixels = static_cast<size_t>(header.job.width)*header.job.height;
+    checkpoint.sums.Resize(header.job.width, header.job.height);
+    checkpoint.sample_counts.resize(total_pixels);
+
+    for (int c = 0; c < 3; c++) {
+        if (fread(checkpoint.sums.GetPlane(c), sizeof(float), total_pixels, fp.get()) != total_pixels) {
+            return false;
+        }
+    }
+    return fread(checkpoint.sample_counts.data(), sizeof(uint32_t), total_pixels, fp.get()) == total_pixels;
+}
+
+}
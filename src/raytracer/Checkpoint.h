@@ -0,0 +1,28 @@
+#pragma once
+
+#include "HDRBuffer.h"
+#include "RenderProtocol.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace raytracer
+{
+
+// Accumulation state of a progressive render, enough to continue it in another process
+// Since samples are a pure function of (seed, pixel, sample), the per-pixel sample count is also the rng position
+struct Checkpoint {
+    public:
+        // settings and camera the render was started with
+        RenderJob job;
+        // per-pixel sum of all samples taken so far
+        HDRBuffer sums;
+        std::vector<uint32_t> sample_counts;
+};
+
+// Written to a temporary file first and then renamed, so a crash never leaves a partial checkpoint
+bool WriteCheckpoint(const std::string &filename, const Checkpoint &checkpoint);
+bool ReadCheckpoint(const std::string &filename, Checkpoint &checkpoint);
+
+}
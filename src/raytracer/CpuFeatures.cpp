@@ -0,0 +1,52 @@
+#include "CpuFeatures.h"
+
+#include <atomic>
+
+namespace raytracer
+{
+
+const char *GetIsaName(CpuIsa isa) {
+    switch (isa) {
+    case CpuIsa::GENERIC:   return "Generic";
+    case CpuIsa::SSE4:      return "SSE4.2";
+    case CpuIsa::AVX2:      return "AVX2";
+    case CpuIsa::AVX512:    return "AVX-512";
+    default:                return "Unknown";
+    }
+}
+
+CpuIsa DetectIsa() {
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+    // reads cpuid and checks the OS saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && 
+        __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) 
+    {
+        return CpuIsa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CpuIsa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return CpuIsa::SSE4;
+    }
+#endif
+    // msvc can't compile the other levels into the same binary
+    return CpuIsa::GENERIC;
+}
+
+static std::atomic<CpuIsa> &ActiveIsa() {
+    static std::atomic<CpuIsa> isa{DetectIsa()};
+    return isa;
+}
+
+CpuIsa GetActiveIsa() {
+    return ActiveIsa().load(std::memory_order_relaxed);
+}
+
+void SetActiveIsa(CpuIsa isa) {
+    const CpuIsa best = DetectIsa();
+    ActiveIsa().store((isa < best) ? isa : best, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+namespace raytracer
+{
+
+// Instruction sets the hot loops are compiled for, in increasing order
+// Each level is built into the same binary with per function target attributes, and picked at runtime
+enum class CpuIsa { GENERIC, SSE4, AVX2, AVX512, TOTAL_ISAS };
+
+// only gcc and clang on x86 can target a single function at another instruction set
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RAYTRACER_HAS_ISA_TARGETS
+#define RAYTRACER_TARGET_SSE4   __attribute__((target("sse4.2")))
+#define RAYTRACER_TARGET_AVX2   __attribute__((target("avx2,fma")))
+#define RAYTRACER_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx2,fma")))
+#endif
+
+const char *GetIsaName(CpuIsa isa);
+// best instruction set supported by both the CPU and this build
+CpuIsa DetectIsa();
+// instruction set the kernels are picked for, starts as DetectIsa()
+CpuIsa GetActiveIsa();
+// lower the instruction set, for comparing them, it is clamped to DetectIsa()
+// only affects kernels that are picked after the call
+void SetActiveIsa(CpuIsa isa);
+
+}
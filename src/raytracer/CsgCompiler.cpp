@@ -0,0 +1,284 @@
+#include "CsgCompiler.h"
+#include "Scene.h"
+
+#include <algorithm>
+
+namespace raytracer
+{
+
+// rough cost of testing a ray against each type of shape, relative to a sphere
+static float GetShapeCost(ShapeType type) {
+    switch (type) {
+    case ShapeType::SPHERE:         return 1.0f;
+    case ShapeType::PLANE:          return 0.5f;
+    case ShapeType::BOX:            return 1.0f;
+    case ShapeType::ORIENTED_BOX:   return 1.5f;
+    case ShapeType::CYLINDER:       return 2.0f;
+    case ShapeType::CONE:           return 2.5f;
+    case ShapeType::DISC:           return 1.0f;
+    default:                        return 2.0f;
+    }
+}
+
+// cost of combining two span lists, relative to a sphere
+static constexpr float COMBINE_COST = 0.5f;
+// subtrees at least this expensive are skipped by testing their bounds first
+static constexpr float MIN_BOUNDS_TEST_COST = 4.0f;
+
+// chance that a ray through the parent's bounds also goes through the child's
+static float GetHitProbability(const Bounds &child, const Bounds &parent) {
+    const float parent_area = parent.GetSurfaceArea();
+    if (!child.IsFinite() || !parent.IsFinite() || parent_area <= 0.0f) {
+        return 1.0f;
+    }
+    return std::min(child.GetSurfaceArea() / parent_area, 1.0f);
+}
+
+namespace {
+
+// the tree is simplified and ordered before it is written out as a program
+class CsgTreeBuilder {
+    public:
+        static constexpr int EMPTY = -1;
+        static constexpr int UNKNOWN = -2;
+        struct Node {
+            public:
+                bool is_primitive;
+                int primitive;
+                CsgOperation operation;
+                // for operations, first is evaluated before second
+                int first, second;
+                Bounds bounds;
+                // expected cost of a ray through the bounds
+                float cost;
+                int stack_depth;
+        };
+        std::vector<Node> nodes;
+    public:
+        CsgTreeBuilder(const Scene &scene, CompiledCsg &csg, bool is_refittable)
+        : m_scene(scene), m_csg(csg), m_is_refittable(is_refittable) {}
+        // node index, EMPTY if nothing can be hit, or UNKNOWN if the tree can't be compiled
+        int Build(const IEntity *entity);
+        void Emit(int node, bool is_root);
+    private:
+        int AddPrimitive(const BasicEntity *entity);
+        int AddOperation(CsgOperation operation, int left, int right);
+    private:
+        const Scene &m_scene;
+        CompiledCsg &m_csg;
+        // subtrees can't be removed for not overlapping, since the shapes may move
+        bool m_is_refittable;
+};
+
+int CsgTreeBuilder::Build(const IEntity *entity) {
+    CsgOperation operation;
+    switch (m_scene.GetEntityType(entity)) {
+    case Scene::EntityType::BASIC:          return AddPrimitive(static_cast<const BasicEntity*>(entity));
+    case Scene::EntityType::UNION:          operation = CsgOperation::UNION; break;
+    case Scene::EntityType::INTERSECTION:   operation = CsgOperation::INTERSECTION; break;
+    case Scene::EntityType::DIFFERENCE:     operation = CsgOperation::DIFFERENCE; break;
+    default:                                return UNKNOWN;
+    }
+
+    const ICompositeEntity *composite = static_cast<const ICompositeEntity*>(entity);
+    const int left = Build(composite->GetLeft());
+    const int right = Build(composite->GetRight());
+    if (left == UNKNOWN || right == UNKNOWN) {
+        return UNKNOWN;
+    }
+    return AddOperation(operation, left, right);
+}
+
+int CsgTreeBuilder::AddPrimitive(const BasicEntity *entity) {
+    IMaterial *material = entity->GetMaterial();
+    auto it = std::find(m_csg.materials.begin(), m_csg.materials.end(), material);
+    if (it == m_csg.materials.end()) {
+        if (m_csg.materials.size() > UINT16_MAX) {
+            return UNKNOWN;
+        }
+        it = m_csg.materials.insert(m_csg.materials.end(), material);
+    }
+
+    CompiledCsg::Primitive primitive;
+    primitive.shape = entity->GetShape();
+    primitive.type = primitive.shape->GetType();
+    primitive.material = static_cast<uint16_t>(it - m_csg.materials.begin());
+    m_csg.primitives.push_back(primitive);
+
+    Node node;
+    node.is_primitive = true;
+    node.operation = CsgOperation::UNION;
+    node.primitive = static_cast<int>(m_csg.primitives.size()) - 1;
+    node.first = node.second = EMPTY;
+    node.bounds = primitive.shape->GetBounds().GetPadded();
+    node.cost = GetShapeCost(primitive.type);
+    node.stack_depth = 1;
+    nodes.push_back(node);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+int CsgTreeBuilder::AddOperation(CsgOperation operation, int left, int right) {
+    Node node;
+    node.is_primitive = false;
+    node.operation = operation;
+    node.primitive = -1;
+    node.first = left;
+    node.second = right;
+
+    switch (operation) {
+    case CsgOperation::UNION:
+        if (left == EMPTY) return right;
+        if (right == EMPTY) return left;
+        node.bounds = Bounds::Union(nodes[left].bounds, nodes[right].bounds);
+        // both sides are always evaluated, so start with the deeper one to keep the stack small
+        if (nodes[right].stack_depth > nodes[left].stack_depth) {
+            std::swap(node.first, node.second);
+        }
+        node.cost = nodes[left].cost + nodes[right].cost + COMBINE_COST;
+        break;
+    case CsgOperation::INTERSECTION:
+        if (left == EMPTY || right == EMPTY) return EMPTY;
+        node.bounds = Bounds::Intersection(nodes[left].bounds, nodes[right].bounds);
+        if (node.bounds.IsEmpty() && !m_is_refittable) return EMPTY;
+        {
+            // the second side is skipped when the first misses, so test the side that is cheaper and less likely to be hit
+            const Bounds both = Bounds::Union(nodes[left].bounds, nodes[right].bounds);
+            const Node &a = nodes[left], &b = nodes[right];
+            const float left_first = a.cost + GetHitProbability(a.bounds, both)*(b.cost + COMBINE_COST);
+            const float right_first = b.cost + GetHitProbability(b.bounds, both)*(a.cost + COMBINE_COST);
+            if (right_first < left_first) {
+                std::swap(node.first, node.second);
+            }
+            node.cost = std::min(left_first, right_first);
+        }
+        break;
+    case CsgOperation::DIFFERENCE:
+    default:
+        if (left == EMPTY) return EMPTY;
+        if (right == EMPTY) return left;
+        // nothing to subtract if they don't overlap
+        if (Bounds::Intersection(nodes[left].bounds, nodes[right].bounds).IsEmpty() && !m_is_refittable) return left;
+        node.bounds = nodes[left].bounds;
+        node.cost = nodes[left].cost + nodes[right].cost + COMBINE_COST;
+        break;
+    }
+
+    node.stack_depth = std::max(nodes[node.first].stack_depth, nodes[node.second].stack_depth+1);
+    nodes.push_back(node);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+void CsgTreeBuilder::Emit(int index, bool is_root) {
+    const Node &node = nodes[index];
+    auto &instructions = m_csg.instructions;
+    if (node.is_primitive) {
+        instructions.push_back({CompiledCsg::OpCode::PRIMITIVE, node.primitive});
+        return;
+    }
+
+    // the bounds of the root are tested before the program runs
+    const bool is_bounds_tested = !is_root && node.cost >= MIN_BOUNDS_TEST_COST && node.bounds.IsFinite();
+    const size_t bounds_test = instructions.size();
+    if (is_bounds_tested) {
+        instructions.push_back({CompiledCsg::OpCode::TEST_BOUNDS, static_cast<int>(m_csg.bounds_tests.size())});
+        m_csg.bounds_tests.push_back({node.bounds, 0});
+    }
+
+    Emit(node.first, false);
+    if (node.operation == CsgOperation::UNION) {
+        Emit(node.second, false);
+        instructions.push_back({CompiledCsg::OpCode::COMBINE, static_cast<int>(node.operation)});
+    } else {
+        // an empty first side gives an empty result, so the second side and the operation can be skipped
+        const size_t skip = instructions.size();
+        instructions.push_back({CompiledCsg::OpCode::BEGIN_SECOND, 0});
+        Emit(node.second, false);
+        instructions.push_back({CompiledCsg::OpCode::COMBINE, static_cast<int>(node.operation)});
+        instructions[skip].argument = static_cast<int>(instructions.size() - skip - 1);
+    }
+
+    if (is_bounds_tested) {
+        m_csg.bounds_tests[instructions[bounds_test].argument].skip = static_cast<int>(instructions.size() - bounds_test - 1);
+    }
+}
+
+}
+
+void CompiledCsg::Clear() {
+    programs.clear();
+    instructions.clear();
+    bounds_tests.clear();
+    primitives.clear();
+    materials.clear();
+}
+
+int CompiledCsg::Compile(const Scene &scene, const IEntity *entity, bool is_refittable) {
+    const size_t total_primitives = primitives.size();
+    const size_t total_materials = materials.size();
+
+    CsgTreeBuilder builder(scene, *this, is_refittable);
+    const int root = builder.Build(entity);
+    if (root == CsgTreeBuilder::UNKNOWN || (root >= 0 && builder.nodes[root].stack_depth > MAX_STACK_DEPTH)) {
+        primitives.resize(total_primitives);
+        materials.resize(total_materials);
+        return -1;
+    }
+
+    CsgProgram program;
+    program.first_instruction = static_cast<int>(instructions.size());
+    if (root == CsgTreeBuilder::EMPTY) {
+        program.stack_depth = 0;
+        program.bounds = {glm::vec3{1,1,1}, glm::vec3{-1,-1,-1}};
+    } else {
+        builder.Emit(root, true);
+        program.stack_depth = builder.nodes[root].stack_depth;
+        program.bounds = builder.nodes[root].bounds;
+    }
+    program.total_instructions = static_cast<int>(instructions.size()) - program.first_instruction;
+    programs.push_back(program);
+    return static_cast<int>(programs.size()) - 1;
+}
+
+void CompiledCsg::Refit() {
+    // run each program over bounds instead of span lists
+    for (CsgProgram &program: programs) {
+        m_refit_stack.clear();
+        m_refit_tests.clear();
+        const int end = program.first_instruction + program.total_instructions;
+        for (int i = program.first_instruction; i < end; i++) {
+            const Instruction &instruction = instructions[i];
+            switch (instruction.op) {
+            case OpCode::PRIMITIVE:
+                m_refit_stack.push_back(primitives[instruction.argument].shape->GetBounds().GetPadded());
+                break;
+            case OpCode::COMBINE:
+                {
+                    const Bounds second = m_refit_stack.back();
+                    m_refit_stack.pop_back();
+                    Bounds &first = m_refit_stack.back();
+                    switch (static_cast<CsgOperation>(instruction.argument)) {
+                    case CsgOperation::UNION:           first = Bounds::Union(first, second); break;
+                    case CsgOperation::INTERSECTION:    first = Bounds::Intersection(first, second); break;
+                    default:                            break;
+                    }
+                }
+                break;
+            case OpCode::TEST_BOUNDS:
+                // the subtree's bounds are known once its last instruction has run
+                m_refit_tests.push_back({instruction.argument, i + bounds_tests[instruction.argument].skip});
+                break;
+            case OpCode::BEGIN_SECOND:
+                break;
+            }
+            while (!m_refit_tests.empty() && m_refit_tests.back().second == i) {
+                bounds_tests[m_refit_tests.back().first].bounds = m_refit_stack.back();
+                m_refit_tests.pop_back();
+            }
+        }
+        if (!m_refit_stack.empty()) {
+            program.bounds = m_refit_stack.back();
+        }
+    }
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Shape.h"
+#include "Material.h"
+#include "Entity.h"
+
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+namespace raytracer
+{
+
+class Scene;
+
+// A CSG entity tree compiled into a postfix program
+struct CsgProgram {
+    public:
+        int first_instruction;
+        int total_instructions;
+        // span lists the program needs on the stack at once
+        int stack_depth;
+        // rays that miss these can't hit the entity, infinite if any of its shapes are unbounded
+        Bounds bounds;
+};
+
+// CSG entity trees compiled into postfix programs over one contiguous array of primitives
+// The programs are run without recursion or virtual calls by the render kernels, using a stack of span lists
+// While compiling:
+// - subtrees that can't be hit because their bounds don't overlap are removed
+// - the children of intersections are ordered so the cheaper and less likely to be hit one is tested first
+// - expensive subtrees are skipped by testing their bounds
+// - materials used by several primitives are stored once
+// Programs compiled to be refit keep the subtrees that don't overlap, so their bounds can be updated after shapes move
+struct CompiledCsg {
+    public:
+        // PRIMITIVE pushes the spans of a primitive, COMBINE replaces the top two span lists with their combination
+        // BEGIN_SECOND comes before the second side of an intersection or difference, and jumps over it if the first is empty
+        // otherwise the second side is only searched over the spans of the first, until they are combined
+        // TEST_BOUNDS pushes an empty span list and jumps over a subtree when the ray misses its bounds
+        enum class OpCode: uint8_t { PRIMITIVE, COMBINE, BEGIN_SECOND, TEST_BOUNDS };
+        struct Instruction {
+            public:
+                OpCode op;
+                // index of the primitive, the CsgOperation, how many instructions to skip, or index of the bounds test
+                int argument;
+        };
+        struct BoundsTest {
+            public:
+                Bounds bounds;
+                // instructions in the subtree
+                int skip;
+        };
+        struct Primitive {
+            public:
+                IShape *shape;
+                ShapeType type;
+                uint16_t material;
+        };
+        static constexpr int MAX_STACK_DEPTH = 8;
+    public:
+        std::vector<CsgProgram> programs;
+        std::vector<Instruction> instructions;
+        std::vector<BoundsTest> bounds_tests;
+        std::vector<Primitive> primitives;
+        std::vector<IMaterial*> materials;
+    public:
+        void Clear();
+        // compile an entity tree built from the scene's entities and return the program's index
+        // returns -1 if it holds an entity of an unknown type, or needs more than MAX_STACK_DEPTH span lists
+        int Compile(const Scene &scene, const IEntity *entity, bool is_refittable=false);
+        // update the bounds of every program and bounds test from the current shapes, without recompiling
+        // only valid when every program was compiled with is_refittable
+        void Refit();
+    private:
+        // bounds of each subtree while refitting
+        std::vector<Bounds> m_refit_stack;
+        std::vector<std::pair<int,int>> m_refit_tests;
+};
+
+}
@@ -2,88 +2,154 @@
 
 namespace raytracer {
 
-bool BasicEntity::CastRay(const Ray &ray, RayCast &cast) {
-    float t0, t1;
-    if (!m_shape->CheckHit(ray, t0, t1)) {
-        return false;
+bool RayCast::GetFirstSurface(float t_min, RaySurface &surface) const {
+    for (int i = 0; i < total_spans; i++) {
+        // if the span started behind us then we are inside it, and the next surface is its exit
+        const RaySpan &span = spans[i];
+        const RaySurface &candidate = (span.enter.t >= t_min) ? span.enter : span.exit;
+        if (candidate.t < t_min) {
+            continue;
+        }
+        if (candidate.t >= t_limit) {
+            return false;
+        }
+        surface = candidate;
+        return true;
     }
-
-    cast.t0 = t0;
-    cast.t1 = t1;
-    cast.shape = m_shape;
-    cast.material = m_material;
-    return true;
+    return false;
 }
 
-bool IntersectionEntity::CastRay(const Ray &ray, RayCast &cast) {
-    RayCast left_cast, right_cast;
+// surfaces of a cast in order, entering span i is surface i*2 and leaving it is i*2+1
+static inline const RaySurface &GetSurface(const RayCast &cast, int index) {
+    const RaySpan &span = cast.spans[index >> 1];
+    return (index & 1) ? span.exit : span.enter;
+}
 
-    bool left_cast_success = m_left->CastRay(ray, left_cast);
-    bool right_cast_success = m_right->CastRay(ray, right_cast);
+// Walks the surfaces of both casts in order, keeping track of whether the ray is inside each of them
+// A span of the result starts or ends wherever the operation applied to those two flags changes
+template <CsgOperation OPERATION>
+static void CombineSpans(const RayCast &left, const RayCast &right, RayCast &result) {
+    result.total_spans = 0;
+    result.t_limit = glm::min(left.t_limit, right.t_limit);
+
+    const int total_left = left.total_spans*2;
+    const int total_right = right.total_spans*2;
+    int left_index = 0, right_index = 0;
+    bool is_inside_left = false, is_inside_right = false, is_inside = false;
+
+    while (left_index < total_left || right_index < total_right) {
+        const bool is_left = 
+            (right_index == total_right) || 
+            (left_index < total_left && GetSurface(left, left_index).t <= GetSurface(right, right_index).t);
+        const RaySurface &surface = is_left ? GetSurface(left, left_index++) : GetSurface(right, right_index++);
+        if (surface.t >= result.t_limit) {
+            break;
+        }
+        is_inside_left ^= is_left;
+        is_inside_right ^= !is_left;
+
+        bool is_now_inside;
+        if constexpr(OPERATION == CsgOperation::UNION) {
+            is_now_inside = is_inside_left || is_inside_right;
+        } else if constexpr(OPERATION == CsgOperation::INTERSECTION) {
+            is_now_inside = is_inside_left && is_inside_right;
+        } else {
+            is_now_inside = is_inside_left && !is_inside_right;
+        }
+        if (is_now_inside == is_inside) {
+            continue;
+        }
+
+        if (is_now_inside) {
+            // out of room, so everything from here on is unknown
+            if (result.total_spans == RayCast::MAX_SPANS) {
+                result.t_limit = surface.t;
+                break;
+            }
+            result.spans[result.total_spans].enter = surface;
+        } else {
+            result.spans[result.total_spans++].exit = surface;
+        }
+        is_inside = is_now_inside;
+    }
 
-    if (!left_cast_success || !right_cast_success) {
-        return false;
+    // a span that was cut short by the limit ends there
+    if (is_inside) {
+        result.spans[result.total_spans++].exit = {result.t_limit, nullptr, nullptr};
     }
+}
 
-    float t0 = glm::max(left_cast.t0, right_cast.t0);
-    float t1 = glm::min(left_cast.t1, right_cast.t1);
-    if (t0 > t1) {
-        return false;
+void CombineSpans(CsgOperation operation, const RayCast &left, const RayCast &right, RayCast &result) {
+    switch (operation) {
+    case CsgOperation::UNION:           return CombineSpans<CsgOperation::UNION>(left, right, result);
+    case CsgOperation::INTERSECTION:    return CombineSpans<CsgOperation::INTERSECTION>(left, right, result);
+    case CsgOperation::DIFFERENCE:      return CombineSpans<CsgOperation::DIFFERENCE>(left, right, result);
     }
+}
 
-    cast.t0 = t0;
-    cast.t1 = t1;
+bool BasicEntity::CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const {
+    cast.total_spans = 0;
+    cast.t_limit = std::numeric_limits<float>::infinity();
 
-    bool hit_left = left_cast.t0 > right_cast.t0;
+    float t0, t1;
+    if (!m_shape->CheckHit(ray, t0, t1)) {
+        return false;
+    }
+    // outside the range we are looking in
+    if (t1 < t_min || t0 > t_max) {
+        return false;
+    }
 
-    cast.material = hit_left ? left_cast.material : right_cast.material;
-    cast.shape = hit_left ? left_cast.shape : right_cast.shape;
+    cast.spans[0].enter = {t0, m_shape, m_material};
+    cast.spans[0].exit = {t1, m_shape, m_material};
+    cast.total_spans = 1;
     return true;
 }
 
-bool DifferenceEntity::CastRay(const Ray &ray, RayCast &cast) {
+bool UnionEntity::CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const {
     RayCast left_cast, right_cast;
+    m_left->CastRay(ray, t_min, t_max, left_cast);
+    m_right->CastRay(ray, t_min, t_max, right_cast);
+    CombineSpans<CsgOperation::UNION>(left_cast, right_cast, cast);
+    return cast.total_spans > 0;
+}
 
-    bool left_cast_success = m_left->CastRay(ray, left_cast);
-    bool right_cast_success = m_right->CastRay(ray, right_cast);
-
-    if (!left_cast_success) {
+bool IntersectionEntity::CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const {
+    cast.total_spans = 0;
+    RayCast left_cast, right_cast;
+    if (!m_left->CastRay(ray, t_min, t_max, left_cast)) {
         return false;
     }
 
-    // don't subtract
-    if (!right_cast_success) {
-        cast = left_cast;
-        return true;
+    // the result is inside the left entity, so the right one is only needed over its spans
+    const float t_start = glm::max(t_min, left_cast.spans[0].enter.t);
+    const float t_end = glm::min(t_max, left_cast.spans[left_cast.total_spans-1].exit.t);
+    if (!m_right->CastRay(ray, t_start, t_end, right_cast)) {
+        return false;
     }
 
-    // difference is disjoint, don't substract
-    if (right_cast.t0 > left_cast.t1 || left_cast.t0 > right_cast.t1) {
-        cast = left_cast;
-        return true;
-    }
+    CombineSpans<CsgOperation::INTERSECTION>(left_cast, right_cast, cast);
+    return cast.total_spans > 0;
+}
 
-    // difference covers entire original entity
-    if (right_cast.t1 > left_cast.t1 && right_cast.t0 < left_cast.t0) {
+bool DifferenceEntity::CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const {
+    cast.total_spans = 0;
+    RayCast left_cast, right_cast;
+    if (!m_left->CastRay(ray, t_min, t_max, left_cast)) {
         return false;
     }
 
-    // difference is behind
-    if (right_cast.t0 > left_cast.t0) {
-        cast.t0 = left_cast.t0;
-        cast.t1 = glm::min(left_cast.t1, right_cast.t0);
-        cast.material = left_cast.material;
-        cast.shape = left_cast.shape;
+    // the result is inside the left entity, so the right one is only needed over its spans
+    const float t_start = glm::max(t_min, left_cast.spans[0].enter.t);
+    const float t_end = glm::min(t_max, left_cast.spans[left_cast.total_spans-1].exit.t);
+    // don't subtract
+    if (!m_right->CastRay(ray, t_start, t_end, right_cast)) {
+        cast = left_cast;
         return true;
     }
 
-
-    // difference is in front
-    cast.t0 = right_cast.t1;
-    cast.t1 = left_cast.t1;
-    cast.material = right_cast.material;
-    cast.shape = right_cast.shape;
-    return true;
+    CombineSpans<CsgOperation::DIFFERENCE>(left_cast, right_cast, cast);
+    return cast.total_spans > 0;
 }
 
-}
\ No newline at end of file
+}
@@ -4,30 +4,60 @@
 #include "Shape.h"
 #include "Material.h"
 
+#include <limits>
+
 namespace raytracer
 {
 
-// what shape and material did the raycast hit
-// what is the interval of the intersection
-struct RayCast {
+// where a ray crosses the surface of an entity, and which shape and material it belongs to
+struct RaySurface {
     public:
+        float t;
         IShape *shape;
         IMaterial *material;
-        float t0, t1;
 };
 
+// part of a ray inside an entity
+struct RaySpan {
+    public:
+        RaySurface enter;
+        RaySurface exit;
+};
+
+// the spans of a ray inside an entity, sorted and disjoint
+// held on the stack, so only the nearest MAX_SPANS are kept
+struct RayCast {
+    public:
+        static constexpr int MAX_SPANS = 8;
+        RaySpan spans[MAX_SPANS];
+        int total_spans{0};
+        // surfaces at or past this distance are unknown because spans were dropped
+        float t_limit{std::numeric_limits<float>::infinity()};
+    public:
+        // nearest surface at or past t_min, returns false if there isn't one
+        bool GetFirstSurface(float t_min, RaySurface &surface) const;
+};
+
+enum class CsgOperation { UNION, INTERSECTION, DIFFERENCE };
+
+// combine the spans of two entities, result must not be either of them
+void CombineSpans(CsgOperation operation, const RayCast &left, const RayCast &right, RayCast &result);
+
 // An entity can take in a ray, and return via params whether it hit anything
+// Spans outside of [t_min, t_max] may be left out, since they can't change the nearest surface in that range
 class IEntity
 {
     public:
-        virtual bool CastRay(const Ray &ray, RayCast &cast) = 0;
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const = 0;
 };
 
 class BasicEntity: public IEntity {
     public:
         BasicEntity(IShape* shape, IMaterial* material)
         : m_shape(shape), m_material(material) {}
-        virtual bool CastRay(const Ray &ray, RayCast &cast);
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const;
+        IShape *GetShape() const { return m_shape; }
+        IMaterial *GetMaterial() const { return m_material; }
     private:
         IShape* m_shape;
         IMaterial* m_material;
@@ -38,18 +68,28 @@ class ICompositeEntity: public IEntity {
     public:
         ICompositeEntity(IEntity* left, IEntity* right)
         : m_left(left), m_right(right) {}
-        virtual bool CastRay(const Ray &ray, RayCast &cast) = 0;
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const = 0;
+        IEntity *GetLeft() const { return m_left; }
+        IEntity *GetRight() const { return m_right; }
     protected:
         IEntity* m_left;
         IEntity* m_right;
 };
 
+// Create a new entity that covers both entities
+class UnionEntity: public ICompositeEntity {
+    public:
+        UnionEntity(IEntity* left, IEntity* right)
+        : ICompositeEntity(left, right) {}
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const;
+};
+
 // Create a new entity that is an intersection of two different entities
 class IntersectionEntity: public ICompositeEntity {
     public:
         IntersectionEntity(IEntity* left, IEntity* right)
         : ICompositeEntity(left, right) {}
-        virtual bool CastRay(const Ray &ray, RayCast &cast);
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const;
 };
 
 // Create a new entity that is the first entity subtracted by the second entity
@@ -57,7 +97,7 @@ class DifferenceEntity: public ICompositeEntity {
     public:
         DifferenceEntity(IEntity* left, IEntity* right)
         : ICompositeEntity(left, right) {}
-        virtual bool CastRay(const Ray &ray, RayCast &cast);
+        virtual bool CastRay(const Ray &ray, float t_min, float t_max, RayCast &cast) const;
 };
 
 }
\ No newline at end of file
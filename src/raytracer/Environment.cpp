@@ -0,0 +1,96 @@
+#include "Environment.h"
+#include "ImageWriter.h"
+
+#include <algorithm>
+
+namespace raytracer
+{
+
+bool EnvironmentMap::Load(const std::string &filename, float intensity) {
+    HDRBuffer image;
+    if (!ReadPFM(filename, image)) {
+        return false;
+    }
+    Create(image, intensity);
+    return true;
+}
+
+void EnvironmentMap::Create(const HDRBuffer &image, float intensity) {
+    m_width = image.GetWidth();
+    m_height = image.GetHeight();
+    const size_t stride = static_cast<size_t>(m_width) + 2;
+    m_texels.resize(stride * (m_height+1));
+    for (int y = 0; y <= m_height; y++) {
+        const int source_y = std::min(y, m_height-1);
+        glm::vec4 *row = m_texels.data() + y*stride;
+        for (int x = 0; x < m_width; x++) {
+            row[x+1] = glm::vec4(image.Read(x, source_y) * intensity, 0.0f);
+        }
+        // wrap around horizontally
+        row[0] = row[m_width];
+        row[m_width+1] = row[1];
+    }
+    BuildAliasTable();
+}
+
+void EnvironmentMap::Clear() {
+    m_width = 0;
+    m_height = 0;
+    m_texels.clear();
+    m_alias_table.clear();
+}
+
+void EnvironmentMap::BuildAliasTable() {
+    m_alias_table.clear();
+    const size_t total = static_cast<size_t>(m_width) * m_height;
+    const size_t stride = static_cast<size_t>(m_width) + 2;
+
+    // each pixel's share of the light, its luminance times the solid angle its row covers
+    std::vector<double> weights(total);
+    double total_weight = 0.0;
+    for (int y = 0; y < m_height; y++) {
+        const double sin_theta = std::sin((y + 0.5) * PI / m_height);
+        for (int x = 0; x < m_width; x++) {
+            const glm::vec4 &texel = m_texels[y*stride + x+1];
+            const double luminance = 0.2126*texel.r + 0.7152*texel.g + 0.0722*texel.b;
+            const double weight = std::max(luminance, 0.0) * sin_theta;
+            weights[x + y*m_width] = weight;
+            total_weight += weight;
+        }
+    }
+    if (!(total_weight > 0.0)) {
+        return;
+    }
+
+    // Vose's method: pixels under the average are topped up by ones above it
+    m_alias_table.resize(total);
+    std::vector<double> scaled(total);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < total; i++) {
+        scaled[i] = weights[i] * total / total_weight;
+        m_alias_table[i].pdf = static_cast<float>(scaled[i]);
+        m_alias_table[i].alias = static_cast<uint32_t>(i);
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        const uint32_t s = small.back();
+        small.pop_back();
+        const uint32_t l = large.back();
+        m_alias_table[s].threshold = static_cast<float>(scaled[s]);
+        m_alias_table[s].alias = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // whatever is left is within rounding of the average
+    for (uint32_t i: small) {
+        m_alias_table[i].threshold = 1.0f;
+    }
+    for (uint32_t i: large) {
+        m_alias_table[i].threshold = 1.0f;
+    }
+}
+
+}
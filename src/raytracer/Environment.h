@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Ray.h"
+#include "Shape.h"
+#include "Material.h"
+#include "Sampler.h"
+#include "HDRBuffer.h"
+
+#include <glm/glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cmath>
+
+namespace raytracer
+{
+
+// Light arriving from infinitely far away, given by an equirectangular image around the scene
+// The top row is +y and the centre of the image is -z, with longitude increasing towards +x
+// Texels are stored as padded RGBA with a wrapped column on either side and the last row repeated,
+// so a bilinear lookup is four aligned vec4 loads without any bounds checks
+// Pixels are importance sampled by their luminance times their solid angle through an alias table,
+// which is what lets diffuse surfaces sample a small bright sun directly instead of hoping to bounce into it
+class EnvironmentMap {
+    public:
+        // a light sampled from the environment, pdf is in solid angle and 0 if nothing could be sampled
+        struct LightSample {
+            public:
+                glm::vec3 direction;
+                glm::vec3 radiance;
+                float pdf;
+        };
+    public:
+        // equirectangular PFM image, scaled by intensity
+        bool Load(const std::string &filename, float intensity=1.0f);
+        void Create(const HDRBuffer &image, float intensity=1.0f);
+        void Clear();
+        // an empty environment leaves escaped rays with their colour, the same as a white sky
+        bool IsEmpty() const { return m_width == 0; }
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
+        // bilinear lookup of the light arriving along direction
+        inline glm::vec3 Evaluate(const glm::vec3 &direction) const;
+        // u_pick selects a pixel from the alias table and u_pixel the point inside it
+        inline LightSample Sample(const glm::vec2 &u_pick, const glm::vec2 &u_pixel) const;
+        // solid angle density of Sample picking direction
+        inline float GetPdf(const glm::vec3 &direction) const;
+        // light of a ray that escaped the scene, weighted against sampling it directly with the power heuristic
+        // bounce_pdf is the density of the bounce that sent the ray, or 0 if it can't be sampled directly
+        inline glm::vec3 EvaluateEscape(const glm::vec3 &direction, float bounce_pdf) const;
+        // next event estimation at a diffuse surface before the ray scatters off it
+        // bounce_pdf(direction) gives the density of the surface scattering in a direction
+        // and is_occluded(ray) tests the shadow ray towards the light
+        template <typename BouncePdf, typename IsOccluded>
+        inline glm::vec3 SampleDirect(
+            const Lambertian &material, const Ray &ray, const Collision &collision, Sampler &sampler,
+            BouncePdf bounce_pdf, IsOccluded is_occluded) const;
+    public:
+        // coordinates in [0,1)x[0,1] of a direction on the image, and back
+        static inline glm::vec2 ToSquare(const glm::vec3 &direction);
+        static inline glm::vec3 ToDirection(const glm::vec2 &square);
+    private:
+        static constexpr float PI = 3.14159265f;
+        // pixel i is kept with chance threshold, otherwise its alias is taken
+        // pdf is the density over the image's unit square of the pixel being sampled
+        struct AliasEntry {
+            public:
+                float threshold;
+                uint32_t alias;
+                float pdf;
+        };
+        static inline float PowerHeuristic(float pdf, float other_pdf) {
+            const float a = pdf*pdf;
+            const float b = other_pdf*other_pdf;
+            return (a > 0.0f) ? a / (a + b) : 0.0f;
+        }
+        void BuildAliasTable();
+    private:
+        int m_width{0}, m_height{0};
+        // m_width+2 texels per row and m_height+1 rows
+        std::vector<glm::vec4> m_texels;
+        // empty if the whole image is black
+        std::vector<AliasEntry> m_alias_table;
+};
+
+inline glm::vec2 EnvironmentMap::ToSquare(const glm::vec3 &direction) {
+    const float u = 0.5f + std::atan2(direction.x, -direction.z) * (0.5f/PI);
+    const float v = std::acos(glm::clamp(direction.y, -1.0f, 1.0f)) * (1.0f/PI);
+    return glm::vec2{u, v};
+}
+
+inline glm::vec3 EnvironmentMap::ToDirection(const glm::vec2 &square) {
+    const float phi = (square.x - 0.5f) * (2.0f*PI);
+    const float theta = square.y * PI;
+    const float sin_theta = std::sin(theta);
+    return glm::vec3{sin_theta*std::sin(phi), std::cos(theta), -sin_theta*std::cos(phi)};
+}
+
+inline glm::vec3 EnvironmentMap::Evaluate(const glm::vec3 &direction) const {
+    const glm::vec2 square = ToSquare(direction);
+    // texel centres are at half coordinates, the padding column on the left makes x+1 always positive
+    const float x = square.x*m_width + 0.5f;
+    const float y = glm::clamp(square.y*m_height - 0.5f, 0.0f, static_cast<float>(m_height-1));
+    const int x0 = std::min(static_cast<int>(x), m_width);
+    const int y0 = static_cast<int>(y);
+    const float fx = x - static_cast<float>(x0);
+    const float fy = y - static_cast<float>(y0);
+
+    const size_t stride = static_cast<size_t>(m_width) + 2;
+    const glm::vec4 *row = m_texels.data() + y0*stride + x0;
+    const glm::vec4 top = row[0]*(1.0f - fx) + row[1]*fx;
+    const glm::vec4 bottom = row[stride]*(1.0f - fx) + row[stride+1]*fx;
+    return glm::vec3(top*(1.0f - fy) + bottom*fy);
+}
+
+inline EnvironmentMap::LightSample EnvironmentMap::Sample(const glm::vec2 &u_pick, const glm::vec2 &u_pixel) const {
+    LightSample sample;
+    sample.pdf = 0.0f;
+    if (m_alias_table.empty()) {
+        return sample;
+    }
+    const uint32_t total = static_cast<uint32_t>(m_alias_table.size());
+    uint32_t index = std::min(static_cast<uint32_t>(u_pick.x * static_cast<float>(total)), total-1);
+    if (u_pick.y >= m_alias_table[index].threshold) {
+        index = m_alias_table[index].alias;
+    }
+
+    const int px = static_cast<int>(index % static_cast<uint32_t>(m_width));
+    const int py = static_cast<int>(index / static_cast<uint32_t>(m_width));
+    const glm::vec2 square{
+        (static_cast<float>(px) + u_pixel.x) / static_cast<float>(m_width),
+        (static_cast<float>(py) + u_pixel.y) / static_cast<float>(m_height)};
+    // the image covers 2pi by pi radians, and rows shrink towards the poles by sin(theta)
+    const float sin_theta = std::sin(square.y * PI);
+    if (sin_theta <= 0.0f) {
+        return sample;
+    }
+    sample.direction = ToDirection(square);
+    sample.radiance = Evaluate(sample.direction);
+    sample.pdf = m_alias_table[index].pdf / (2.0f*PI*PI*sin_theta);
+    return sample;
+}
+
+inline float EnvironmentMap::GetPdf(const glm::vec3 &direction) const {
+    if (m_alias_table.empty()) {
+        return 0.0f;
+    }
+    const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - direction.y*direction.y));
+    if (sin_theta <= 0.0f) {
+        return 0.0f;
+    }
+    const glm::vec2 square = ToSquare(direction);
+    const int px = std::min(static_cast<int>(square.x * m_width), m_width-1);
+    const int py = std::min(static_cast<int>(square.y * m_height), m_height-1);
+    return m_alias_table[px + py*m_width].pdf / (2.0f*PI*PI*sin_theta);
+}
+
+inline glm::vec3 EnvironmentMap::EvaluateEscape(const glm::vec3 &direction, float bounce_pdf) const {
+    const glm::vec3 radiance = Evaluate(direction);
+    if (bounce_pdf <= 0.0f) {
+        return radiance;
+    }
+    return radiance * PowerHeuristic(bounce_pdf, GetPdf(direction));
+}
+
+template <typename BouncePdf, typename IsOccluded>
+inline glm::vec3 EnvironmentMap::SampleDirect(
+    const Lambertian &material, const Ray &ray, const Collision &collision, Sampler &sampler,
+    BouncePdf bounce_pdf, IsOccluded is_occluded) const
+{
+    // the dimensions are always taken so the bounce after uses the same ones whether or not this finds light
+    const glm::vec2 u_pick = sampler.Next2D();
+    const glm::vec2 u_pixel = sampler.Next2D();
+    const LightSample light = Sample(u_pick, u_pixel);
+    if (light.pdf <= 0.0f) {
+        return glm::vec3{0,0,0};
+    }
+    const float cos_theta = glm::dot(light.direction, collision.normal);
+    if (cos_theta <= 0.0f) {
+        return glm::vec3{0,0,0};
+    }
+
+    Ray shadow;
+    shadow.origin = collision.pos;
+    shadow.direction = light.direction;
+    if (is_occluded(shadow)) {
+        return glm::vec3{0,0,0};
+    }
+    const float weight = PowerHeuristic(light.pdf, bounce_pdf(light.direction));
+    const glm::vec3 reflectance = material.GetColor(ray, collision) * (cos_theta / PI);
+    return ray.color * reflectance * light.radiance * (weight / light.pdf);
+}
+
+}
@@ -0,0 +1,101 @@
+#include "Framebuffer.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace raytracer
+{
+
+Framebuffer::Framebuffer(int cell_size)
+: m_cell_size(std::max(1, cell_size))
+{}
+
+void Framebuffer::Resize(int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_total_cells_x = (width + m_cell_size - 1) / m_cell_size;
+    m_total_cells_y = (height + m_cell_size - 1) / m_cell_size;
+
+    const size_t total_bytes = static_cast<size_t>(width)*height*TOTAL_CHANNELS;
+    m_back.resize(total_bytes);
+    m_front.resize(total_bytes);
+
+    const size_t total_cells = static_cast<size_t>(m_total_cells_x)*m_total_cells_y;
+    m_total_dirty_words = (total_cells + 63) / 64;
+    if (m_total_dirty_words > m_dirty_capacity) {
+        m_dirty = std::make_unique<std::atomic<uint64_t>[]>(m_total_dirty_words);
+        m_dirty_capacity = m_total_dirty_words;
+    }
+    for (size_t i = 0; i < m_total_dirty_words; i++) {
+        m_dirty[i].store(0, std::memory_order_relaxed);
+    }
+    m_is_cell_dirty.assign(total_cells, 0);
+}
+
+void Framebuffer::MarkDirty(int x_start, int x_end, int y_start, int y_end) {
+    if (x_start >= x_end || y_start >= y_end) {
+        return;
+    }
+    const int cx_start = x_start / m_cell_size;
+    const int cx_end = (x_end - 1) / m_cell_size;
+    const int cy_start = y_start / m_cell_size;
+    const int cy_end = (y_end - 1) / m_cell_size;
+    for (int cy = cy_start; cy <= cy_end; cy++) {
+        for (int cx = cx_start; cx <= cx_end; cx++) {
+            const size_t cell = cx + static_cast<size_t>(cy)*m_total_cells_x;
+            // release so the pixels are visible to the thread that clears the bit
+            m_dirty[cell / 64].fetch_or(uint64_t(1) << (cell % 64), std::memory_order_release);
+        }
+    }
+}
+
+const std::vector<Framebuffer::Rect> &Framebuffer::Present() {
+    m_rects.clear();
+
+    // clear the bits before copying, so a cell written again during the copy stays dirty
+    bool has_dirty = false;
+    for (size_t i = 0; i < m_total_dirty_words; i++) {
+        uint64_t bits = m_dirty[i].exchange(0, std::memory_order_acquire);
+        for (int bit = 0; bits != 0; bit++, bits >>= 1) {
+            if (bits & 1) {
+                m_is_cell_dirty[i*64 + bit] = 1;
+                has_dirty = true;
+            }
+        }
+    }
+    if (!has_dirty) {
+        return m_rects;
+    }
+
+    // merge runs of dirty cells along each row of cells into one rectangle
+    const size_t stride = static_cast<size_t>(m_width)*TOTAL_CHANNELS;
+    for (int cy = 0; cy < m_total_cells_y; cy++) {
+        int cx = 0;
+        while (cx < m_total_cells_x) {
+            const size_t row = static_cast<size_t>(cy)*m_total_cells_x;
+            if (!m_is_cell_dirty[row + cx]) {
+                cx++;
+                continue;
+            }
+            const int run_start = cx;
+            while (cx < m_total_cells_x && m_is_cell_dirty[row + cx]) {
+                m_is_cell_dirty[row + cx] = 0;
+                cx++;
+            }
+
+            Rect rect;
+            rect.x = run_start*m_cell_size;
+            rect.y = cy*m_cell_size;
+            rect.width = std::min(cx*m_cell_size, m_width) - rect.x;
+            rect.height = std::min((cy+1)*m_cell_size, m_height) - rect.y;
+            for (int y = rect.y; y < rect.y + rect.height; y++) {
+                const size_t offset = y*stride + static_cast<size_t>(rect.x)*TOTAL_CHANNELS;
+                memcpy(m_front.data() + offset, m_back.data() + offset, static_cast<size_t>(rect.width)*TOTAL_CHANNELS);
+            }
+            m_rects.push_back(rect);
+        }
+    }
+    return m_rects;
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include "Allocator.h"
+
+namespace raytracer
+{
+
+// Display output of the renderer, RGBA with 8 bits per channel
+// Worker threads write into the back buffer and then mark the cells they changed as dirty
+// Present copies the dirty cells into the front buffer, which only the presenting thread touches,
+// so the viewer can upload it without racing the renderer
+class Framebuffer {
+    public:
+        struct Rect {
+            public:
+                int x, y, width, height;
+        };
+        static constexpr int TOTAL_CHANNELS = 4;
+    public:
+        Framebuffer(int cell_size=32);
+        // must not be called while the back buffer is being written
+        // the back buffer is left uninitialised, it is up to the renderer to write every pixel
+        // memory is only reallocated when growing past the largest size so far
+        void Resize(int width, int height);
+        inline int GetWidth() const { return m_width; }
+        inline int GetHeight() const { return m_height; }
+        inline uint8_t *GetBackBuffer() { return m_back.data(); }
+        inline const uint8_t *GetFrontBuffer() const { return m_front.data(); }
+        // called by writers once they are done with a region of the back buffer, safe from any thread
+        void MarkDirty(int x_start, int x_end, int y_start, int y_end);
+        // copy the dirty cells into the front buffer and return the rectangles that changed
+        // only one thread may present at a time
+        const std::vector<Rect> &Present();
+        // copy of the front buffer as of the last Present
+        std::vector<uint8_t> Snapshot() const { return m_front; }
+    private:
+        const int m_cell_size;
+        int m_width{0}, m_height{0};
+        int m_total_cells_x{0}, m_total_cells_y{0};
+        std::vector<uint8_t, DefaultInitAllocator<uint8_t>> m_back;
+        std::vector<uint8_t> m_front;
+        // one bit per cell, set by writers and cleared by Present
+        std::unique_ptr<std::atomic<uint64_t>[]> m_dirty;
+        size_t m_total_dirty_words{0};
+        size_t m_dirty_capacity{0};
+        // scratch space for Present
+        std::vector<uint8_t> m_is_cell_dirty;
+        std::vector<Rect> m_rects;
+};
+
+}
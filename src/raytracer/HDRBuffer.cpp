@@ -0,0 +1,42 @@
+#include "HDRBuffer.h"
+
+#include <algorithm>
+
+namespace raytracer
+{
+
+void HDRBuffer::Resize(int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_plane_size = static_cast<size_t>(width)*static_cast<size_t>(height);
+    m_data.resize(m_plane_size*3);
+}
+
+void HDRBuffer::Clear() {
+    std::fill(m_data.begin(), m_data.end(), 0.0f);
+}
+
+void ResampleBilinear(const HDRBuffer &src, HDRBuffer &dst, int x_start, int x_end, int y_start, int y_end) {
+    const int src_width = src.GetWidth();
+    const int src_height = src.GetHeight();
+    const float x_scale = (float)src_width / (float)dst.GetWidth();
+    const float y_scale = (float)src_height / (float)dst.GetHeight();
+
+    for (int y = y_start; y < y_end; y++) {
+        const float v = std::min(std::max((y + 0.5f)*y_scale - 0.5f, 0.0f), (float)(src_height-1));
+        const int y0 = static_cast<int>(v);
+        const int y1 = std::min(y0+1, src_height-1);
+        const float fy = v - (float)y0;
+        for (int x = x_start; x < x_end; x++) {
+            const float u = std::min(std::max((x + 0.5f)*x_scale - 0.5f, 0.0f), (float)(src_width-1));
+            const int x0 = static_cast<int>(u);
+            const int x1 = std::min(x0+1, src_width-1);
+            const float fx = u - (float)x0;
+            const glm::vec3 top = glm::mix(src.Read(x0, y0), src.Read(x1, y0), fx);
+            const glm::vec3 bottom = glm::mix(src.Read(x0, y1), src.Read(x1, y1), fx);
+            dst.Write(x, y, glm::mix(top, bottom, fy));
+        }
+    }
+}
+
+}
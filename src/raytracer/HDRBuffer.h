@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+#include <vector>
+#include <stddef.h>
+#include "Allocator.h"
+
+namespace raytracer
+{
+
+// Linear floating point colour image
+// Each channel is stored in its own plane so stages like tonemapping can run over contiguous floats
+class HDRBuffer {
+    public:
+        HDRBuffer() {}
+        HDRBuffer(int width, int height) { Resize(width, height); }
+        // reuses the previous allocation if it is large enough, new pixels are left uninitialised
+        void Resize(int width, int height);
+        void Clear();
+        inline int GetWidth() const { return m_width; }
+        inline int GetHeight() const { return m_height; }
+        inline float *GetPlane(int channel) { return m_data.data() + channel*m_plane_size; }
+        inline const float *GetPlane(int channel) const { return m_data.data() + channel*m_plane_size; }
+        inline void Write(int x, int y, const glm::vec3 &color) {
+            size_t i = x + static_cast<size_t>(y)*m_width;
+            m_data[i] = color.r;
+            m_data[i + m_plane_size] = color.g;
+            m_data[i + 2*m_plane_size] = color.b;
+        }
+        inline glm::vec3 Read(int x, int y) const {
+            size_t i = x + static_cast<size_t>(y)*m_width;
+            return glm::vec3{m_data[i], m_data[i + m_plane_size], m_data[i + 2*m_plane_size]};
+        }
+    private:
+        int m_width{0}, m_height{0};
+        size_t m_plane_size{0};
+        std::vector<float, DefaultInitAllocator<float>> m_data;
+};
+
+// bilinear resample of src into the region [x_start,x_end) x [y_start,y_end) of dst, with pixel centres aligned
+void ResampleBilinear(const HDRBuffer &src, HDRBuffer &dst, int x_start, int x_end, int y_start, int y_end);
+
+}
@@ -0,0 +1,491 @@
+#include "ImageWriter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#ifdef RAYTRACER_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace raytracer
+{
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *fp) const { fclose(fp); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+// all of the formats below are little endian, except for png chunks
+template <typename T>
+void Append(std::vector<uint8_t> &out, T value) {
+    uint8_t bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes+sizeof(T));
+}
+
+void AppendString(std::vector<uint8_t> &out, const char *str) {
+    out.insert(out.end(), str, str+strlen(str)+1);
+}
+
+void AppendBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back((value >> 24) & 0xFF);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+uint32_t Adler32(const uint8_t *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) {
+#ifdef RAYTRACER_HAS_ZLIB
+    return static_cast<uint32_t>(crc32(crc, data, static_cast<uInt>(size)));
+#else
+    static uint32_t table[256] = {0};
+    static bool is_init = false;
+    if (!is_init) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        is_init = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+#endif
+}
+
+// Produce a zlib stream for png and exr
+// Without zlib the data is still valid but stored in uncompressed deflate blocks
+std::vector<uint8_t> ZlibCompress(const uint8_t *data, size_t size) {
+    std::vector<uint8_t> out;
+#ifdef RAYTRACER_HAS_ZLIB
+    uLongf out_size = compressBound(static_cast<uLong>(size));
+    out.resize(out_size);
+    // favour speed since we write while the next render is running
+    if (compress2(out.data(), &out_size, data, static_cast<uLong>(size), Z_BEST_SPEED) == Z_OK) {
+        out.resize(out_size);
+        return out;
+    }
+    out.clear();
+#endif
+    constexpr size_t MAX_BLOCK_SIZE = 65535;
+    out.reserve(size + (size/MAX_BLOCK_SIZE + 1)*5 + 6);
+    out.push_back(0x78);
+    out.push_back(0x01);
+    size_t offset = 0;
+    do {
+        const size_t n = std::min(MAX_BLOCK_SIZE, size-offset);
+        const bool is_final = offset+n == size;
+        out.push_back(is_final ? 1 : 0);
+        Append<uint16_t>(out, static_cast<uint16_t>(n));
+        Append<uint16_t>(out, static_cast<uint16_t>(~n));
+        out.insert(out.end(), data+offset, data+offset+n);
+        offset += n;
+    } while (offset < size);
+    AppendBigEndian(out, Adler32(data, size));
+    return out;
+}
+
+bool WriteFile(const std::string &filename, const std::vector<uint8_t> &data) {
+    FilePtr fp(fopen(filename.c_str(), "wb"));
+    if (!fp) {
+        return false;
+    }
+    return fwrite(data.data(), 1, data.size(), fp.get()) == data.size();
+}
+
+// exr channels are stored in alphabetical order, B G R, from the planes R G B
+const char *const EXR_CHANNEL_NAMES[3] = {"B", "G", "R"};
+const int EXR_CHANNEL_PLANES[3] = {2, 1, 0};
+
+// header of a single part exr with 32bit float RGB channels, tiled when tile_size isn't 0
+void AppendEXRHeader(std::vector<uint8_t> &out, int width, int height, EXRCompression compression, int tile_size) {
+    Append<uint32_t>(out, 20000630);
+    // version 2, with the single part tiled flag
+    Append<uint32_t>(out, (tile_size > 0) ? 2 | 0x200 : 2);
+
+    AppendString(out, "channels");
+    AppendString(out, "chlist");
+    Append<int32_t>(out, 3*(2 + 16) + 1);
+    for (auto name: EXR_CHANNEL_NAMES) {
+        AppendString(out, name);
+        Append<int32_t>(out, 2);        // FLOAT
+        Append<uint32_t>(out, 0);       // pLinear and reserved
+        Append<int32_t>(out, 1);        // x sampling
+        Append<int32_t>(out, 1);        // y sampling
+    }
+    out.push_back(0);
+
+    AppendString(out, "compression");
+    AppendString(out, "compression");
+    Append<int32_t>(out, 1);
+    out.push_back(compression == EXRCompression::ZIP ? 3 : 0);
+
+    for (auto window: {"dataWindow", "displayWindow"}) {
+        AppendString(out, window);
+        AppendString(out, "box2i");
+        Append<int32_t>(out, 16);
+        Append<int32_t>(out, 0);
+        Append<int32_t>(out, 0);
+        Append<int32_t>(out, width-1);
+        Append<int32_t>(out, height-1);
+    }
+
+    // tiles are written as they finish, so their order in the file is random
+    AppendString(out, "lineOrder");
+    AppendString(out, "lineOrder");
+    Append<int32_t>(out, 1);
+    out.push_back((tile_size > 0) ? 2 : 0);
+
+    AppendString(out, "pixelAspectRatio");
+    AppendString(out, "float");
+    Append<int32_t>(out, 4);
+    Append<float>(out, 1.0f);
+
+    AppendString(out, "screenWindowCenter");
+    AppendString(out, "v2f");
+    Append<int32_t>(out, 8);
+    Append<float>(out, 0.0f);
+    Append<float>(out, 0.0f);
+
+    AppendString(out, "screenWindowWidth");
+    AppendString(out, "float");
+    Append<int32_t>(out, 4);
+    Append<float>(out, 1.0f);
+
+    if (tile_size > 0) {
+        AppendString(out, "tiles");
+        AppendString(out, "tiledesc");
+        Append<int32_t>(out, 9);
+        Append<uint32_t>(out, static_cast<uint32_t>(tile_size));
+        Append<uint32_t>(out, static_cast<uint32_t>(tile_size));
+        out.push_back(0);               // one level, rounded down
+    }
+
+    out.push_back(0);
+}
+
+// data and data_size are pointed at the compressed block, unless it is no smaller than the raw block
+void CompressEXRBlock(
+    const std::vector<uint8_t> &block, EXRCompression compression,
+    std::vector<uint8_t> &shuffled, std::vector<uint8_t> &compressed,
+    const uint8_t *&data, size_t &data_size)
+{
+    data = block.data();
+    data_size = block.size();
+    if (compression != EXRCompression::ZIP || block.empty()) {
+        return;
+    }
+
+    // split the even and odd bytes, then delta encode them, before deflating
+    shuffled.resize(block.size());
+    uint8_t *t1 = shuffled.data();
+    uint8_t *t2 = shuffled.data() + (block.size()+1)/2;
+    for (size_t j = 0; j < block.size(); j++) {
+        if (j % 2 == 0) {
+            *t1++ = block[j];
+        } else {
+            *t2++ = block[j];
+        }
+    }
+    int prev = shuffled[0];
+    for (size_t j = 1; j < shuffled.size(); j++) {
+        int curr = shuffled[j];
+        shuffled[j] = static_cast<uint8_t>(curr - prev + (128 + 256));
+        prev = curr;
+    }
+
+    compressed = ZlibCompress(shuffled.data(), shuffled.size());
+    // readers expect incompressible blocks to be stored raw
+    if (compressed.size() < block.size()) {
+        data = compressed.data();
+        data_size = compressed.size();
+    }
+}
+
+}
+
+bool WritePFM(const std::string &filename, const HDRBuffer &hdr) {
+    const int width = hdr.GetWidth();
+    const int height = hdr.GetHeight();
+
+    FilePtr fp(fopen(filename.c_str(), "wb"));
+    if (!fp) {
+        return false;
+    }
+
+    // negative scale indicates little endian
+    fprintf(fp.get(), "PF\n%d %d\n-1.0\n", width, height);
+
+    // scanlines are stored from bottom to top
+    std::vector<float> row(static_cast<size_t>(width)*3);
+    for (int y = height-1; y >= 0; y--) {
+        const size_t offset = static_cast<size_t>(y)*width;
+        for (int c = 0; c < 3; c++) {
+            const float *plane = hdr.GetPlane(c) + offset;
+            for (int x = 0; x < width; x++) {
+                row[x*3 + c] = plane[x];
+            }
+        }
+        if (fwrite(row.data(), sizeof(float), row.size(), fp.get()) != row.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReadPFM(const std::string &filename, HDRBuffer &hdr) {
+    FilePtr fp(fopen(filename.c_str(), "rb"));
+    if (!fp) {
+        return false;
+    }
+
+    char type[3] = {0};
+    int width, height;
+    float scale;
+    if (fscanf(fp.get(), "%2s %d %d %f", type, &width, &height, &scale) != 4) {
+        return false;
+    }
+    // a single whitespace character separates the header from the data
+    fgetc(fp.get());
+    const bool is_colour = strcmp(type, "PF") == 0;
+    if ((!is_colour && strcmp(type, "Pf") != 0) || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    const int total_channels = is_colour ? 3 : 1;
+    // negative scale indicates little endian
+    const uint16_t endian_test = 1;
+    const bool is_host_little_endian = *reinterpret_cast<const uint8_t*>(&endian_test) == 1;
+    const bool is_swapped = (scale < 0.0f) != is_host_little_endian;
+
+    hdr.Resize(width, height);
+    std::vector<float> row(static_cast<size_t>(width)*total_channels);
+    for (int y = height-1; y >= 0; y--) {
+        if (fread(row.data(), sizeof(float), row.size(), fp.get()) != row.size()) {
+            return false;
+        }
+        if (is_swapped) {
+            for (float &value: row) {
+                uint8_t bytes[4];
+                memcpy(bytes, &value, 4);
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+                memcpy(&value, bytes, 4);
+            }
+        }
+        for (int x = 0; x < width; x++) {
+            const float *pixel = row.data() + x*total_channels;
+            hdr.Write(x, y, is_colour ? glm::vec3{pixel[0], pixel[1], pixel[2]} : glm::vec3{pixel[0]});
+        }
+    }
+    return true;
+}
+
+// https://openexr.com/en/latest/OpenEXRFileLayout.html
+bool WriteEXR(const std::string &filename, const HDRBuffer &hdr, EXRCompression compression) {
+    const int width = hdr.GetWidth();
+    const int height = hdr.GetHeight();
+    // zip compresses blocks of 16 scanlines
+    const int lines_per_block = (compression == EXRCompression::ZIP) ? 16 : 1;
+    const int total_blocks = (height + lines_per_block - 1) / lines_per_block;
+
+    std::vector<uint8_t> out;
+    AppendEXRHeader(out, width, height, compression, 0);
+
+    // offset table is filled in as the blocks are written
+    const size_t offset_table = out.size();
+    out.resize(out.size() + total_blocks*sizeof(uint64_t));
+
+    std::vector<uint8_t> block;
+    std::vector<uint8_t> shuffled;
+    std::vector<uint8_t> compressed;
+    for (int i = 0; i < total_blocks; i++) {
+        const int y_start = i*lines_per_block;
+        const int y_end = std::min(y_start+lines_per_block, height);
+
+        block.clear();
+        for (int y = y_start; y < y_end; y++) {
+            for (int c = 0; c < 3; c++) {
+                const float *plane = hdr.GetPlane(EXR_CHANNEL_PLANES[c]) + static_cast<size_t>(y)*width;
+                const uint8_t *bytes = reinterpret_cast<const uint8_t*>(plane);
+                block.insert(block.end(), bytes, bytes + width*sizeof(float));
+            }
+        }
+
+        const uint8_t *data;
+        size_t data_size;
+        CompressEXRBlock(block, compression, shuffled, compressed, data, data_size);
+
+        const uint64_t block_offset = out.size();
+        memcpy(out.data() + offset_table + i*sizeof(uint64_t), &block_offset, sizeof(uint64_t));
+        Append<int32_t>(out, y_start);
+        Append<int32_t>(out, static_cast<int32_t>(data_size));
+        out.insert(out.end(), data, data+data_size);
+    }
+
+    return WriteFile(filename, out);
+}
+
+TiledEXRWriter::~TiledEXRWriter() {
+    if (m_file) {
+        fclose(m_file);
+    }
+}
+
+bool TiledEXRWriter::Open(const std::string &filename, int width, int height, int tile_size, EXRCompression compression) {
+    if (m_file || width <= 0 || height <= 0 || tile_size <= 0) {
+        return false;
+    }
+    m_file = fopen(filename.c_str(), "wb");
+    if (!m_file) {
+        return false;
+    }
+    m_width = width;
+    m_height = height;
+    m_tile_size = tile_size;
+    m_compression = compression;
+    m_tiles_x = (width + tile_size - 1) / tile_size;
+    m_tiles_y = (height + tile_size - 1) / tile_size;
+    m_offsets.assign(static_cast<size_t>(m_tiles_x)*m_tiles_y, 0);
+    m_is_failed = false;
+
+    // the table of offsets follows the header, and is left empty until every tile is in
+    std::vector<uint8_t> header;
+    AppendEXRHeader(header, width, height, compression, tile_size);
+    m_offset_table = header.size();
+    header.resize(header.size() + m_offsets.size()*sizeof(uint64_t));
+    m_position = header.size();
+    if (fwrite(header.data(), 1, header.size(), m_file) != header.size()) {
+        m_is_failed = true;
+    }
+    return !m_is_failed;
+}
+
+bool TiledEXRWriter::WriteTile(int tile_x, int tile_y, const float *planes) {
+    if (tile_x < 0 || tile_x >= m_tiles_x || tile_y < 0 || tile_y >= m_tiles_y) {
+        return false;
+    }
+    const int x_start = tile_x*m_tile_size;
+    const int y_start = tile_y*m_tile_size;
+    const int tile_width = std::min(m_tile_size, m_width - x_start);
+    const int tile_height = std::min(m_tile_size, m_height - y_start);
+    const size_t plane_size = static_cast<size_t>(tile_width)*tile_height;
+
+    // encoded before taking the lock, so the threads compress their tiles at the same time
+    std::vector<uint8_t> block;
+    block.reserve(plane_size*3*sizeof(float));
+    for (int y = 0; y < tile_height; y++) {
+        for (int c = 0; c < 3; c++) {
+            const float *row = planes + EXR_CHANNEL_PLANES[c]*plane_size + static_cast<size_t>(y)*tile_width;
+            const uint8_t *bytes = reinterpret_cast<const uint8_t*>(row);
+            block.insert(block.end(), bytes, bytes + tile_width*sizeof(float));
+        }
+    }
+    std::vector<uint8_t> shuffled;
+    std::vector<uint8_t> compressed;
+    const uint8_t *data;
+    size_t data_size;
+    CompressEXRBlock(block, m_compression, shuffled, compressed, data, data_size);
+
+    std::vector<uint8_t> chunk;
+    Append<int32_t>(chunk, tile_x);
+    Append<int32_t>(chunk, tile_y);
+    Append<int32_t>(chunk, 0);          // level x
+    Append<int32_t>(chunk, 0);          // level y
+    Append<int32_t>(chunk, static_cast<int32_t>(data_size));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file || m_is_failed) {
+        return false;
+    }
+    uint64_t &offset = m_offsets[tile_x + static_cast<size_t>(tile_y)*m_tiles_x];
+    if (offset != 0) {
+        return false;
+    }
+    if (fwrite(chunk.data(), 1, chunk.size(), m_file) != chunk.size() ||
+        fwrite(data, 1, data_size, m_file) != data_size) {
+        m_is_failed = true;
+        return false;
+    }
+    offset = m_position;
+    m_position += chunk.size() + data_size;
+    return true;
+}
+
+bool TiledEXRWriter::Close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_file) {
+        return false;
+    }
+    bool is_complete = !m_is_failed;
+    for (uint64_t offset: m_offsets) {
+        is_complete = is_complete && offset != 0;
+    }
+    // a missing tile would leave readers with an invalid offset, so the table is only written once the image is whole
+    if (is_complete) {
+        is_complete = fseek(m_file, static_cast<long>(m_offset_table), SEEK_SET) == 0 &&
+            fwrite(m_offsets.data(), sizeof(uint64_t), m_offsets.size(), m_file) == m_offsets.size();
+    }
+    is_complete = (fclose(m_file) == 0) && is_complete;
+    m_file = nullptr;
+    m_offsets.clear();
+    return is_complete;
+}
+
+// http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
+bool WritePNG(const std::string &filename, const uint8_t *rgba, int width, int height) {
+    std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    auto append_chunk = [&out](const char *type, const uint8_t *data, size_t size) {
+        AppendBigEndian(out, static_cast<uint32_t>(size));
+        const size_t start = out.size();
+        out.insert(out.end(), type, type+4);
+        out.insert(out.end(), data, data+size);
+        AppendBigEndian(out, Crc32(0, out.data()+start, out.size()-start));
+    };
+
+    std::vector<uint8_t> header;
+    AppendBigEndian(header, width);
+    AppendBigEndian(header, height);
+    header.push_back(8);    // bit depth
+    header.push_back(6);    // RGBA
+    header.push_back(0);    // deflate
+    header.push_back(0);    // adaptive filtering
+    header.push_back(0);    // no interlacing
+    append_chunk("IHDR", header.data(), header.size());
+
+    // every scanline is prefixed with its filter type, we use none for speed
+    const size_t stride = static_cast<size_t>(width)*4;
+    std::vector<uint8_t> scanlines((stride+1)*height);
+    for (int y = 0; y < height; y++) {
+        uint8_t *dst = scanlines.data() + y*(stride+1);
+        dst[0] = 0;
+        memcpy(dst+1, rgba + y*stride, stride);
+    }
+    std::vector<uint8_t> compressed = ZlibCompress(scanlines.data(), scanlines.size());
+    append_chunk("IDAT", compressed.data(), compressed.size());
+    append_chunk("IEND", nullptr, 0);
+
+    return WriteFile(filename, out);
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "HDRBuffer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace raytracer
+{
+
+enum class EXRCompression { NONE, ZIP };
+
+// Writers return false if the file could not be written
+// Portable float map, linear RGB
+bool WritePFM(const std::string &filename, const HDRBuffer &hdr);
+// OpenEXR scanline image with 32bit float RGB channels
+bool WriteEXR(const std::string &filename, const HDRBuffer &hdr, EXRCompression compression=EXRCompression::ZIP);
+// 8bit RGBA image, such as the tonemapped output of the renderer
+bool WritePNG(const std::string &filename, const uint8_t *rgba, int width, int height);
+
+// OpenEXR tiled image with 32bit float RGB channels, written a tile at a time in any order
+// Only the table of tile offsets is kept in memory, it is reserved after the header and filled in by Close,
+// so images far larger than memory can be written as their tiles finish
+class TiledEXRWriter {
+    public:
+        TiledEXRWriter() {}
+        TiledEXRWriter(const TiledEXRWriter&) = delete;
+        TiledEXRWriter &operator=(const TiledEXRWriter&) = delete;
+        // an unclosed file is left without its offsets, so readers reject it
+        ~TiledEXRWriter();
+        // tiles are tile_size square, except at the right and bottom edges where they are cut short
+        bool Open(const std::string &filename, int width, int height, int tile_size, EXRCompression compression=EXRCompression::ZIP);
+        int GetTilesX() const { return m_tiles_x; }
+        int GetTilesY() const { return m_tiles_y; }
+        // planes holds the tile's colour as 3 planes of its width*height, fails if the tile was already written
+        // safe to call from several threads, tiles are compressed at the same time and appended one at a time
+        bool WriteTile(int tile_x, int tile_y, const float *planes);
+        // fails if a tile is missing or any write failed
+        bool Close();
+    private:
+        std::mutex m_mutex;
+        FILE *m_file{nullptr};
+        int m_width{0}, m_height{0};
+        int m_tile_size{0};
+        int m_tiles_x{0}, m_tiles_y{0};
+        EXRCompression m_compression{EXRCompression::ZIP};
+        // where the table of offsets starts, and where the next tile goes
+        uint64_t m_offset_table{0};
+        uint64_t m_position{0};
+        // of each tile in scanline order, 0 until it is written
+        std::vector<uint64_t> m_offsets;
+        bool m_is_failed{false};
+};
+
+// Readers return false if the file could not be read or is in an unsupported format
+// Portable float map, colour or greyscale in either byte order
+bool ReadPFM(const std::string &filename, HDRBuffer &hdr);
+
+}
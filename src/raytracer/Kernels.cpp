@@ -0,0 +1,174 @@
+#include "Kernels.h"
+#include "CpuFeatures.h"
+#include "Timeline.h"
+#include "PathGuide.h"
+
+#include <limits>
+
+namespace raytracer
+{
+
+void KernelScene::Build(const Scene &scene, bool is_refittable) {
+    TimelineScope scope("Build kernel scene", "accel", "entities", static_cast<int64_t>(scene.m_entities.size()));
+    entries.clear();
+    refit_scene = is_refittable ? &scene : nullptr;
+    csg.Clear();
+    has_csg = false;
+    has_only_spheres = true;
+    has_dielectric = !scene.m_dielectric.empty();
+
+    for (int i = 0; i < static_cast<int>(scene.m_entities.size()); i++) {
+        IEntity *entity = scene.m_entities[i];
+        Entry entry;
+        entry.entity = entity;
+        entry.entity_id = i;
+        if (scene.GetEntityType(entity) != Scene::EntityType::BASIC) {
+            has_csg = true;
+            has_only_spheres = false;
+            entry.shape = nullptr;
+            entry.material = nullptr;
+            entry.shape_type = ShapeType::TOTAL_TYPES;
+            entry.material_type = MaterialType::TOTAL_TYPES;
+            entry.program = csg.Compile(scene, entity, is_refittable);
+            entries.push_back(entry);
+            continue;
+        }
+        const BasicEntity *basic = static_cast<const BasicEntity*>(entity);
+        entry.shape = basic->GetShape();
+        entry.material = basic->GetMaterial();
+        entry.shape_type = entry.shape->GetType();
+        entry.material_type = entry.material->GetType();
+        entry.program = -1;
+        has_only_spheres &= (entry.shape_type == ShapeType::SPHERE);
+        entries.push_back(entry);
+    }
+
+    UpdateEntryBounds();
+    unbounded_entries.clear();
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!m_entry_bounds[i].IsFinite()) {
+            unbounded_entries.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    TimelineScope bvh_scope("Build BVH", "accel");
+    bvh.Build(m_entry_bounds);
+}
+
+void KernelScene::UpdateEntryBounds() {
+    const float infinity = std::numeric_limits<float>::infinity();
+    m_entry_bounds.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry &entry = entries[i];
+        if (entry.shape) {
+            m_entry_bounds[i] = entry.shape->GetBounds().GetPadded();
+        } else if (entry.program >= 0) {
+            m_entry_bounds[i] = csg.programs[entry.program].bounds;
+        } else {
+            // entities that couldn't be compiled have no bounds
+            m_entry_bounds[i] = {glm::vec3{-infinity}, glm::vec3{infinity}};
+        }
+    }
+}
+
+bool KernelScene::CanRefit(const Scene &scene) const {
+    if (refit_scene != &scene || entries.size() != scene.m_entities.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].entity != scene.m_entities[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void KernelScene::Refit() {
+    TimelineScope scope("Refit kernel scene", "accel", "entities", static_cast<int64_t>(entries.size()));
+    csg.Refit();
+    UpdateEntryBounds();
+    bvh.Refit(m_entry_bounds);
+}
+
+Bounds KernelScene::GetFiniteBounds() const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    Bounds bounds{glm::vec3{infinity}, glm::vec3{-infinity}};
+    for (const Bounds &entry_bounds: m_entry_bounds) {
+        if (entry_bounds.IsFinite()) {
+            bounds = Bounds::Union(bounds, entry_bounds);
+        }
+    }
+    return bounds;
+}
+
+// bounce counts with their own kernels
+static const int KERNEL_BOUNCES[] = {0, 4, 8, 16};
+constexpr int TOTAL_KERNEL_BOUNCES = sizeof(KERNEL_BOUNCES) / sizeof(KERNEL_BOUNCES[0]);
+
+// the same kernels compiled for each instruction set, so the compiler can use the wider vectors when inlining
+#define KERNEL_TARGET
+namespace generic {
+#include "Kernels.inl"
+}
+#undef KERNEL_TARGET
+
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+#define KERNEL_TARGET RAYTRACER_TARGET_SSE4
+namespace sse4 {
+#include "Kernels.inl"
+}
+#undef KERNEL_TARGET
+
+#define KERNEL_TARGET RAYTRACER_TARGET_AVX2
+namespace avx2 {
+#include "Kernels.inl"
+}
+#undef KERNEL_TARGET
+
+#define KERNEL_TARGET RAYTRACER_TARGET_AVX512
+namespace avx512 {
+#include "Kernels.inl"
+}
+#undef KERNEL_TARGET
+#endif
+
+TraceKernel SelectKernel(const KernelScene &scene, int total_bounces) {
+    int bounces_index = 0;
+    for (int i = 1; i < TOTAL_KERNEL_BOUNCES; i++) {
+        if (KERNEL_BOUNCES[i] == total_bounces) {
+            bounces_index = i;
+        }
+    }
+
+    const TraceKernel (*const *kernels)[2][2] = generic::KERNELS;
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+    switch (GetActiveIsa()) {
+    case CpuIsa::SSE4:      kernels = sse4::KERNELS; break;
+    case CpuIsa::AVX2:      kernels = avx2::KERNELS; break;
+    case CpuIsa::AVX512:    kernels = avx512::KERNELS; break;
+    default:                break;
+    }
+#endif
+    return kernels[bounces_index][scene.has_csg][scene.has_only_spheres][scene.has_dielectric];
+}
+
+IntersectKernel SelectIntersectKernel(const KernelScene &scene) {
+    const IntersectKernel (*kernels)[2] = generic::INTERSECT_KERNELS;
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+    switch (GetActiveIsa()) {
+    case CpuIsa::SSE4:      kernels = sse4::INTERSECT_KERNELS; break;
+    case CpuIsa::AVX2:      kernels = avx2::INTERSECT_KERNELS; break;
+    case CpuIsa::AVX512:    kernels = avx512::INTERSECT_KERNELS; break;
+    default:                break;
+    }
+#endif
+    return kernels[scene.has_csg][scene.has_only_spheres];
+}
+
+void ResolveHit(
+    const KernelScene &scene, const KernelHit &hit, const RaySurface &csg_surface,
+    Scene::Hit &result, ShapeType &shape_type, MaterialType &material_type)
+{
+    generic::ResolveKernelHit<true>(scene, hit, csg_surface, result, shape_type, material_type);
+}
+
+}
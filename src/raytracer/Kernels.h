@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Sampler.h"
+#include "CsgCompiler.h"
+#include "Bvh.h"
+
+#include <vector>
+
+namespace raytracer
+{
+
+class PathGuide;
+
+// Features of a scene that the render kernels are specialised over
+// Entities are flattened so the kernels can intersect them without virtual calls
+// CSG entities are compiled into programs, and any the compiler doesn't know fall back to their CastRay
+// Entries with finite bounds are found through a compressed BVH, the rest are tested by every ray
+struct KernelScene {
+    public:
+        struct Entry {
+            public:
+                // shape and material of a basic entity, or null
+                IShape *shape;
+                IMaterial *material;
+                ShapeType shape_type;
+                MaterialType material_type;
+                // program in csg for a CSG entity, or -1
+                int program;
+                IEntity *entity;
+                int entity_id;
+        };
+        std::vector<Entry> entries;
+        CompiledCsg csg;
+        // items are indices into entries
+        CompressedBvh bvh;
+        std::vector<uint32_t> unbounded_entries;
+        bool has_csg{false};
+        bool has_only_spheres{true};
+        bool has_dielectric{false};
+        // built from this scene with programs that can be refit
+        const Scene *refit_scene{nullptr};
+    public:
+        // is_refittable compiles the CSG entities so Refit can follow their shapes as they move
+        void Build(const Scene &scene, bool is_refittable=false);
+        // true if it was built to be refit from the scene, and the scene still has the same entities
+        bool CanRefit(const Scene &scene) const;
+        // update the bounds of the CSG programs and BVH after shapes have moved, much cheaper than building again
+        void Refit();
+        // bounds of every entry with finite bounds, empty if there are none
+        Bounds GetFiniteBounds() const;
+    private:
+        void UpdateEntryBounds();
+    private:
+        std::vector<Bounds> m_entry_bounds;
+};
+
+// Closest hit found by the kernels, as an entry index instead of pointers so batches of them stay small
+// hits on CSG entries also need the surface the program found, which is kept separately
+struct KernelHit {
+    public:
+        float t;
+        uint32_t entry;
+};
+
+struct KernelContext {
+    public:
+        const Camera *camera;
+        const Scene *scene;
+        const KernelScene *kernel_scene;
+        // size of the camera's image, pixels are given to the kernels in its coordinates
+        int width, height;
+        uint32_t seed;
+        int total_bounces;
+        // spread of the cone of primary rays
+        float pixel_spread;
+        // added to the index of each pixel to pick its samples, so views rendered into one image get their own
+        uint32_t pixel_offset;
+        // samples diffuse bounces and is trained by the paths when set, see PathGuide
+        PathGuide *guide;
+};
+
+// Traces the samples [sample_start, sample_end) of a pixel and adds them onto sum in sample order
+// info receives the first surface hit by sample 0 if it is traced, with an entity_id of -1 for a miss
+using TraceKernel = void (*)(
+    const KernelContext &context, int x, int y, 
+    int sample_start, int sample_end, glm::vec3 &sum, Scene::SurfaceInfo *info);
+
+// nearest hit of a ray on the scene, same as Scene::Intersect
+// csg_surface is only written for hits on CSG entries
+using IntersectKernel = bool (*)(const KernelScene &scene, const Ray &ray, KernelHit &hit, RaySurface &csg_surface);
+
+// the shape, material and their types of a hit
+void ResolveHit(
+    const KernelScene &scene, const KernelHit &hit, const RaySurface &csg_surface,
+    Scene::Hit &result, ShapeType &shape_type, MaterialType &material_type);
+
+// kernel specialised for the scene and bounce count
+// bounce counts without their own kernel use one that reads the count at runtime
+TraceKernel SelectKernel(const KernelScene &scene, int total_bounces);
+IntersectKernel SelectIntersectKernel(const KernelScene &scene);
+
+}
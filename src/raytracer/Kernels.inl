@@ -0,0 +1,436 @@
+// Render kernels, included by Kernels.cpp once per instruction set inside its own namespace
+// KERNEL_TARGET is defined to the target attribute of that instruction set
+
+template <bool HAS_DIELECTRIC>
+KERNEL_TARGET static inline bool ScatterRay(IMaterial *material, MaterialType type, Ray &ray, const Collision &collision, Sampler &sampler) {
+    switch (type) {
+    case MaterialType::LAMBERTIAN:  return static_cast<Lambertian*>(material)->Lambertian::CastRay(ray, collision, sampler);
+    case MaterialType::METAL:       return static_cast<Metal*>(material)->Metal::CastRay(ray, collision, sampler);
+    case MaterialType::DIELECTRIC:
+        if constexpr(HAS_DIELECTRIC) {
+            return static_cast<Dielectric*>(material)->Dielectric::CastRay(ray, collision, sampler);
+        }
+        // otherwise falls through to the virtual call
+    default:                        return material->CastRay(ray, collision, sampler);
+    }
+}
+
+KERNEL_TARGET static inline bool CheckShapeHit(IShape *shape, ShapeType type, const Ray &ray, float &t0, float &t1) {
+    switch (type) {
+    case ShapeType::SPHERE:         return static_cast<Sphere*>(shape)->Sphere::CheckHit(ray, t0, t1);
+    case ShapeType::PLANE:          return static_cast<Plane*>(shape)->Plane::CheckHit(ray, t0, t1);
+    case ShapeType::BOX:            return static_cast<Box*>(shape)->Box::CheckHit(ray, t0, t1);
+    case ShapeType::ORIENTED_BOX:   return static_cast<OrientedBox*>(shape)->OrientedBox::CheckHit(ray, t0, t1);
+    case ShapeType::CYLINDER:       return static_cast<Cylinder*>(shape)->Cylinder::CheckHit(ray, t0, t1);
+    case ShapeType::CONE:           return static_cast<Cone*>(shape)->Cone::CheckHit(ray, t0, t1);
+    case ShapeType::DISC:           return static_cast<Disc*>(shape)->Disc::CheckHit(ray, t0, t1);
+    default:                        return shape->CheckHit(ray, t0, t1);
+    }
+}
+
+KERNEL_TARGET static inline Collision GetShapeCollision(IShape *shape, ShapeType type, const Ray &ray, float t) {
+    switch (type) {
+    case ShapeType::SPHERE:         return static_cast<Sphere*>(shape)->Sphere::GetCollision(ray, t);
+    case ShapeType::PLANE:          return static_cast<Plane*>(shape)->Plane::GetCollision(ray, t);
+    case ShapeType::BOX:            return static_cast<Box*>(shape)->Box::GetCollision(ray, t);
+    case ShapeType::ORIENTED_BOX:   return static_cast<OrientedBox*>(shape)->OrientedBox::GetCollision(ray, t);
+    case ShapeType::CYLINDER:       return static_cast<Cylinder*>(shape)->Cylinder::GetCollision(ray, t);
+    case ShapeType::CONE:           return static_cast<Cone*>(shape)->Cone::GetCollision(ray, t);
+    case ShapeType::DISC:           return static_cast<Disc*>(shape)->Disc::GetCollision(ray, t);
+    default:                        return shape->GetCollision(ray, t);
+    }
+}
+
+// nearest surface of a compiled CSG entity, same as its CastRay followed by RayCast::GetFirstSurface
+KERNEL_TARGET static bool CastProgram(
+    const CompiledCsg &csg, const CsgProgram &program, 
+    const Ray &ray, float t_min, float t_max, RaySurface &surface) 
+{
+    if (program.total_instructions == 0) {
+        return false;
+    }
+    if (program.bounds.IsFinite()) {
+        float t0, t1;
+        if (!program.bounds.CheckHit(ray, t0, t1) || t1 < t_min || t0 > t_max) {
+            return false;
+        }
+    }
+
+    // operations write their result into the free list above the stack, then the lists are swapped
+    RayCast lists[CompiledCsg::MAX_STACK_DEPTH+1];
+    RayCast *stack[CompiledCsg::MAX_STACK_DEPTH+1];
+    for (int i = 0; i <= program.stack_depth; i++) {
+        stack[i] = &lists[i];
+    }
+    int top = 0;
+    // ranges to restore once the second side of an intersection or difference is combined
+    float ranges[CompiledCsg::MAX_STACK_DEPTH][2];
+    int total_ranges = 0;
+    float t_start = t_min, t_end = t_max;
+
+    const CompiledCsg::Instruction *instructions = csg.instructions.data() + program.first_instruction;
+    for (int i = 0; i < program.total_instructions; i++) {
+        const CompiledCsg::Instruction &instruction = instructions[i];
+        switch (instruction.op) {
+        case CompiledCsg::OpCode::PRIMITIVE:
+            {
+                // same as BasicEntity::CastRay
+                const CompiledCsg::Primitive &primitive = csg.primitives[instruction.argument];
+                RayCast &cast = *stack[top++];
+                cast.total_spans = 0;
+                cast.t_limit = std::numeric_limits<float>::infinity();
+                float t0, t1;
+                if (!CheckShapeHit(primitive.shape, primitive.type, ray, t0, t1) || t1 < t_start || t0 > t_end) {
+                    break;
+                }
+                IMaterial *material = csg.materials[primitive.material];
+                cast.spans[0].enter = {t0, primitive.shape, material};
+                cast.spans[0].exit = {t1, primitive.shape, material};
+                cast.total_spans = 1;
+            }
+            break;
+        case CompiledCsg::OpCode::BEGIN_SECOND:
+            {
+                // same as the early outs of IntersectionEntity and DifferenceEntity::CastRay
+                const RayCast &first = *stack[top-1];
+                if (first.total_spans == 0) {
+                    i += instruction.argument;
+                    break;
+                }
+                ranges[total_ranges][0] = t_start;
+                ranges[total_ranges][1] = t_end;
+                total_ranges++;
+                t_start = glm::max(t_start, first.spans[0].enter.t);
+                t_end = glm::min(t_end, first.spans[first.total_spans-1].exit.t);
+            }
+            break;
+        case CompiledCsg::OpCode::TEST_BOUNDS:
+            {
+                // a subtree whose shapes are all missed gives an empty span list
+                const CompiledCsg::BoundsTest &test = csg.bounds_tests[instruction.argument];
+                float t0, t1;
+                if (test.bounds.CheckHit(ray, t0, t1) && t1 >= t_start && t0 <= t_end) {
+                    break;
+                }
+                RayCast &cast = *stack[top++];
+                cast.total_spans = 0;
+                cast.t_limit = std::numeric_limits<float>::infinity();
+                i += test.skip;
+            }
+            break;
+        case CompiledCsg::OpCode::COMBINE:
+            {
+                const CsgOperation operation = static_cast<CsgOperation>(instruction.argument);
+                RayCast *left = stack[top-2];
+                RayCast *right = stack[top-1];
+                RayCast *result = stack[top];
+                CombineSpans(operation, *left, *right, *result);
+                stack[top-2] = result;
+                stack[top-1] = left;
+                stack[top] = right;
+                top--;
+                if (operation != CsgOperation::UNION) {
+                    total_ranges--;
+                    t_start = ranges[total_ranges][0];
+                    t_end = ranges[total_ranges][1];
+                }
+            }
+            break;
+        }
+    }
+    return stack[0]->GetFirstSurface(t_min, surface);
+}
+
+// hits at the same distance go to the later entry, like Scene::Intersect, so the order entries are tested in doesn't matter
+KERNEL_TARGET static inline bool IsCloser(float t, uint32_t index, const KernelHit &closest, bool is_hit) {
+    return (t < closest.t) || (t == closest.t && (!is_hit || index > closest.entry));
+}
+
+// test one entry of the kernel scene, keeping the closest hit
+template <bool ONLY_SPHERES, bool HAS_CSG>
+KERNEL_TARGET static inline void IntersectEntry(
+    const KernelScene &scene, uint32_t index, const Ray &ray, float t_min,
+    KernelHit &closest, bool &is_hit, RaySurface &closest_surface)
+{
+    const KernelScene::Entry &entry = scene.entries[index];
+    if constexpr(HAS_CSG) {
+        if (!entry.shape) {
+            RaySurface surface;
+            bool is_entry_hit;
+            if (entry.program >= 0) {
+                is_entry_hit = CastProgram(scene.csg, scene.csg.programs[entry.program], ray, t_min, closest.t, surface);
+            } else {
+                RayCast cast;
+                is_entry_hit = entry.entity->CastRay(ray, t_min, closest.t, cast) && cast.GetFirstSurface(t_min, surface);
+            }
+            if (!is_entry_hit || !IsCloser(surface.t, index, closest, is_hit)) {
+                return;
+            }
+            closest = {surface.t, index};
+            closest_surface = surface;
+            is_hit = true;
+            return;
+        }
+    }
+
+    float t0, t1;
+    bool is_entry_hit;
+    if constexpr(ONLY_SPHERES) {
+        is_entry_hit = static_cast<Sphere*>(entry.shape)->Sphere::CheckHit(ray, t0, t1);
+    } else {
+        is_entry_hit = CheckShapeHit(entry.shape, entry.shape_type, ray, t0, t1);
+    }
+    if (!is_entry_hit) {
+        return;
+    }
+
+    float t = t0;
+    if (t < t_min || t > closest.t) {
+        t = t1;
+        if (t < t_min || t > closest.t) {
+            return;
+        }
+    }
+    if (IsCloser(t, index, closest, is_hit)) {
+        closest = {t, index};
+        is_hit = true;
+    }
+}
+
+// same as Scene::Intersect, with the bounded entries found through the BVH
+template <bool ONLY_SPHERES, bool HAS_CSG>
+KERNEL_TARGET static bool IntersectScene(const KernelScene &scene, const Ray &ray, KernelHit &hit, RaySurface &csg_surface) {
+    const float t_min = 0.001f;
+    // finite, so the infinite ends of unbounded shapes are never taken as hits
+    hit.t = std::numeric_limits<float>::max();
+    hit.entry = 0;
+    bool is_hit = false;
+
+    for (uint32_t index: scene.unbounded_entries) {
+        IntersectEntry<ONLY_SPHERES, HAS_CSG>(scene, index, ray, t_min, hit, is_hit, csg_surface);
+    }
+    if (scene.bvh.IsEmpty()) {
+        return is_hit;
+    }
+
+    // a node, or the items of a leaf when count isn't 0, and how far along the ray its bounds start
+    struct StackEntry {
+        public:
+            float t;
+            uint32_t index;
+            uint32_t count;
+    };
+    StackEntry stack[CompressedBvh::STACK_SIZE];
+    int top = 0;
+    stack[top++] = {t_min, 0, 0};
+    const BvhRay bvh_ray(ray);
+    const uint32_t *items = scene.bvh.items.data();
+
+    while (top > 0) {
+        const StackEntry current = stack[--top];
+        // something nearer was hit since it was pushed
+        if (current.t > hit.t) {
+            continue;
+        }
+        if (current.count > 0) {
+            for (uint32_t k = current.index; k < current.index + current.count; k++) {
+                IntersectEntry<ONLY_SPHERES, HAS_CSG>(scene, items[k], ray, t_min, hit, is_hit, csg_surface);
+            }
+            continue;
+        }
+
+        const CompressedBvh::Node &node = scene.bvh.nodes[current.index];
+        float t_near[CompressedBvh::WIDTH];
+        const int hit_mask = IntersectBvhNode(node, bvh_ray, t_min, hit.t, t_near);
+
+        // children sorted from far to near, so the nearest is popped first
+        StackEntry children[CompressedBvh::WIDTH];
+        int total_children = 0;
+        for (int i = 0; i < CompressedBvh::WIDTH; i++) {
+            if (!(hit_mask & (1 << i))) {
+                continue;
+            }
+            StackEntry child;
+            child.t = t_near[i];
+            if (node.inner_mask & (1 << i)) {
+                child.index = node.first_node + node.meta[i];
+                child.count = 0;
+            } else {
+                child.index = node.first_item + node.meta[i]/8;
+                child.count = node.meta[i] & 7;
+                if (child.count == 0) {
+                    continue;
+                }
+            }
+            int j = total_children++;
+            for (; j > 0 && children[j-1].t < child.t; j--) {
+                children[j] = children[j-1];
+            }
+            children[j] = child;
+        }
+        for (int i = 0; i < total_children; i++) {
+            stack[top++] = children[i];
+        }
+    }
+    return is_hit;
+}
+
+// the shape and material of a hit, and their types
+template <bool HAS_CSG>
+KERNEL_TARGET static inline void ResolveKernelHit(
+    const KernelScene &scene, const KernelHit &hit, const RaySurface &csg_surface,
+    Scene::Hit &result, ShapeType &shape_type, MaterialType &material_type)
+{
+    const KernelScene::Entry &entry = scene.entries[hit.entry];
+    result.t = hit.t;
+    result.entity_id = entry.entity_id;
+    if (HAS_CSG && !entry.shape) {
+        result.shape = csg_surface.shape;
+        result.material = csg_surface.material;
+        shape_type = result.shape->GetType();
+        material_type = result.material->GetType();
+        return;
+    }
+    result.shape = entry.shape;
+    result.material = entry.material;
+    shape_type = entry.shape_type;
+    material_type = entry.material_type;
+}
+
+// MAX_BOUNCES of 0 reads the bounce count at runtime
+template <int MAX_BOUNCES, bool HAS_CSG, bool ONLY_SPHERES, bool HAS_DIELECTRIC>
+KERNEL_TARGET static void TracePixelKernel(
+    const KernelContext &context, int x, int y, 
+    int sample_start, int sample_end, glm::vec3 &sum, Scene::SurfaceInfo *info)
+{
+    const int total_bounces = (MAX_BOUNCES > 0) ? MAX_BOUNCES : context.total_bounces;
+    const uint32_t pixel = context.pixel_offset + static_cast<uint32_t>(x + y*context.width);
+    const float s = (float)x / (float)(context.width-1);
+    const float t = 1.0f - (float)y / (float)(context.height-1);
+
+    // diffuse vertices of the path, to train the guide with
+    PathGuide *guide = context.guide;
+    const bool is_training = guide && guide->IsTraining();
+    PathGuide::Vertex vertices[PathGuide::MAX_VERTICES];
+    // without an environment escaped rays keep their colour and nothing is sampled directly
+    const EnvironmentMap *environment = context.scene->m_environment.IsEmpty() ? nullptr : &context.scene->m_environment;
+
+    for (int j = sample_start; j < sample_end; j++) {
+        Sampler sampler(context.seed, pixel, static_cast<uint32_t>(j));
+        Ray ray = context.camera->GetRay(s, t);
+        ray.color = glm::vec3{1, 1, 1};
+        ray.cone_spread = context.pixel_spread;
+        int total_vertices = 0;
+        // light sampled directly from the environment, and the density of the last bounce to weigh escapes against it
+        glm::vec3 direct{0,0,0};
+        float bounce_pdf = 0.0f;
+
+        for (int i = 0; i <= total_bounces; i++) {
+            // out of bounces
+            if (i == total_bounces) {
+                ray.color *= glm::vec3{0,0,0};
+                break;
+            }
+
+            KernelHit kernel_hit;
+            RaySurface csg_surface;
+            const bool is_hit = IntersectScene<ONLY_SPHERES, HAS_CSG>(*context.kernel_scene, ray, kernel_hit, csg_surface);
+
+            // rays that escape the scene keep their colour, times the environment's light if there is one
+            if (!is_hit) {
+                if (info && i == 0 && j == 0) {
+                    info->entity_id = -1;
+                }
+                if (environment) {
+                    ray.color *= environment->EvaluateEscape(ray.direction, bounce_pdf);
+                }
+                break;
+            }
+
+            Scene::Hit hit;
+            ShapeType shape_type;
+            MaterialType type;
+            ResolveKernelHit<HAS_CSG>(*context.kernel_scene, kernel_hit, csg_surface, hit, shape_type, type);
+
+            Collision collision;
+            if constexpr(ONLY_SPHERES) {
+                collision = static_cast<Sphere*>(hit.shape)->Sphere::GetCollision(ray, hit.t);
+            } else {
+                collision = GetShapeCollision(hit.shape, shape_type, ray, hit.t);
+            }
+            if (info && i == 0 && j == 0) {
+                *info = context.scene->GetSurfaceInfo(hit, collision);
+            }
+
+            // not at the last bounce, where the paths that bounce towards the light are cut off
+            if (environment && type == MaterialType::LAMBERTIAN && i+1 < total_bounces) {
+                const Lambertian &material = *static_cast<Lambertian*>(hit.material);
+                direct += environment->SampleDirect(material, ray, collision, sampler,
+                    [&](const glm::vec3 &direction) {
+                        return guide ? guide->GetLambertianPdf(collision, direction) : material.GetPdf(collision, direction);
+                    },
+                    [&](const Ray &shadow) {
+                        KernelHit shadow_hit;
+                        RaySurface shadow_surface;
+                        return IntersectScene<ONLY_SPHERES, HAS_CSG>(*context.kernel_scene, shadow, shadow_hit, shadow_surface);
+                    });
+            }
+
+            if (guide && type == MaterialType::LAMBERTIAN) {
+                float pdf;
+                const bool has_scatter = guide->ScatterLambertian(*static_cast<Lambertian*>(hit.material), ray, collision, sampler, pdf);
+                if (is_training && total_vertices < PathGuide::MAX_VERTICES) {
+                    vertices[total_vertices++] = {collision.pos, ray.direction, ray.color, direct, pdf};
+                }
+                if (!has_scatter) {
+                    break;
+                }
+                bounce_pdf = pdf;
+            } else if (!ScatterRay<HAS_DIELECTRIC>(hit.material, type, ray, collision, sampler)) {
+                break;
+            } else if (environment) {
+                // only diffuse bounces are also sampled directly
+                bounce_pdf = (type == MaterialType::LAMBERTIAN) ? static_cast<Lambertian*>(hit.material)->GetPdf(collision, ray.direction) : 0.0f;
+            }
+        }
+
+        if (environment) {
+            ray.color += direct;
+        }
+        if (total_vertices > 0) {
+            guide->Record(vertices, total_vertices, ray.color);
+        }
+        // accumulate in sample order so continuing a partial sum gives the same result
+        sum += ray.color;
+    }
+}
+
+template <int MAX_BOUNCES>
+struct KernelTable {
+    static constexpr TraceKernel kernels[2][2][2] = {
+        {
+            {TracePixelKernel<MAX_BOUNCES, false, false, false>, TracePixelKernel<MAX_BOUNCES, false, false, true>},
+            {TracePixelKernel<MAX_BOUNCES, false, true, false>, TracePixelKernel<MAX_BOUNCES, false, true, true>},
+        },
+        {
+            // only spheres is never set for scenes with CSG
+            {TracePixelKernel<MAX_BOUNCES, true, false, false>, TracePixelKernel<MAX_BOUNCES, true, false, true>},
+            {TracePixelKernel<MAX_BOUNCES, true, false, false>, TracePixelKernel<MAX_BOUNCES, true, false, true>},
+        },
+    };
+};
+
+// a kernel for every combination, indexed by [bounces][csg][only spheres][dielectric]
+static const TraceKernel (*const KERNELS[TOTAL_KERNEL_BOUNCES])[2][2] = {
+    KernelTable<0>::kernels,
+    KernelTable<4>::kernels,
+    KernelTable<8>::kernels,
+    KernelTable<16>::kernels,
+};
+
+// intersection on its own, indexed by [csg][only spheres]
+static const IntersectKernel INTERSECT_KERNELS[2][2] = {
+    {IntersectScene<false, false>, IntersectScene<true, false>},
+    // only spheres is never set for scenes with CSG
+    {IntersectScene<false, true>, IntersectScene<false, true>},
+};
@@ -2,41 +2,189 @@
 
 #include "Ray.h"
 #include "Shape.h"
+#include "Sampler.h"
+#include "Texture.h"
 #include <glm/glm/glm.hpp>
+#include <glm/gtc/epsilon.hpp>
+#include <limits>
 
 namespace raytracer {
 
+// Used to group hits by material when shading batches of rays
+enum class MaterialType { LAMBERTIAN, METAL, DIELECTRIC, TOTAL_TYPES };
+
 // A material handles updating the ray
 // Takes in a collision object, which contains the normal, position of surface
+// All randomness comes from the sampler so that renders are reproducible
+// Materials can have a texture, which is multiplied into their colour
 class IMaterial {
     public:
-        virtual bool CastRay(Ray &ray, const Collision &collision) = 0;
+        virtual bool CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const = 0;
+        // base colour of the surface, used for albedo outputs
+        virtual glm::vec3 GetAlbedo(const Collision &collision) const = 0;
+        virtual MaterialType GetType() const = 0;
 };
 
 class Metal: public IMaterial {
     private:
         glm::vec3 m_albedo;
         float m_fuzziness{1.0f};
+        ITexture *m_texture;
     public:
-        Metal(const glm::vec3 &albedo, float fuzziness);
-        virtual bool CastRay(Ray &ray, const Collision &collision);
+        Metal(const glm::vec3 &albedo, float fuzziness, ITexture *texture=nullptr);
+        virtual bool CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const;
+        virtual glm::vec3 GetAlbedo(const Collision &collision) const;
+        virtual MaterialType GetType() const { return MaterialType::METAL; }
 };
 
 class Lambertian: public IMaterial {
     private:
         glm::vec3 m_albedo;
+        ITexture *m_texture;
     public:
-        Lambertian(const glm::vec3& albedo);
-        virtual bool CastRay(Ray &ray, const Collision &collision);
+        Lambertian(const glm::vec3& albedo, ITexture *texture=nullptr);
+        virtual bool CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const;
+        // continue the ray in a direction picked elsewhere, with its colour also scaled by weight
+        void Scatter(Ray &ray, const Collision &collision, const glm::vec3 &direction, float weight) const;
+        // colour a ray arriving at the collision is scaled by when it scatters
+        glm::vec3 GetColor(const Ray &ray, const Collision &collision) const;
+        // solid angle density of CastRay scattering in a direction
+        float GetPdf(const Collision &collision, const glm::vec3 &direction) const;
+        virtual glm::vec3 GetAlbedo(const Collision &collision) const;
+        virtual MaterialType GetType() const { return MaterialType::LAMBERTIAN; }
 };
 
 class Dielectric: public IMaterial {
     private:
         float m_refractive_index;
         glm::vec3 m_color;
+        ITexture *m_texture;
     public:
-        Dielectric(float refractive_index, const glm::vec3 &color = glm::vec3{1,1,1});
-        virtual bool CastRay(Ray &ray, const Collision &collision);
+        Dielectric(float refractive_index, const glm::vec3 &color = glm::vec3{1,1,1}, ITexture *texture=nullptr);
+        virtual bool CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const;
+        virtual glm::vec3 GetAlbedo(const Collision &collision) const;
+        virtual MaterialType GetType() const { return MaterialType::DIELECTRIC; }
 };
 
+// diffuse bounces go in every direction, so the cone after one is treated as this wide
+constexpr float DIFFUSE_CONE_SPREAD = 0.25f;
+
+// width of a ray's cone where it hit a surface
+inline float GetConeWidth(const Ray &ray, const Collision &collision) {
+    return ray.cone_width + ray.cone_spread*glm::length(collision.pos - ray.origin);
+}
+
+// colour of a material with an optional texture, the cone width picks how much the texture is filtered
+inline glm::vec3 GetSurfaceColor(const glm::vec3 &color, const ITexture *texture, const Collision &collision, float cone_width) {
+    if (!texture) {
+        return color;
+    }
+    return color * texture->Evaluate(collision.uv, cone_width*collision.uv_scale);
+}
+
+inline glm::vec3 Metal::GetAlbedo(const Collision &collision) const {
+    return GetSurfaceColor(m_albedo, m_texture, collision, 0.0f);
+}
+
+inline glm::vec3 Lambertian::GetAlbedo(const Collision &collision) const {
+    return GetSurfaceColor(m_albedo, m_texture, collision, 0.0f);
+}
+
+inline glm::vec3 Dielectric::GetAlbedo(const Collision &collision) const {
+    return GetSurfaceColor(m_color, m_texture, collision, 0.0f);
+}
+
+// defined here so the specialised kernels in Kernels.cpp can inline them
+inline bool Metal::CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const {
+    // metallic scattering
+    glm::vec3 pure_reflection = glm::reflect(ray.direction, collision.normal);
+    glm::vec3 reflected = glm::normalize(
+        pure_reflection +
+        m_fuzziness*sampler.UnitSphere());
+    
+    if (glm::dot(pure_reflection, collision.normal) < 0) {
+        reflected = glm::normalize(pure_reflection);
+    }
+
+    // rougher metals widen the cone
+    const float cone_width = GetConeWidth(ray, collision);
+    ray.color *= GetSurfaceColor(m_albedo, m_texture, collision, cone_width);
+    ray.cone_width = cone_width;
+    ray.cone_spread += m_fuzziness;
+    ray.origin = collision.pos;
+    ray.direction = reflected;
+    return true;
+}
+
+inline bool Lambertian::CastRay(Ray &ray, const Collision &collision, Sampler &sampler) const {
+    // diffuse scattering
+    glm::vec3 scatter = glm::normalize(
+        collision.normal + 
+        sampler.UnitSphere());
+
+    if (glm::any(glm::epsilonEqual(scatter, glm::vec3{0,0,0}, std::numeric_limits<float>::epsilon()))) {
+        scatter = collision.normal;
+    }
+
+    Scatter(ray, collision, scatter, 1.0f);
+    return true;
+}
+
+inline void Lambertian::Scatter(Ray &ray, const Collision &collision, const glm::vec3 &direction, float weight) const {
+    const float cone_width = GetConeWidth(ray, collision);
+    ray.color *= GetSurfaceColor(m_albedo, m_texture, collision, cone_width) * weight;
+    ray.cone_width = cone_width;
+    ray.cone_spread = glm::max(ray.cone_spread, DIFFUSE_CONE_SPREAD);
+    ray.origin = collision.pos;
+    ray.direction = direction;
+}
+
+inline glm::vec3 Lambertian::GetColor(const Ray &ray, const Collision &collision) const {
+    return GetSurfaceColor(m_albedo, m_texture, collision, GetConeWidth(ray, collision));
+}
+
+inline float Lambertian::GetPdf(const Collision &collision, const glm::vec3 &direction) const {
+    // normal plus a point on the unit sphere is a cosine distribution
+    return glm::max(glm::dot(direction, collision.normal), 0.0f) * (1.0f / 3.14159265f);
+}
+
+inline bool Dielectric::CastRay(Ray &ray, const Collision &collision, Sampler &) const {
+    // we go from medium 1 into medium 2
+    // refraction_ratio = n_1 / n_2 (n = optical density)
+
+    // check if total internal reflection
+    // if it is internal, than the interface is reverse, therefore refractive index is inverted
+    float refraction_ratio = collision.is_internal ? m_refractive_index : 1.0f/m_refractive_index;
+
+    // get angle between ray and the surface normal
+    float cos_theta = glm::min(glm::dot(-ray.direction, collision.normal), 1.0f);
+    float sin_theta = glm::sqrt(1.0f - cos_theta*cos_theta);
+
+    // check if the ray refracts, or reflects
+    // total internal reflection occurs when going from more dense to less dense
+    // refraction_ratio > 1.0f for total internal reflection
+
+    // sin(theta_t)/sin(theta_i) = n_1/n_2
+    // For total internal reflection, theta_t = 90, sin(theta_t) = 1
+    // sin(theta_t) = sin(theta_i) * n_1/n_2
+    // Hence if sin(theta_i) * n_1/n_2 > 1.0f, we have total internal reflection
+
+    bool is_refract = refraction_ratio*sin_theta < 1.0f;
+
+    glm::vec3 direction;
+    if (is_refract) {
+        direction = glm::refract(ray.direction, collision.normal, refraction_ratio);
+    } else {
+        direction = glm::reflect(ray.direction, collision.normal);
+    }
+
+    // smooth glass keeps the cone's spread
+    const float cone_width = GetConeWidth(ray, collision);
+    ray.color *= GetSurfaceColor(m_color, m_texture, collision, cone_width);
+    ray.cone_width = cone_width;
+    ray.origin = collision.pos;
+    ray.direction = direction;
+    return true;
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "MultiView.h"
+
+#include <algorithm>
+
+namespace raytracer
+{
+
+MultiView MultiView::CreateSingle(const Camera &camera, int width, int height) {
+    MultiView views;
+    views.AddView(camera, 0, 0, width, height);
+    return views;
+}
+
+MultiView MultiView::CreateStereo(const Camera &camera, float eye_separation, int width, int height) {
+    const glm::vec3 right = glm::normalize(glm::cross(camera.m_up, camera.m_look_from - camera.m_look_at));
+    MultiView views;
+    for (int eye = 0; eye < 2; eye++) {
+        const glm::vec3 offset = right * (eye_separation * ((eye == 0) ? -0.5f : 0.5f));
+        Camera eye_camera = camera;
+        eye_camera.m_look_from += offset;
+        eye_camera.m_look_at += offset;
+        eye_camera.m_aspect_ratio = (float)width/(float)height;
+        views.AddView(eye_camera, eye*width, 0, width, height);
+    }
+    return views;
+}
+
+MultiView MultiView::CreateCubemap(const Camera &camera, int face_size) {
+    struct Face {
+        glm::vec3 direction;
+        glm::vec3 up;
+    };
+    static const Face faces[6] = {
+        {{ 1, 0, 0}, {0, 1, 0}},
+        {{-1, 0, 0}, {0, 1, 0}},
+        {{ 0, 1, 0}, {0, 0,-1}},
+        {{ 0,-1, 0}, {0, 0, 1}},
+        {{ 0, 0, 1}, {0, 1, 0}},
+        {{ 0, 0,-1}, {0, 1, 0}},
+    };
+    MultiView views;
+    for (int i = 0; i < 6; i++) {
+        Camera face_camera = camera;
+        face_camera.m_projection = Camera::PERSPECTIVE;
+        face_camera.m_look_at = camera.m_look_from + faces[i].direction;
+        face_camera.m_up = faces[i].up;
+        face_camera.m_vertical_fov = 90.0f;
+        face_camera.m_aspect_ratio = 1.0f;
+        views.AddView(face_camera, (i % 3)*face_size, (i / 3)*face_size, face_size, face_size);
+    }
+    return views;
+}
+
+MultiView MultiView::CreateEquirectangular(const Camera &camera, int width) {
+    Camera panorama_camera = camera;
+    panorama_camera.m_projection = Camera::EQUIRECTANGULAR;
+    MultiView views;
+    views.AddView(panorama_camera, 0, 0, width, std::max(width/2, 2));
+    return views;
+}
+
+MultiView MultiView::CreateArray(const Camera &camera, int columns, int rows, float spacing, int width, int height) {
+    const glm::vec3 backwards = glm::normalize(camera.m_look_from - camera.m_look_at);
+    const glm::vec3 right = glm::normalize(glm::cross(camera.m_up, backwards));
+    const glm::vec3 up = glm::cross(backwards, right);
+    MultiView views;
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            // centred on the camera, with the first row at the top
+            const float dx = (column - 0.5f*(columns-1)) * spacing;
+            const float dy = (0.5f*(rows-1) - row) * spacing;
+            const glm::vec3 offset = right*dx + up*dy;
+            Camera array_camera = camera;
+            array_camera.m_look_from += offset;
+            array_camera.m_look_at += offset;
+            array_camera.m_aspect_ratio = (float)width/(float)height;
+            views.AddView(array_camera, column*width, row*height, width, height);
+        }
+    }
+    return views;
+}
+
+void MultiView::AddView(const Camera &camera, int x, int y, int width, int height) {
+    View view{camera, x, y, width, height};
+    view.camera.RecalculateVirtualPlane();
+    m_views.push_back(view);
+    m_width = std::max(m_width, x+width);
+    m_height = std::max(m_height, y+height);
+}
+
+}
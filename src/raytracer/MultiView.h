@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Camera.h"
+
+#include <vector>
+
+namespace raytracer
+{
+
+// A camera and the region of the output image it renders into
+struct View {
+    public:
+        Camera camera;
+        int x, y;
+        int width, height;
+};
+
+// Several cameras rendered as one job into separate regions of a single image
+// The views share the renderer's threads and kernel scene, and their tiles are interleaved
+// so the same part of every view is rendered back to back while the scene data it touches is still cached
+class MultiView {
+    public:
+        // a single camera filling the image, the same as Renderer::Start with it
+        static MultiView CreateSingle(const Camera &camera, int width, int height);
+        // left and right eyes side by side, each width by height, separated along the camera's right axis
+        // the eyes look in parallel, so objects at the look at point are eye_separation apart between the images
+        static MultiView CreateStereo(const Camera &camera, float eye_separation, int width, int height);
+        // 90 degree faces around the camera's position along the world axes, in two rows of three
+        // +x -x +y on the top row then -y +z -z, with +y as up for the sides
+        static MultiView CreateCubemap(const Camera &camera, int face_size);
+        // the whole sphere around the camera in one image of width by width/2
+        static MultiView CreateEquirectangular(const Camera &camera, int width);
+        // a grid of parallel cameras spacing apart on the plane of the camera's right and up axes
+        // laid out in the image the same way they are placed, each width by height
+        static MultiView CreateArray(const Camera &camera, int columns, int rows, float spacing, int width, int height);
+    public:
+        int GetWidth() const { return m_width; }
+        int GetHeight() const { return m_height; }
+        const std::vector<View> &GetViews() const { return m_views; }
+        // the camera is copied with its virtual plane recalculated, and the image grows to fit the region
+        void AddView(const Camera &camera, int x, int y, int width, int height);
+    private:
+        std::vector<View> m_views;
+        int m_width{0}, m_height{0};
+};
+
+}
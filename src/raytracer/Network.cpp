@@ -0,0 +1,418 @@
+#include "Network.h"
+#include "RenderProtocol.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+namespace raytracer
+{
+
+#ifdef _WIN32
+const Socket::Handle Socket::INVALID_HANDLE = static_cast<Socket::Handle>(INVALID_SOCKET);
+#define poll WSAPoll
+#else
+const Socket::Handle Socket::INVALID_HANDLE = -1;
+#endif
+
+namespace {
+
+#ifdef _WIN32
+struct WinsockInit {
+    WinsockInit() { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); }
+    ~WinsockInit() { WSACleanup(); }
+};
+static WinsockInit winsock_init;
+
+void CloseHandle(Socket::Handle handle) { closesocket(static_cast<SOCKET>(handle)); }
+bool IsWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+void CloseHandle(Socket::Handle handle) { close(handle); }
+bool IsWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+#endif
+
+bool WaitHandle(Socket::Handle handle, short events) {
+    pollfd fd;
+    fd.fd = handle;
+    fd.events = events;
+    fd.revents = 0;
+    return poll(&fd, 1, -1) > 0;
+}
+
+// split "tcp:host:port" into its parts
+bool ParseTCP(const std::string &address, std::string &host, std::string &port) {
+    if (address.rfind("tcp:", 0) != 0) {
+        return false;
+    }
+    auto rest = address.substr(4);
+    auto colon = rest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    host = rest.substr(0, colon);
+    port = rest.substr(colon+1);
+    return true;
+}
+
+bool ParseUnix(const std::string &address, std::string &path) {
+    if (address.rfind("unix:", 0) != 0) {
+        return false;
+    }
+    path = address.substr(5);
+    return true;
+}
+
+Socket OpenTCP(const std::string &host, const std::string &port, bool is_listen) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = is_listen ? AI_PASSIVE : 0;
+
+    addrinfo *results = nullptr;
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results) != 0) {
+        return Socket();
+    }
+
+    Socket socket;
+    for (addrinfo *info = results; info != nullptr; info = info->ai_next) {
+        Socket::Handle handle = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (handle == Socket::INVALID_HANDLE) {
+            continue;
+        }
+        int enable = 1;
+        if (is_listen) {
+            setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enable), sizeof(enable));
+            if (bind(handle, info->ai_addr, static_cast<int>(info->ai_addrlen)) == 0 && listen(handle, 64) == 0) {
+                socket = Socket(handle);
+                break;
+            }
+        } else {
+            // tiles are sent as soon as they are ready
+            setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+            if (connect(handle, info->ai_addr, static_cast<int>(info->ai_addrlen)) == 0) {
+                socket = Socket(handle);
+                break;
+            }
+        }
+        CloseHandle(handle);
+    }
+    freeaddrinfo(results);
+    return socket;
+}
+
+Socket OpenUnix(const std::string &path, bool is_listen) {
+#ifdef _WIN32
+    return Socket();
+#else
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return Socket();
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+    Socket::Handle handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle == Socket::INVALID_HANDLE) {
+        return Socket();
+    }
+    if (is_listen) {
+        unlink(path.c_str());
+        if (bind(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 && listen(handle, 64) == 0) {
+            return Socket(handle);
+        }
+    } else {
+        if (connect(handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+            return Socket(handle);
+        }
+    }
+    CloseHandle(handle);
+    return Socket();
+#endif
+}
+
+// largest payload of each type of message
+size_t GetMaxPayloadSize(MessageType type) {
+    const size_t max_tile_planes = static_cast<size_t>(MAX_TILE_SIZE)*MAX_TILE_SIZE*3*sizeof(float);
+    switch (type) {
+    case MessageType::HELLO:    return sizeof(RenderHello);
+    case MessageType::JOB:      return sizeof(RenderJob);
+    case MessageType::TILE:     return sizeof(RenderTileRequest);
+    case MessageType::RESULT:   return sizeof(RenderTileRequest) + max_tile_planes;
+    case MessageType::SHUTDOWN: return 0;
+    case MessageType::SUBMIT:   return sizeof(RenderSubmit) + MAX_SCENE_NAME_SIZE;
+    case MessageType::CANCEL:   return sizeof(RenderCancel);
+    case MessageType::PROGRESS: return sizeof(RenderProgress) + max_tile_planes;
+    case MessageType::DONE:     return sizeof(RenderDone);
+    default:                    return 0;
+    }
+}
+
+Socket Open(const std::string &address, bool is_listen) {
+    std::string host, port, path;
+    if (ParseTCP(address, host, port)) {
+        return OpenTCP(host, port, is_listen);
+    }
+    if (ParseUnix(address, path)) {
+        return OpenUnix(path, is_listen);
+    }
+    return Socket();
+}
+
+}
+
+Socket::~Socket() {
+    Close();
+}
+
+Socket::Socket(Socket &&other) 
+: m_handle(other.m_handle) 
+{
+    other.m_handle = INVALID_HANDLE;
+}
+
+Socket& Socket::operator=(Socket &&other) {
+    if (this != &other) {
+        Close();
+        m_handle = other.m_handle;
+        other.m_handle = INVALID_HANDLE;
+    }
+    return *this;
+}
+
+Socket Socket::Listen(const std::string &address) {
+    return Open(address, true);
+}
+
+Socket Socket::Connect(const std::string &address) {
+    return Open(address, false);
+}
+
+Socket Socket::Accept() {
+    Handle handle = accept(m_handle, nullptr, nullptr);
+    if (handle == INVALID_HANDLE) {
+        return Socket();
+    }
+    int enable = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+    return Socket(handle);
+}
+
+void Socket::Close() {
+    if (IsValid()) {
+        CloseHandle(m_handle);
+        m_handle = INVALID_HANDLE;
+    }
+}
+
+bool Socket::SendAll(const void *data, size_t size) {
+    const char *ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        const int64_t n = SendSome(ptr, size);
+        if (n < 0 || (n == 0 && !WaitHandle(m_handle, POLLOUT))) {
+            return false;
+        }
+        ptr += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool Socket::RecvAll(void *data, size_t size) {
+    char *ptr = static_cast<char*>(data);
+    while (size > 0) {
+#ifdef _WIN32
+        int n = recv(m_handle, ptr, static_cast<int>(size), 0);
+#else
+        auto n = recv(m_handle, ptr, size, 0);
+#endif
+        if (n < 0 && IsWouldBlock()) {
+            if (!WaitHandle(m_handle, POLLIN)) {
+                return false;
+            }
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+int64_t Socket::SendSome(const void *data, size_t size) {
+#if defined(_WIN32)
+    int n = send(m_handle, static_cast<const char*>(data), static_cast<int>(size), 0);
+#elif defined(MSG_NOSIGNAL)
+    // a dead peer should return an error instead of killing the process
+    auto n = send(m_handle, data, size, MSG_NOSIGNAL);
+#else
+    auto n = send(m_handle, data, size, 0);
+#endif
+    if (n < 0) {
+        return IsWouldBlock() ? 0 : -1;
+    }
+    // nothing sent on a blocking socket means the connection has gone
+    return (n == 0 && size > 0) ? -1 : static_cast<int64_t>(n);
+}
+
+int64_t Socket::RecvSome(void *data, size_t size) {
+#ifdef _WIN32
+    int n = recv(m_handle, static_cast<char*>(data), static_cast<int>(size), 0);
+#else
+    auto n = recv(m_handle, data, size, 0);
+#endif
+    if (n < 0) {
+        return IsWouldBlock() ? 0 : -1;
+    }
+    // nothing received means the peer closed the connection
+    return (n == 0 && size > 0) ? -1 : static_cast<int64_t>(n);
+}
+
+bool Socket::SetNonBlocking(bool is_non_blocking) {
+#ifdef _WIN32
+    u_long mode = is_non_blocking ? 1 : 0;
+    return ioctlsocket(static_cast<SOCKET>(m_handle), FIONBIO, &mode) == 0;
+#else
+    const int flags = fcntl(m_handle, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(m_handle, F_SETFL, is_non_blocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == 0;
+#endif
+}
+
+bool Socket::WaitReadable(int timeout_ms) {
+    pollfd fd;
+    fd.fd = m_handle;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    return poll(&fd, 1, timeout_ms) > 0;
+}
+
+bool SendMessage(Socket &socket, MessageType type, const void *payload, size_t size) {
+    return SendMessage(socket, type, payload, size, nullptr, 0);
+}
+
+bool SendMessage(Socket &socket, MessageType type, const void *header, size_t header_size, const void *payload, size_t size) {
+    MessageHeader message;
+    message.magic = MESSAGE_MAGIC;
+    message.type = type;
+    message.size = static_cast<uint32_t>(header_size + size);
+    if (!socket.SendAll(&message, sizeof(message))) {
+        return false;
+    }
+    if (header_size > 0 && !socket.SendAll(header, header_size)) {
+        return false;
+    }
+    if (size > 0 && !socket.SendAll(payload, size)) {
+        return false;
+    }
+    return true;
+}
+
+void EncodeMessage(
+    MessageType type, const void *header, size_t header_size, const void *payload, size_t size,
+    std::vector<uint8_t> &message)
+{
+    MessageHeader message_header;
+    message_header.magic = MESSAGE_MAGIC;
+    message_header.type = type;
+    message_header.size = static_cast<uint32_t>(header_size + size);
+    message.resize(sizeof(message_header) + header_size + size);
+    memcpy(message.data(), &message_header, sizeof(message_header));
+    if (header_size > 0) {
+        memcpy(message.data() + sizeof(message_header), header, header_size);
+    }
+    if (size > 0) {
+        memcpy(message.data() + sizeof(message_header) + header_size, payload, size);
+    }
+}
+
+int64_t DecodeMessage(const uint8_t *data, size_t size, MessageType &type, std::vector<uint8_t> &payload) {
+    MessageHeader message;
+    if (size < sizeof(message)) {
+        return 0;
+    }
+    memcpy(&message, data, sizeof(message));
+    // checked before the payload arrives, so a bad size is rejected without waiting for it
+    if (message.magic != MESSAGE_MAGIC || message.size > GetMaxPayloadSize(message.type)) {
+        return -1;
+    }
+    if (size - sizeof(message) < message.size) {
+        return 0;
+    }
+    type = message.type;
+    payload.assign(data + sizeof(message), data + sizeof(message) + message.size);
+    return static_cast<int64_t>(sizeof(message) + message.size);
+}
+
+bool RecvMessage(Socket &socket, MessageType &type, std::vector<uint8_t> &payload) {
+    MessageHeader message;
+    if (!socket.RecvAll(&message, sizeof(message))) {
+        return false;
+    }
+    if (message.magic != MESSAGE_MAGIC) {
+        return false;
+    }
+    if (message.size > GetMaxPayloadSize(message.type)) {
+        return false;
+    }
+    type = message.type;
+    payload.resize(message.size);
+    if (message.size > 0 && !socket.RecvAll(payload.data(), message.size)) {
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> PollReadable(const std::vector<Socket*> &sockets, int timeout_ms) {
+    std::vector<int> writable;
+    return PollReadable(sockets, timeout_ms, std::vector<bool>(sockets.size(), false), writable);
+}
+
+std::vector<int> PollReadable(
+    const std::vector<Socket*> &sockets, int timeout_ms,
+    const std::vector<bool> &is_writing, std::vector<int> &writable)
+{
+    std::vector<pollfd> fds(sockets.size());
+    for (size_t i = 0; i < sockets.size(); i++) {
+        fds[i].fd = sockets[i]->GetHandle();
+        fds[i].events = POLLIN | (is_writing[i] ? POLLOUT : 0);
+        fds[i].revents = 0;
+    }
+
+    std::vector<int> readable;
+    writable.clear();
+    if (fds.empty() || poll(fds.data(), static_cast<unsigned long>(fds.size()), timeout_ms) <= 0) {
+        return readable;
+    }
+    for (size_t i = 0; i < fds.size(); i++) {
+        // hangups and errors are reported as readable so the caller sees the failed read
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+            readable.push_back(static_cast<int>(i));
+        }
+        if (fds[i].revents & POLLOUT) {
+            writable.push_back(static_cast<int>(i));
+        }
+    }
+    return readable;
+}
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace raytracer
+{
+
+// Thin wrapper around a stream socket
+// Addresses are either "tcp:<host>:<port>" or "unix:<path>" (unix sockets are not available on windows)
+class Socket {
+    public:
+#ifdef _WIN32
+        using Handle = uintptr_t;
+#else
+        using Handle = int;
+#endif
+        static const Handle INVALID_HANDLE;
+    public:
+        Socket() {}
+        explicit Socket(Handle handle): m_handle(handle) {}
+        ~Socket();
+        Socket(Socket &&other);
+        Socket& operator=(Socket &&other);
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        static Socket Listen(const std::string &address);
+        static Socket Connect(const std::string &address);
+        Socket Accept();
+        void Close();
+
+        // these wait for the socket when it is non-blocking
+        bool SendAll(const void *data, size_t size);
+        bool RecvAll(void *data, size_t size);
+        // send as much as fits without waiting, returns the bytes sent or -1 if the connection failed
+        int64_t SendSome(const void *data, size_t size);
+        // receive whatever has arrived without waiting, returns the bytes received or -1 if the connection closed or failed
+        int64_t RecvSome(void *data, size_t size);
+        bool SetNonBlocking(bool is_non_blocking);
+        // wait up to timeout_ms for data to become readable
+        bool WaitReadable(int timeout_ms);
+        inline bool IsValid() const { return m_handle != INVALID_HANDLE; }
+        inline Handle GetHandle() const { return m_handle; }
+    private:
+        Handle m_handle{INVALID_HANDLE};
+};
+
+// Messages are a fixed header followed by a payload
+// Values are sent in host byte order, so all nodes are expected to share the same architecture
+enum class MessageType: uint32_t {
+    HELLO,      // worker -> coordinator: RenderHello
+    JOB,        // coordinator -> worker: RenderJob
+    TILE,       // coordinator -> worker: RenderTileRequest
+    RESULT,     // worker -> coordinator: RenderTileRequest followed by 3 float planes
+    SHUTDOWN,   // coordinator -> worker, or client -> server: no payload
+    SUBMIT,     // client -> server: RenderSubmit followed by the scene name
+    CANCEL,     // client -> server: RenderCancel
+    PROGRESS,   // server -> client: RenderProgress followed by 3 float planes
+    DONE,       // server -> client: RenderDone
+};
+
+struct MessageHeader {
+    public:
+        uint32_t magic;
+        MessageType type;
+        uint32_t size;
+};
+
+constexpr uint32_t MESSAGE_MAGIC = 0x52415954;
+constexpr uint32_t PROTOCOL_VERSION = 1;
+
+bool SendMessage(Socket &socket, MessageType type, const void *payload, size_t size);
+bool SendMessage(Socket &socket, MessageType type, const void *header, size_t header_size, const void *payload, size_t size);
+// the bytes SendMessage would send, for sockets that are written a piece at a time
+void EncodeMessage(
+    MessageType type, const void *header, size_t header_size, const void *payload, size_t size,
+    std::vector<uint8_t> &message);
+// take the first message out of bytes received a piece at a time
+// returns the bytes it used, 0 if all of it hasn't arrived yet, or -1 if it isn't a valid message
+int64_t DecodeMessage(const uint8_t *data, size_t size, MessageType &type, std::vector<uint8_t> &payload);
+// fails for payloads larger than their type allows, see RenderProtocol.h
+bool RecvMessage(Socket &socket, MessageType &type, std::vector<uint8_t> &payload);
+
+// Wait until any of the sockets is readable, returns indices of the readable sockets
+std::vector<int> PollReadable(const std::vector<Socket*> &sockets, int timeout_ms);
+// the same, also waking when a socket with is_writing set becomes writable, whose indices are put in writable
+std::vector<int> PollReadable(
+    const std::vector<Socket*> &sockets, int timeout_ms,
+    const std::vector<bool> &is_writing, std::vector<int> &writable);
+
+}
@@ -0,0 +1,344 @@
+#include "PathGuide.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raytracer
+{
+
+namespace {
+
+constexpr float PI = 3.14159265f;
+// radiance is summed as fixed point with this many steps per unit
+constexpr double FIXED_SCALE = 65536.0;
+// largest radiance over pdf recorded from one vertex, so a rare bright path can't take over a region
+constexpr float MAX_RECORD = 1e4f;
+constexpr int MAX_SPATIAL_DEPTH = 32;
+
+// keeps coordinates inside [0,1) so they always land in a quarter
+inline float ClampUnit(float x) {
+    return std::min(std::max(x, 0.0f), 0.99999994f);
+}
+
+// adds the node for a quarter with the given energy and its subdivisions, children are always added after their parents
+// nodes that the source doesn't divide any further are split with their energy spread evenly
+uint32_t AddBuildingNode(
+    const std::vector<DirectionTree::Node> &source, int source_node, float energy,
+    int depth, int max_depth, float threshold, std::vector<uint32_t> &children)
+{
+    const uint32_t index = static_cast<uint32_t>(children.size() / 4);
+    children.resize(children.size() + 4, 0);
+    for (int i = 0; i < 4; i++) {
+        const float quarter = (source_node >= 0) ? source[source_node].sums[i] : energy*0.25f;
+        if (depth+1 >= max_depth || quarter <= threshold) {
+            continue;
+        }
+        const int child_source = (source_node >= 0 && source[source_node].children[i]) ?
+            static_cast<int>(source[source_node].children[i]) : -1;
+        const uint32_t child = AddBuildingNode(source, child_source, quarter, depth+1, max_depth, threshold, children);
+        children[index*4 + i] = child;
+    }
+    return index;
+}
+
+}
+
+glm::vec2 DirectionTree::ToSquare(const glm::vec3 &direction) {
+    float phi = std::atan2(direction.y, direction.x);
+    if (phi < 0.0f) {
+        phi += 2.0f*PI;
+    }
+    return glm::vec2{ClampUnit(0.5f*(direction.z + 1.0f)), ClampUnit(phi / (2.0f*PI))};
+}
+
+glm::vec3 DirectionTree::ToDirection(const glm::vec2 &square) {
+    const float cos_theta = 2.0f*square.x - 1.0f;
+    const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta*cos_theta));
+    const float phi = 2.0f*PI*square.y;
+    return glm::vec3{sin_theta*std::cos(phi), sin_theta*std::sin(phi), cos_theta};
+}
+
+glm::vec3 DirectionTree::Sample(glm::vec2 u) const {
+    u = glm::vec2{ClampUnit(u.x), ClampUnit(u.y)};
+    glm::vec2 origin{0.0f, 0.0f};
+    float size = 1.0f;
+    uint32_t node = 0;
+    while (true) {
+        const Node &n = nodes[node];
+        const float total = n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3];
+        if (total <= 0.0f) {
+            return ToDirection(origin + u*size);
+        }
+        // pick the column and then the quarter within it, reusing each random number for the next level
+        const float left = n.sums[0] + n.sums[2];
+        int x, y;
+        if (u.x*total < left) {
+            x = 0;
+            u.x = u.x*total / left;
+        } else {
+            x = 1;
+            u.x = (u.x*total - left) / (total - left);
+        }
+        const float bottom = n.sums[x];
+        const float column = n.sums[x] + n.sums[x+2];
+        if (column <= 0.0f) {
+            y = (u.y < 0.5f) ? 0 : 1;
+            u.y = (y == 0) ? 2.0f*u.y : 2.0f*u.y - 1.0f;
+        } else if (u.y*column < bottom) {
+            y = 0;
+            u.y = u.y*column / bottom;
+        } else {
+            y = 1;
+            u.y = (u.y*column - bottom) / (column - bottom);
+        }
+        u = glm::vec2{ClampUnit(u.x), ClampUnit(u.y)};
+
+        size *= 0.5f;
+        origin += glm::vec2{static_cast<float>(x), static_cast<float>(y)}*size;
+        const uint32_t child = n.children[x + 2*y];
+        if (!child) {
+            return ToDirection(origin + u*size);
+        }
+        node = child;
+    }
+}
+
+float DirectionTree::GetPdf(const glm::vec3 &direction) const {
+    glm::vec2 p = ToSquare(direction);
+    // density over the square, which covers 4 pi steradians
+    float pdf = 1.0f / (4.0f*PI);
+    uint32_t node = 0;
+    while (true) {
+        const Node &n = nodes[node];
+        const float total = n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3];
+        if (total <= 0.0f) {
+            return pdf;
+        }
+        const int x = (p.x >= 0.5f) ? 1 : 0;
+        const int y = (p.y >= 0.5f) ? 1 : 0;
+        const int i = x + 2*y;
+        pdf *= 4.0f*n.sums[i] / total;
+        if (!n.children[i]) {
+            return pdf;
+        }
+        p = p*2.0f - glm::vec2{static_cast<float>(x), static_cast<float>(y)};
+        node = n.children[i];
+    }
+}
+
+void PathGuide::Reset(const Bounds &bounds) {
+    m_nodes.clear();
+    m_regions.clear();
+    m_iteration = 0;
+    m_pass = 0;
+
+    auto region = std::make_unique<Region>();
+    region->bounds = bounds.IsEmpty() ? Bounds{glm::vec3{-1}, glm::vec3{1}} : bounds;
+    region->depth = 0;
+    region->building_children.assign(4, 0);
+    ResetBuildingSums(*region);
+    m_regions.push_back(std::move(region));
+    m_nodes.push_back({0, 0.0f, {0, 0}, 0});
+}
+
+void PathGuide::OnPassFinished() {
+    if (!IsTraining() || m_regions.empty()) {
+        return;
+    }
+    // each iteration has twice the passes of the one before
+    m_pass++;
+    if (m_pass < (1 << m_iteration)) {
+        return;
+    }
+    FinishIteration();
+    m_pass = 0;
+    m_iteration++;
+}
+
+int PathGuide::FindRegion(const glm::vec3 &position) const {
+    // points outside the bounds, such as on an infinite plane, go to the region nearest to them
+    const SpatialNode *node = &m_nodes[0];
+    while (node->region < 0) {
+        node = &m_nodes[node->children[(position[node->axis] >= node->split) ? 1 : 0]];
+    }
+    return node->region;
+}
+
+bool PathGuide::ScatterLambertian(
+    const Lambertian &material, Ray &ray, const Collision &collision, Sampler &sampler, float &pdf) const
+{
+    const Region &region = *m_regions[FindRegion(collision.pos)];
+    if (region.sampling.nodes.empty()) {
+        const bool has_scatter = material.CastRay(ray, collision, sampler);
+        pdf = std::max(glm::dot(ray.direction, collision.normal), 0.0f) / PI;
+        return has_scatter;
+    }
+
+    glm::vec3 direction;
+    if (sampler.Next1D() < m_guide_fraction) {
+        direction = region.sampling.Sample(sampler.Next2D());
+    } else {
+        // same as Lambertian::CastRay
+        direction = glm::normalize(collision.normal + sampler.UnitSphere());
+        if (glm::any(glm::epsilonEqual(direction, glm::vec3{0,0,0}, std::numeric_limits<float>::epsilon()))) {
+            direction = collision.normal;
+        }
+    }
+
+    // guided directions can go into the surface, those paths end without light
+    const float cos_theta = glm::dot(direction, collision.normal);
+    if (cos_theta <= 0.0f) {
+        ray.color = glm::vec3{0,0,0};
+        pdf = 0.0f;
+        return false;
+    }
+    // one sample combination of the two, weighted by the density of either picking the direction
+    const float material_pdf = cos_theta / PI;
+    pdf = m_guide_fraction*region.sampling.GetPdf(direction) + (1.0f - m_guide_fraction)*material_pdf;
+    material.Scatter(ray, collision, direction, material_pdf / pdf);
+    return true;
+}
+
+float PathGuide::GetLambertianPdf(const Collision &collision, const glm::vec3 &direction) const {
+    const float material_pdf = std::max(glm::dot(direction, collision.normal), 0.0f) / PI;
+    const Region &region = *m_regions[FindRegion(collision.pos)];
+    if (region.sampling.nodes.empty()) {
+        return material_pdf;
+    }
+    return m_guide_fraction*region.sampling.GetPdf(direction) + (1.0f - m_guide_fraction)*material_pdf;
+}
+
+void PathGuide::Record(const Vertex *vertices, int total_vertices, const glm::vec3 &color) {
+    for (int k = 0; k < total_vertices; k++) {
+        const Vertex &vertex = vertices[k];
+        if (vertex.pdf <= 0.0f) {
+            continue;
+        }
+        Region &region = *m_regions[FindRegion(vertex.position)];
+        region.total_records.fetch_add(1, std::memory_order_relaxed);
+
+        // the light the path gathered after the vertex is the throughput up to it times the light that arrived there
+        glm::vec3 radiance{0,0,0};
+        for (int c = 0; c < 3; c++) {
+            radiance[c] = (vertex.throughput[c] > 0.0f) ? (color[c] - vertex.prior[c]) / vertex.throughput[c] : 0.0f;
+        }
+        const float luminance = 0.2126f*radiance.r + 0.7152f*radiance.g + 0.0722f*radiance.b;
+        const float value = std::min(luminance / vertex.pdf, MAX_RECORD);
+        const uint64_t fixed = static_cast<uint64_t>(value * FIXED_SCALE);
+        if (fixed == 0) {
+            continue;
+        }
+
+        glm::vec2 p = DirectionTree::ToSquare(vertex.direction);
+        uint32_t node = 0;
+        while (true) {
+            const int x = (p.x >= 0.5f) ? 1 : 0;
+            const int y = (p.y >= 0.5f) ? 1 : 0;
+            const uint32_t slot = node*4 + x + 2*y;
+            const uint32_t child = region.building_children[slot];
+            if (!child) {
+                region.building_sums[slot].fetch_add(fixed, std::memory_order_relaxed);
+                break;
+            }
+            p = p*2.0f - glm::vec2{static_cast<float>(x), static_cast<float>(y)};
+            node = child;
+        }
+    }
+}
+
+void PathGuide::FinishIteration() {
+    for (auto &region: m_regions) {
+        BuildSamplingTree(*region);
+        RefineBuildingTree(*region);
+    }
+
+    // later iterations have more paths, so regions need more of them to be split
+    const uint32_t threshold = static_cast<uint32_t>(m_split_threshold * std::sqrt(static_cast<float>(1 << m_iteration)));
+    const int total_nodes = static_cast<int>(m_nodes.size());
+    for (int n = 0; n < total_nodes; n++) {
+        if (m_nodes[n].region >= 0) {
+            SplitRegion(n, m_regions[m_nodes[n].region]->total_records.load(), threshold);
+        }
+    }
+
+    for (auto &region: m_regions) {
+        ResetBuildingSums(*region);
+        region->total_records = 0;
+    }
+}
+
+void PathGuide::BuildSamplingTree(Region &region) const {
+    const int total_nodes = static_cast<int>(region.building_children.size() / 4);
+    std::vector<DirectionTree::Node> nodes(total_nodes);
+    // children always come after their parents, so the sums are built from the last node back
+    for (int n = total_nodes-1; n >= 0; n--) {
+        for (int i = 0; i < 4; i++) {
+            const uint32_t child = region.building_children[n*4 + i];
+            float sum = static_cast<float>(region.building_sums[n*4 + i].load() / FIXED_SCALE);
+            if (child) {
+                const DirectionTree::Node &c = nodes[child];
+                sum += c.sums[0] + c.sums[1] + c.sums[2] + c.sums[3];
+            }
+            nodes[n].sums[i] = sum;
+            nodes[n].children[i] = child;
+        }
+    }
+    // regions that saw no light keep what they learnt before
+    const DirectionTree::Node &root = nodes[0];
+    if (root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3] > 0.0f) {
+        region.sampling.nodes = std::move(nodes);
+    }
+}
+
+void PathGuide::RefineBuildingTree(Region &region) const {
+    const auto &source = region.sampling.nodes;
+    region.building_children.clear();
+    if (source.empty()) {
+        region.building_children.assign(4, 0);
+        return;
+    }
+    const DirectionTree::Node &root = source[0];
+    const float total = root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3];
+    AddBuildingNode(source, 0, total, 0, MAX_DEPTH, m_subdivision_threshold*total, region.building_children);
+}
+
+void PathGuide::ResetBuildingSums(Region &region) const {
+    const size_t total_sums = region.building_children.size();
+    region.building_sums.reset(new std::atomic<uint64_t>[total_sums]);
+    for (size_t i = 0; i < total_sums; i++) {
+        region.building_sums[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void PathGuide::SplitRegion(int node, uint32_t total_records, uint32_t threshold) {
+    const int region_index = m_nodes[node].region;
+    Region &region = *m_regions[region_index];
+    if (total_records <= threshold || region.depth >= MAX_SPATIAL_DEPTH) {
+        return;
+    }
+
+    // halve the region along each axis in turn, both halves start from what the whole region learnt
+    const int axis = region.depth % 3;
+    const float split = 0.5f*(region.bounds.min[axis] + region.bounds.max[axis]);
+    auto other = std::make_unique<Region>();
+    other->bounds = region.bounds;
+    other->bounds.min[axis] = split;
+    other->depth = region.depth + 1;
+    other->sampling = region.sampling;
+    other->building_children = region.building_children;
+    region.bounds.max[axis] = split;
+    region.depth++;
+
+    const int other_index = static_cast<int>(m_regions.size());
+    m_regions.push_back(std::move(other));
+    const uint32_t first = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back({0, 0.0f, {0, 0}, region_index});
+    m_nodes.push_back({0, 0.0f, {0, 0}, other_index});
+    m_nodes[node] = {axis, split, {first, first+1}, -1};
+
+    // assume the paths were spread evenly between the halves
+    SplitRegion(first, total_records/2, threshold);
+    SplitRegion(first+1, total_records/2, threshold);
+}
+
+}
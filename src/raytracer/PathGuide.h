@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Ray.h"
+#include "Shape.h"
+#include "Material.h"
+#include "Sampler.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+namespace raytracer
+{
+
+// Distribution over the sphere of directions as a quadtree over the square (cos(theta), phi)
+// The mapping keeps areas, so each node's density is proportional to its share of the energy over its area
+struct DirectionTree {
+    public:
+        // child i covers the quarter at x = i&1, y = i>>1, and a child of 0 is a leaf
+        struct Node {
+            public:
+                float sums[4];
+                uint32_t children[4];
+        };
+        std::vector<Node> nodes;
+    public:
+        glm::vec3 Sample(glm::vec2 u) const;
+        // solid angle density of Sample
+        float GetPdf(const glm::vec3 &direction) const;
+        static glm::vec2 ToSquare(const glm::vec3 &direction);
+        static glm::vec3 ToDirection(const glm::vec2 &square);
+};
+
+// Online learned distribution of the light arriving at each point of the scene, used to sample diffuse bounces
+// A binary tree over space holds a directional quadtree in each of its regions, as in practical path guiding
+// Paths record the radiance they carried back into the tree being built while the one learnt before is sampled
+// Passes are grouped into training iterations of 1, 2, 4 ... passes, and between iterations each region is split
+// once it has seen enough paths and its quadtree is refined where the most light arrives
+// Radiance is summed with integer atomics, so workers record without locks and the result doesn't depend on their order
+class PathGuide {
+    public:
+        // diffuse vertices of a path that are recorded, the ones after are dropped
+        static constexpr int MAX_VERTICES = 16;
+        struct Vertex {
+            public:
+                glm::vec3 position;
+                glm::vec3 direction;
+                // colour of the path after scattering at the vertex
+                glm::vec3 throughput;
+                // light the path had already gathered by then, which didn't arrive through the scattered direction
+                glm::vec3 prior;
+                float pdf;
+        };
+    public:
+        // forget everything learnt, the scene's finite entities should be within bounds
+        void Reset(const Bounds &bounds);
+        // called between passes while no paths are being traced
+        void OnPassFinished();
+        bool IsTraining() const { return m_iteration < m_total_iterations; }
+        // scatter off a diffuse surface, in a direction from the guide or the material's cosine lobe
+        // pdf receives the solid angle density of the combined sampling, to record the vertex with
+        bool ScatterLambertian(const Lambertian &material, Ray &ray, const Collision &collision, Sampler &sampler, float &pdf) const;
+        // solid angle density of ScatterLambertian picking direction
+        float GetLambertianPdf(const Collision &collision, const glm::vec3 &direction) const;
+        // add the radiance each vertex received from the rest of the path, color is the path's final colour
+        // safe to call from any thread during a pass
+        void Record(const Vertex *vertices, int total_vertices, const glm::vec3 &color);
+        int GetTotalRegions() const { return static_cast<int>(m_regions.size()); }
+        int GetIteration() const { return m_iteration; }
+    public:
+        int m_total_iterations{8};
+        // paths recorded in a region before it is split, grows by sqrt(2) every iteration like the paths per iteration
+        // regions split with fewer paths learn from only a few bright paths each, which guides worse than sharing them
+        int m_split_threshold{32000};
+        // share of a region's light above which a direction node is subdivided
+        float m_subdivision_threshold{0.01f};
+        // chance of sampling the guide instead of the material once it has learnt something
+        float m_guide_fraction{0.5f};
+    private:
+        static constexpr int MAX_DEPTH = 16;
+        struct SpatialNode {
+            public:
+                int axis;
+                float split;
+                uint32_t children[2];
+                // region of a leaf, or -1
+                int region;
+        };
+        struct Region {
+            public:
+                Bounds bounds;
+                int depth;
+                // distribution sampled in this iteration, empty until the region has seen light
+                DirectionTree sampling;
+                // topology of the tree being built, with 4 fixed point sums per node that only count the light
+                // landing directly in each quarter, so a record only adds to the node it ends in
+                std::vector<uint32_t> building_children;
+                std::unique_ptr<std::atomic<uint64_t>[]> building_sums;
+                std::atomic<uint32_t> total_records{0};
+        };
+    private:
+        int FindRegion(const glm::vec3 &position) const;
+        void FinishIteration();
+        // new sampling tree for a region from what it recorded
+        void BuildSamplingTree(Region &region) const;
+        // topology for the next tree to build, subdivided wherever the sampling tree has enough light
+        void RefineBuildingTree(Region &region) const;
+        void ResetBuildingSums(Region &region) const;
+        void SplitRegion(int node, uint32_t total_records, uint32_t threshold);
+    private:
+        std::vector<SpatialNode> m_nodes;
+        std::vector<std::unique_ptr<Region>> m_regions;
+        int m_iteration{0};
+        int m_pass{0};
+};
+
+}
@@ -10,6 +10,10 @@ struct Ray {
         glm::vec3 origin;
         glm::vec3 direction;
         glm::vec3 color;
+        // the ray is a cone, used to pick how much textures are filtered
+        // width of the cone at the origin, and how much it grows per unit distance
+        float cone_width;
+        float cone_spread;
 };
 
 }
\ No newline at end of file
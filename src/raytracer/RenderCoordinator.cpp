@@ -0,0 +1,237 @@
+#include "RenderCoordinator.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace raytracer
+{
+
+bool RenderCoordinator::Listen(const std::string &address) {
+    m_listener = Socket::Listen(address);
+    return m_listener.IsValid();
+}
+
+bool RenderCoordinator::RenderFrame(
+    const Camera &camera, int total_samples, int total_bounces, uint32_t seed,
+    HDRBuffer &output, int width, int height)
+{
+    output.Resize(width, height);
+    output.Clear();
+
+    Frame frame;
+    frame.id = ++m_frame_id;
+    frame.job = RenderJob::Create(frame.id, camera, width, height, total_samples, total_bounces, seed);
+    frame.total_done = 0;
+
+    const int tile_size = std::min(std::max(1, m_tile_size), MAX_TILE_SIZE);
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            Tile tile;
+            tile.x_start = x;
+            tile.x_end = std::min(x+tile_size, width);
+            tile.y_start = y;
+            tile.y_end = std::min(y+tile_size, height);
+            frame.tiles.push_back(tile);
+        }
+    }
+    const int total_tiles = static_cast<int>(frame.tiles.size());
+    frame.states.resize(total_tiles, TileState::PENDING);
+    frame.issue_times.resize(total_tiles);
+    // hand out tiles from the front of the image first
+    for (int i = total_tiles-1; i >= 0; i--) {
+        frame.pending.push_back(i);
+    }
+
+    auto last_worker_time = clock::now();
+
+    while (frame.total_done < total_tiles) {
+        for (auto &worker: m_workers) {
+            DispatchTiles(*worker, frame);
+        }
+
+        std::vector<Socket*> sockets;
+        sockets.push_back(&m_listener);
+        for (auto &worker: m_workers) {
+            sockets.push_back(&worker->socket);
+        }
+
+        // poll with a timeout so stalled tiles are reissued even if nothing arrives
+        auto readable = PollReadable(sockets, 100);
+        // go backwards so removing a worker doesn't shift the ones we still have to read
+        std::sort(readable.begin(), readable.end(), std::greater<int>());
+        for (int i: readable) {
+            if (i == 0) {
+                AcceptWorker();
+                continue;
+            }
+            if (!HandleMessage(*m_workers[i-1], frame, output)) {
+                RemoveWorker(i-1, frame);
+            }
+        }
+
+        if (!m_workers.empty()) {
+            last_worker_time = clock::now();
+        } else {
+            float elapsed = std::chrono::duration<float>(clock::now() - last_worker_time).count();
+            if (elapsed > m_worker_timeout) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void RenderCoordinator::Shutdown() {
+    for (auto &worker: m_workers) {
+        SendMessage(worker->socket, MessageType::SHUTDOWN, nullptr, 0);
+    }
+    m_workers.clear();
+}
+
+void RenderCoordinator::AcceptWorker() {
+    Socket socket = m_listener.Accept();
+    if (!socket.IsValid()) {
+        return;
+    }
+
+    // workers introduce themselves straight after connecting
+    MessageType type;
+    std::vector<uint8_t> payload;
+    if (!socket.WaitReadable(1000) || !RecvMessage(socket, type, payload)) {
+        return;
+    }
+    if (type != MessageType::HELLO || payload.size() != sizeof(RenderHello)) {
+        return;
+    }
+    RenderHello hello;
+    memcpy(&hello, payload.data(), sizeof(hello));
+    if (hello.version != PROTOCOL_VERSION) {
+        return;
+    }
+
+    auto worker = std::make_unique<Worker>();
+    worker->socket = std::move(socket);
+    // keep one extra tile queued so the worker never waits on the network
+    worker->capacity = std::max(1, static_cast<int>(hello.total_threads)) + 1;
+    worker->frame_id = 0;
+    m_workers.push_back(std::move(worker));
+}
+
+bool RenderCoordinator::HandleMessage(Worker &worker, Frame &frame, HDRBuffer &output) {
+    MessageType type;
+    std::vector<uint8_t> payload;
+    if (!RecvMessage(worker.socket, type, payload)) {
+        return false;
+    }
+    if (type != MessageType::RESULT || payload.size() < sizeof(RenderTileRequest)) {
+        return false;
+    }
+
+    RenderTileRequest request;
+    memcpy(&request, payload.data(), sizeof(request));
+
+    auto &tiles = worker.tiles;
+    auto it = std::find(tiles.begin(), tiles.end(), static_cast<int>(request.tile_id));
+    if (request.frame_id != frame.id || it == tiles.end()) {
+        // a late result from an older frame
+        return true;
+    }
+    tiles.erase(it);
+
+    const int tile_id = static_cast<int>(request.tile_id);
+    // another worker may have already returned this tile
+    if (frame.states[tile_id] == TileState::DONE) {
+        return true;
+    }
+
+    const Tile &tile = frame.tiles[tile_id];
+    const size_t plane_size = static_cast<size_t>(tile.GetWidth())*tile.GetHeight();
+    if (payload.size() != sizeof(RenderTileRequest) + plane_size*3*sizeof(float)) {
+        return false;
+    }
+
+    const float *planes = reinterpret_cast<const float*>(payload.data() + sizeof(RenderTileRequest));
+    for (int c = 0; c < 3; c++) {
+        const float *src = planes + c*plane_size;
+        for (int y = tile.y_start; y < tile.y_end; y++) {
+            float *dst = output.GetPlane(c) + static_cast<size_t>(y)*output.GetWidth() + tile.x_start;
+            memcpy(dst, src + static_cast<size_t>(y-tile.y_start)*tile.GetWidth(), tile.GetWidth()*sizeof(float));
+        }
+    }
+
+    frame.states[tile_id] = TileState::DONE;
+    frame.total_done++;
+    return true;
+}
+
+void RenderCoordinator::RemoveWorker(int index, Frame &frame) {
+    // give the unfinished tiles of a dead worker to everyone else
+    for (int tile_id: m_workers[index]->tiles) {
+        if (frame.states[tile_id] == TileState::IN_FLIGHT) {
+            frame.states[tile_id] = TileState::PENDING;
+            frame.pending.push_back(tile_id);
+        }
+    }
+    m_workers.erase(m_workers.begin() + index);
+}
+
+void RenderCoordinator::DispatchTiles(Worker &worker, Frame &frame) {
+    while (static_cast<int>(worker.tiles.size()) < worker.capacity) {
+        int tile_id = -1;
+
+        // drop tiles that were finished by someone else after being reissued
+        while (!frame.pending.empty() && tile_id < 0) {
+            int id = frame.pending.back();
+            frame.pending.pop_back();
+            if (frame.states[id] == TileState::PENDING) {
+                tile_id = id;
+            }
+        }
+
+        // nothing left to hand out, so duplicate a tile that has been running for too long
+        if (tile_id < 0) {
+            auto now = clock::now();
+            for (int id = 0; id < static_cast<int>(frame.tiles.size()); id++) {
+                if (frame.states[id] != TileState::IN_FLIGHT) {
+                    continue;
+                }
+                float elapsed = std::chrono::duration<float>(now - frame.issue_times[id]).count();
+                if (elapsed > m_tile_timeout && std::find(worker.tiles.begin(), worker.tiles.end(), id) == worker.tiles.end()) {
+                    tile_id = id;
+                    break;
+                }
+            }
+        }
+
+        if (tile_id < 0) {
+            return;
+        }
+
+        if (worker.frame_id != frame.id) {
+            if (!SendMessage(worker.socket, MessageType::JOB, &frame.job, sizeof(frame.job))) {
+                frame.pending.push_back(tile_id);
+                return;
+            }
+            worker.frame_id = frame.id;
+        }
+
+        RenderTileRequest request;
+        request.frame_id = frame.id;
+        request.tile_id = static_cast<uint32_t>(tile_id);
+        request.tile = frame.tiles[tile_id];
+        // failed sends are picked up as a disconnect when polling
+        if (!SendMessage(worker.socket, MessageType::TILE, &request, sizeof(request))) {
+            if (frame.states[tile_id] == TileState::PENDING) {
+                frame.pending.push_back(tile_id);
+            }
+            return;
+        }
+
+        frame.states[tile_id] = TileState::IN_FLIGHT;
+        frame.issue_times[tile_id] = clock::now();
+        worker.tiles.push_back(tile_id);
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Network.h"
+#include "RenderProtocol.h"
+#include "HDRBuffer.h"
+
+#include <memory>
+#include <vector>
+#include <chrono>
+
+namespace raytracer
+{
+
+// Distributes the tiles of a frame to RenderWorker processes
+// Workers are given tiles as they finish their previous ones, so faster nodes take more of the frame
+// Tiles held by a worker that disconnects, or that take too long, are given to another worker
+class RenderCoordinator {
+    public:
+        RenderCoordinator() {}
+        bool Listen(const std::string &address);
+        // blocks until every tile has been returned, or no workers are available for m_worker_timeout
+        bool RenderFrame(
+            const Camera &camera, int total_samples, int total_bounces, uint32_t seed,
+            HDRBuffer &output, int width, int height);
+        // tell all workers to exit
+        void Shutdown();
+        int GetTotalWorkers() const { return static_cast<int>(m_workers.size()); }
+    public:
+        // at most MAX_TILE_SIZE
+        int m_tile_size{32};
+        // seconds before an unfinished tile is also given to another worker
+        float m_tile_timeout{30.0f};
+        // seconds to wait without any connected workers before giving up on a frame
+        float m_worker_timeout{30.0f};
+    private:
+        using clock = std::chrono::steady_clock;
+        enum class TileState { PENDING, IN_FLIGHT, DONE };
+        struct Worker {
+            public:
+                Socket socket;
+                int capacity;
+                uint32_t frame_id;
+                std::vector<int> tiles;
+        };
+        struct Frame {
+            public:
+                uint32_t id;
+                RenderJob job;
+                std::vector<Tile> tiles;
+                std::vector<TileState> states;
+                std::vector<clock::time_point> issue_times;
+                std::vector<int> pending;
+                int total_done;
+        };
+    private:
+        void AcceptWorker();
+        bool HandleMessage(Worker &worker, Frame &frame, HDRBuffer &output);
+        void RemoveWorker(int index, Frame &frame);
+        void DispatchTiles(Worker &worker, Frame &frame);
+    private:
+        Socket m_listener;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        uint32_t m_frame_id{0};
+};
+
+}
@@ -0,0 +1,40 @@
+#include "RenderProtocol.h"
+
+namespace raytracer
+{
+
+RenderJob RenderJob::Create(
+    uint32_t frame_id, const Camera &camera, int width, int height, 
+    int total_samples, int total_bounces, uint32_t seed) 
+{
+    RenderJob job;
+    job.frame_id = frame_id;
+    job.width = width;
+    job.height = height;
+    job.total_samples = total_samples;
+    job.total_bounces = total_bounces;
+    job.seed = seed;
+    job.vertical_fov = camera.m_vertical_fov;
+    job.aspect_ratio = camera.m_aspect_ratio;
+    job.plane_distance = camera.m_plane_distance;
+    for (int i = 0; i < 3; i++) {
+        job.look_from[i] = camera.m_look_from[i];
+        job.look_at[i] = camera.m_look_at[i];
+        job.up[i] = camera.m_up[i];
+    }
+    return job;
+}
+
+Camera RenderJob::GetCamera() const {
+    Camera camera;
+    camera.m_vertical_fov = vertical_fov;
+    camera.m_aspect_ratio = aspect_ratio;
+    camera.m_plane_distance = plane_distance;
+    camera.m_look_from = glm::vec3{look_from[0], look_from[1], look_from[2]};
+    camera.m_look_at = glm::vec3{look_at[0], look_at[1], look_at[2]};
+    camera.m_up = glm::vec3{up[0], up[1], up[2]};
+    camera.RecalculateVirtualPlane();
+    return camera;
+}
+
+}
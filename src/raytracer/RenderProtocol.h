@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Network.h"
+#include "Camera.h"
+#include "Tile.h"
+
+namespace raytracer
+{
+
+// Payloads exchanged between a RenderCoordinator and its RenderWorkers, and between a RenderServer and its clients
+
+// RecvMessage drops the connection for anything larger than these allow, so a peer can't make us allocate whatever it likes
+// tiles are at most this many pixels wide and high
+constexpr int MAX_TILE_SIZE = 256;
+constexpr size_t MAX_SCENE_NAME_SIZE = 256;
+
+struct RenderHello {
+    public:
+        uint32_t version;
+        // how many tiles the worker can render at the same time
+        uint32_t total_threads;
+};
+
+// Everything a worker needs besides the scene, which it loads itself
+struct RenderJob {
+    public:
+        uint32_t frame_id;
+        int32_t width, height;
+        int32_t total_samples;
+        int32_t total_bounces;
+        uint32_t seed;
+        float vertical_fov;
+        float aspect_ratio;
+        float plane_distance;
+        float look_from[3];
+        float look_at[3];
+        float up[3];
+    public:
+        static RenderJob Create(
+            uint32_t frame_id, const Camera &camera, int width, int height, 
+            int total_samples, int total_bounces, uint32_t seed);
+        // returns a camera ready for use
+        Camera GetCamera() const;
+};
+
+struct RenderTileRequest {
+    public:
+        uint32_t frame_id;
+        uint32_t tile_id;
+        Tile tile;
+};
+
+// A job for a RenderServer, its frame_id is chosen by the client and sent back with every result
+struct RenderSubmit {
+    public:
+        RenderJob job;
+        // higher priorities take every free thread before any tile of a lower one is started
+        int32_t priority;
+        // samples added to every tile before the next pass is started, and the tiles are sent back
+        int32_t samples_per_pass;
+};
+
+struct RenderCancel {
+    public:
+        uint32_t frame_id;
+};
+
+// The average of the samples of a tile so far
+struct RenderProgress {
+    public:
+        uint32_t frame_id;
+        int32_t total_samples;
+        Tile tile;
+};
+
+enum class RenderStatus: uint32_t { FINISHED, CANCELLED, UNKNOWN_SCENE, INVALID };
+
+struct RenderDone {
+    public:
+        uint32_t frame_id;
+        RenderStatus status;
+        // from being submitted to the first tile being started, and to the last tile being finished
+        float queued_seconds;
+        float total_seconds;
+};
+
+}
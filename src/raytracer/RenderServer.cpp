@@ -0,0 +1,484 @@
+#include "RenderServer.h"
+#include "Timeline.h"
+
+#include <algorithm>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+namespace raytracer
+{
+
+namespace {
+
+// most read from a client each time it is readable
+constexpr size_t RECV_CHUNK_SIZE = 64*1024;
+
+}
+
+RenderServer::~RenderServer() {
+    // cancelled jobs have no tiles left, so the tasks leave after their current one
+    m_is_stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mutex);
+        for (auto &job: m_jobs) {
+            job->is_cancelled = true;
+        }
+    }
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            if (m_total_tasks == 0) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void RenderServer::AddScene(const std::string &name, SceneLoader loader) {
+    m_loaders[name] = std::move(loader);
+}
+
+bool RenderServer::Run(const std::string &address) {
+    m_listener = Socket::Listen(address);
+    if (!m_listener.IsValid()) {
+        return false;
+    }
+
+    bool is_shutdown = false;
+    while (!is_shutdown) {
+        // anything the render threads couldn't send straight away is sent once the client can take it
+        std::vector<Socket*> sockets;
+        std::vector<bool> is_writing;
+        sockets.push_back(&m_listener);
+        is_writing.push_back(false);
+        for (auto &client: m_clients) {
+            sockets.push_back(&client->socket);
+            is_writing.push_back(FlushClient(*client));
+        }
+
+        std::vector<int> writable;
+        auto readable = PollReadable(sockets, 100, is_writing, writable);
+        for (int i: readable) {
+            if (i == 0) {
+                AcceptClient();
+                continue;
+            }
+            std::shared_ptr<Client> client = m_clients[i-1];
+            const bool is_connected = ReadClient(client, is_shutdown);
+            if (!is_connected) {
+                std::lock_guard<std::mutex> lock(client->send_mutex);
+                client->is_connected = false;
+            }
+        }
+
+        // clients that hung up, or were dropped for not reading what was sent to them
+        for (size_t i = m_clients.size(); i-- > 0;) {
+            std::shared_ptr<Client> client = m_clients[i];
+            bool is_connected;
+            {
+                std::lock_guard<std::mutex> lock(client->send_mutex);
+                is_connected = client->is_connected;
+            }
+            if (!is_connected) {
+                RemoveClient(client);
+                m_clients.erase(m_clients.begin() + i);
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mutex);
+        for (auto &job: m_jobs) {
+            job->is_cancelled = true;
+        }
+        PushTasks();
+    }
+    m_listener.Close();
+    return true;
+}
+
+void RenderServer::AcceptClient() {
+    Socket socket = m_listener.Accept();
+    if (!socket.IsValid()) {
+        return;
+    }
+    // everything sent to it goes through FlushClient, which must never wait
+    socket.SetNonBlocking(true);
+    auto client = std::make_shared<Client>();
+    client->socket = std::move(socket);
+    m_clients.push_back(std::move(client));
+}
+
+bool RenderServer::ReadClient(const std::shared_ptr<Client> &client, bool &is_shutdown) {
+    const size_t total_buffered = client->incoming.size();
+    client->incoming.resize(total_buffered + RECV_CHUNK_SIZE);
+    const int64_t received = client->socket.RecvSome(client->incoming.data() + total_buffered, RECV_CHUNK_SIZE);
+    if (received < 0) {
+        return false;
+    }
+    client->incoming.resize(total_buffered + static_cast<size_t>(received));
+
+    // the buffer never holds more than one message and a chunk, since sizes are checked from the header
+    size_t offset = 0;
+    while (!is_shutdown) {
+        MessageType type;
+        std::vector<uint8_t> payload;
+        const int64_t used = DecodeMessage(client->incoming.data() + offset, client->incoming.size() - offset, type, payload);
+        if (used < 0) {
+            return false;
+        }
+        if (used == 0) {
+            break;
+        }
+        offset += static_cast<size_t>(used);
+        if (!HandleMessage(client, type, payload, is_shutdown)) {
+            return false;
+        }
+    }
+    client->incoming.erase(client->incoming.begin(), client->incoming.begin() + offset);
+    return true;
+}
+
+bool RenderServer::HandleMessage(
+    const std::shared_ptr<Client> &client, MessageType type, const std::vector<uint8_t> &payload, bool &is_shutdown)
+{
+    if (type == MessageType::SHUTDOWN) {
+        is_shutdown = true;
+        return true;
+    }
+    if (type == MessageType::SUBMIT && payload.size() >= sizeof(RenderSubmit)) {
+        RenderSubmit submit;
+        memcpy(&submit, payload.data(), sizeof(submit));
+        const std::string scene_name(payload.begin() + sizeof(RenderSubmit), payload.end());
+        Submit(client, submit, scene_name);
+        return true;
+    }
+    if (type == MessageType::CANCEL && payload.size() == sizeof(RenderCancel)) {
+        RenderCancel cancel;
+        memcpy(&cancel, payload.data(), sizeof(cancel));
+        Cancel(client.get(), cancel.frame_id);
+        return true;
+    }
+    return false;
+}
+
+void RenderServer::Submit(const std::shared_ptr<Client> &client, const RenderSubmit &submit, const std::string &scene_name) {
+    const RenderJob &render_job = submit.job;
+    // enough for an 8K frame, whose sums take 400 MB once every tile has been rendered
+    const int64_t max_pixels = int64_t{1} << 25;
+    if (render_job.width <= 0 || render_job.height <= 0 || render_job.total_samples <= 0 || render_job.total_bounces < 0 ||
+        static_cast<int64_t>(render_job.width)*render_job.height > max_pixels)
+    {
+        QueueDone(*client, render_job.frame_id, RenderStatus::INVALID, 0.0f, 0.0f);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_jobs_mutex);
+        const auto total_client_jobs = std::count_if(m_jobs.begin(), m_jobs.end(),
+            [&](const auto &job) { return job->client == client; });
+        if (total_client_jobs >= m_max_client_jobs) {
+            QueueDone(*client, render_job.frame_id, RenderStatus::INVALID, 0.0f, 0.0f);
+            return;
+        }
+    }
+    std::shared_ptr<WarmScene> scene = GetScene(scene_name);
+    if (!scene) {
+        QueueDone(*client, render_job.frame_id, RenderStatus::UNKNOWN_SCENE, 0.0f, 0.0f);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->client = client;
+    job->submit = submit;
+    job->submit.samples_per_pass = std::max(1, std::min(submit.samples_per_pass, render_job.total_samples));
+    job->camera = render_job.GetCamera();
+    job->scene = scene;
+    job->kernel = SelectKernel(scene->kernel_scene, render_job.total_bounces);
+    const int tile_size = std::min(std::max(1, m_tile_size), MAX_TILE_SIZE);
+    for (int y = 0; y < render_job.height; y += tile_size) {
+        for (int x = 0; x < render_job.width; x += tile_size) {
+            Tile tile;
+            tile.x_start = x;
+            tile.x_end = std::min(x+tile_size, static_cast<int>(render_job.width));
+            tile.y_start = y;
+            tile.y_end = std::min(y+tile_size, static_cast<int>(render_job.height));
+            job->tiles.push_back(tile);
+        }
+    }
+    job->sums.resize(job->tiles.size());
+    job->sample_start = 0;
+    job->sample_end = job->submit.samples_per_pass;
+    job->next_tile = 0;
+    job->total_tiles_done = 0;
+    job->is_started = false;
+    job->is_cancelled = false;
+    job->submit_time = clock::now();
+
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    job->id = m_total_jobs++;
+    m_jobs.push_back(std::move(job));
+    PushTasks();
+}
+
+void RenderServer::Cancel(const Client *client, uint32_t frame_id) {
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    for (auto &job: m_jobs) {
+        if (job->client.get() == client && job->submit.job.frame_id == frame_id) {
+            job->is_cancelled = true;
+        }
+    }
+    // jobs without a tile in flight would otherwise never be removed
+    PushTasks();
+}
+
+std::shared_ptr<RenderServer::WarmScene> RenderServer::GetScene(const std::string &name) {
+    for (auto &scene: m_warm_scenes) {
+        if (scene->name == name) {
+            scene->last_used = ++m_total_scene_uses;
+            return scene;
+        }
+    }
+    auto loader = m_loaders.find(name);
+    if (loader == m_loaders.end()) {
+        return nullptr;
+    }
+
+    TimelineScope scope("Load warm scene", "scene");
+    const auto start = clock::now();
+    auto scene = std::make_shared<WarmScene>();
+    scene->name = name;
+    loader->second(scene->scene);
+    scene->kernel_scene.Build(scene->scene);
+    scene->last_used = ++m_total_scene_uses;
+    if (m_is_logging) {
+        printf("Loaded scene %s in %.3fs\n", name.c_str(), std::chrono::duration<float>(clock::now() - start).count());
+    }
+
+    // jobs hold on to their scene, so an unloaded scene lives until its last job is done
+    m_warm_scenes.push_back(scene);
+    while (static_cast<int>(m_warm_scenes.size()) > std::max(1, m_max_warm_scenes)) {
+        auto oldest = std::min_element(m_warm_scenes.begin(), m_warm_scenes.end(),
+            [](const auto &a, const auto &b) { return a->last_used < b->last_used; });
+        m_warm_scenes.erase(oldest);
+    }
+    return scene;
+}
+
+void RenderServer::RemoveClient(const std::shared_ptr<Client> &client) {
+    // the jobs of a client that has gone are of no use to anyone
+    std::lock_guard<std::mutex> lock(m_jobs_mutex);
+    for (auto &job: m_jobs) {
+        if (job->client == client) {
+            job->is_cancelled = true;
+        }
+    }
+    PushTasks();
+}
+
+void RenderServer::QueueMessage(Client &client, MessageType type, const void *header, size_t header_size, const void *payload, size_t size) {
+    std::vector<uint8_t> message;
+    EncodeMessage(type, header, header_size, payload, size, message);
+    std::lock_guard<std::mutex> lock(client.send_mutex);
+    if (!client.is_connected) {
+        return;
+    }
+    client.total_outgoing += message.size();
+    client.outgoing.push_back(std::move(message));
+    if (client.total_outgoing > m_max_queued_bytes) {
+        client.is_connected = false;
+        client.outgoing.clear();
+        client.total_outgoing = 0;
+    }
+}
+
+bool RenderServer::FlushClient(Client &client) {
+    std::lock_guard<std::mutex> lock(client.send_mutex);
+    while (client.is_connected && !client.outgoing.empty()) {
+        const std::vector<uint8_t> &message = client.outgoing.front();
+        const int64_t sent = client.socket.SendSome(message.data() + client.front_sent, message.size() - client.front_sent);
+        if (sent < 0) {
+            client.is_connected = false;
+            client.outgoing.clear();
+            client.total_outgoing = 0;
+            break;
+        }
+        if (sent == 0) {
+            break;
+        }
+        client.front_sent += static_cast<size_t>(sent);
+        client.total_outgoing -= static_cast<size_t>(sent);
+        if (client.front_sent == message.size()) {
+            client.outgoing.pop_front();
+            client.front_sent = 0;
+        }
+    }
+    return !client.outgoing.empty();
+}
+
+void RenderServer::QueueDone(Client &client, uint32_t frame_id, RenderStatus status, float queued_seconds, float total_seconds) {
+    RenderDone done;
+    done.frame_id = frame_id;
+    done.status = status;
+    done.queued_seconds = queued_seconds;
+    done.total_seconds = total_seconds;
+    QueueMessage(client, MessageType::DONE, &done, sizeof(done));
+}
+
+void RenderServer::PushTasks() {
+    // cancelled jobs are removed here when none of their tiles are being rendered
+    for (size_t i = m_jobs.size(); i-- > 0;) {
+        const auto &job = m_jobs[i];
+        if (job->is_cancelled && job->next_tile == job->total_tiles_done) {
+            RemoveJob(job, RenderStatus::CANCELLED);
+        }
+    }
+
+    int total_tiles = 0;
+    for (const auto &job: m_jobs) {
+        total_tiles += static_cast<int>(job->tiles.size()) - job->next_tile;
+    }
+    // one task per thread at most, each one takes tiles until there are none left
+    while (!m_is_stopping && m_total_tasks < m_renderer.GetTotalThreads() && m_total_tasks < total_tiles) {
+        m_total_tasks++;
+        m_renderer.Push([this](int id) {
+            RunTasks(id);
+        });
+    }
+}
+
+std::shared_ptr<RenderServer::Job> RenderServer::TakeTile(int &tile_index) {
+    // highest priority first, then the oldest job
+    std::shared_ptr<Job> best;
+    for (const auto &job: m_jobs) {
+        if (job->is_cancelled || job->next_tile >= static_cast<int>(job->tiles.size())) {
+            continue;
+        }
+        if (!best || job->submit.priority > best->submit.priority) {
+            best = job;
+        }
+    }
+    if (best) {
+        tile_index = best->next_tile++;
+        if (!best->is_started) {
+            best->is_started = true;
+            best->start_time = clock::now();
+        }
+    }
+    return best;
+}
+
+void RenderServer::FinishTile(const std::shared_ptr<Job> &job) {
+    job->total_tiles_done++;
+    if (job->is_cancelled) {
+        // no more of its tiles are taken, so it goes once the ones in flight are done
+        if (job->total_tiles_done == job->next_tile) {
+            RemoveJob(job, RenderStatus::CANCELLED);
+        }
+        return;
+    }
+    if (job->total_tiles_done < static_cast<int>(job->tiles.size())) {
+        return;
+    }
+
+    // every tile has the samples of this pass, so the next one can start
+    const int total_samples = job->submit.job.total_samples;
+    job->sample_start = job->sample_end;
+    if (job->sample_start >= total_samples) {
+        RemoveJob(job, RenderStatus::FINISHED);
+        return;
+    }
+    job->sample_end = std::min(job->sample_start + job->submit.samples_per_pass, total_samples);
+    job->next_tile = 0;
+    job->total_tiles_done = 0;
+    PushTasks();
+}
+
+void RenderServer::RemoveJob(const std::shared_ptr<Job> &job, RenderStatus status) {
+    // keep the job alive while it is removed from the list that might hold its last reference
+    std::shared_ptr<Job> removed = job;
+    m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), removed));
+
+    const auto now = clock::now();
+    const float queued_seconds = std::chrono::duration<float>((removed->is_started ? removed->start_time : now) - removed->submit_time).count();
+    const float total_seconds = std::chrono::duration<float>(now - removed->submit_time).count();
+    QueueDone(*removed->client, removed->submit.job.frame_id, status, queued_seconds, total_seconds);
+    if (m_is_logging) {
+        const RenderJob &render_job = removed->submit.job;
+        printf("Job %llu %s %dx%d %d samples priority %d %s, queued %.3fs, total %.3fs\n",
+            static_cast<unsigned long long>(removed->id), removed->scene->name.c_str(),
+            render_job.width, render_job.height, render_job.total_samples, removed->submit.priority,
+            (status == RenderStatus::FINISHED) ? "finished" : "cancelled", queued_seconds, total_seconds);
+        fflush(stdout);
+    }
+}
+
+void RenderServer::RunTasks(int thread_id) {
+    if (IsTimelineEnabled()) {
+        SetTimelineThreadName("Render thread", thread_id);
+    }
+    std::vector<float> average;
+    while (true) {
+        std::shared_ptr<Job> job;
+        int tile_index = 0;
+        int sample_start = 0, sample_end = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            job = TakeTile(tile_index);
+            if (!job) {
+                m_total_tasks--;
+                return;
+            }
+            sample_start = job->sample_start;
+            sample_end = job->sample_end;
+        }
+
+        // only this task touches the tile's sums until it is finished
+        const Tile &tile = job->tiles[tile_index];
+        const RenderJob &render_job = job->submit.job;
+        const int tile_width = tile.GetWidth();
+        const size_t plane_size = static_cast<size_t>(tile_width)*tile.GetHeight();
+        if (job->sums[tile_index].empty()) {
+            job->sums[tile_index].assign(plane_size*3, 0.0f);
+        }
+        float *sums = job->sums[tile_index].data();
+        {
+            TimelineScope scope("Server tile", "render", "job", static_cast<int64_t>(job->id), "samples", sample_end);
+            const KernelContext context{
+                &job->camera, &job->scene->scene, &job->scene->kernel_scene,
+                render_job.width, render_job.height, render_job.seed, render_job.total_bounces,
+                job->camera.GetPixelSpread(render_job.height), 0, nullptr};
+            for (int y = tile.y_start; y < tile.y_end; y++) {
+                for (int x = tile.x_start; x < tile.x_end; x++) {
+                    const size_t i = (x-tile.x_start) + static_cast<size_t>(y-tile.y_start)*tile_width;
+                    glm::vec3 sum{sums[i], sums[i + plane_size], sums[i + 2*plane_size]};
+                    job->kernel(context, x, y, sample_start, sample_end, sum, nullptr);
+                    sums[i] = sum.r;
+                    sums[i + plane_size] = sum.g;
+                    sums[i + 2*plane_size] = sum.b;
+                }
+            }
+        }
+
+        // divided the same way as the renderer, so a finished job matches its image exactly
+        average.resize(plane_size*3);
+        for (size_t i = 0; i < plane_size*3; i++) {
+            average[i] = sums[i] / static_cast<float>(sample_end);
+        }
+        RenderProgress progress;
+        progress.frame_id = render_job.frame_id;
+        progress.total_samples = sample_end;
+        progress.tile = tile;
+        QueueMessage(*job->client, MessageType::PROGRESS, &progress, sizeof(progress), average.data(), average.size()*sizeof(float));
+
+        {
+            std::lock_guard<std::mutex> lock(m_jobs_mutex);
+            FinishTile(job);
+        }
+        // after the jobs lock is released, along with the job's DONE if that was its last tile
+        FlushClient(*job->client);
+    }
+}
+
+}
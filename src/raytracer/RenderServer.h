@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Network.h"
+#include "RenderProtocol.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Kernels.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace raytracer
+{
+
+// Long running service that renders jobs from any number of clients on the worker threads of a local renderer
+// Scenes are loaded by name the first time a job asks for them, and kept with their kernel scene for later jobs
+// Every thread takes its next tile from the highest priority job that has one left, so a new job with a higher
+// priority takes over the threads as their current tiles finish
+// Jobs are rendered a pass at a time, and every tile is sent back to its client after each pass
+class RenderServer {
+    public:
+        using SceneLoader = std::function<void(Scene &scene)>;
+    public:
+        explicit RenderServer(Renderer &renderer)
+        : m_renderer(renderer) {}
+        ~RenderServer();
+        // scenes have to be added before Run
+        void AddScene(const std::string &name, SceneLoader loader);
+        // serve clients until one of them sends a shutdown
+        bool Run(const std::string &address);
+    public:
+        // at most MAX_TILE_SIZE
+        int m_tile_size{32};
+        // loaded scenes kept after their jobs finish, the least recently used are unloaded past this
+        int m_max_warm_scenes{4};
+        // print a line for every scene loaded and every job finished
+        bool m_is_logging{false};
+        // a client with more than this queued to be sent is disconnected
+        size_t m_max_queued_bytes{size_t{256} << 20};
+        // jobs a client can have queued or rendering at once, more are refused as invalid
+        int m_max_client_jobs{16};
+    private:
+        using clock = std::chrono::steady_clock;
+        struct WarmScene {
+            public:
+                std::string name;
+                Scene scene;
+                KernelScene kernel_scene;
+                uint64_t last_used;
+        };
+        // messages to a client are queued, and sent without blocking by whichever thread flushes it next
+        // so a client that stops reading can't hold up the render threads or the other clients
+        struct Client {
+            public:
+                Socket socket;
+                std::mutex send_mutex;
+                std::deque<std::vector<uint8_t>> outgoing;
+                // bytes of outgoing still to send, and of its front message already sent
+                size_t total_outgoing{0};
+                size_t front_sent{0};
+                // cleared when it hangs up or falls too far behind, it is then removed by Run
+                bool is_connected{true};
+                // bytes received by Run that don't make up a whole message yet, so a slow client never makes it wait
+                std::vector<uint8_t> incoming;
+        };
+        struct Job {
+            public:
+                uint64_t id;
+                std::shared_ptr<Client> client;
+                RenderSubmit submit;
+                Camera camera;
+                std::shared_ptr<WarmScene> scene;
+                TraceKernel kernel;
+                std::vector<Tile> tiles;
+                // sum of the samples of each tile as 3 planes, allocated when the tile is first rendered
+                std::vector<std::vector<float>> sums;
+                // samples [sample_start, sample_end) are being added by the current pass
+                int sample_start, sample_end;
+                int next_tile;
+                int total_tiles_done;
+                bool is_started;
+                bool is_cancelled;
+                clock::time_point submit_time;
+                clock::time_point start_time;
+        };
+    private:
+        void AcceptClient();
+        // read what the client has sent without waiting and act on every whole message, returns false if it has gone
+        bool ReadClient(const std::shared_ptr<Client> &client, bool &is_shutdown);
+        bool HandleMessage(const std::shared_ptr<Client> &client, MessageType type, const std::vector<uint8_t> &payload, bool &is_shutdown);
+        void Submit(const std::shared_ptr<Client> &client, const RenderSubmit &submit, const std::string &scene_name);
+        void Cancel(const Client *client, uint32_t frame_id);
+        std::shared_ptr<WarmScene> GetScene(const std::string &name);
+        void QueueMessage(Client &client, MessageType type, const void *header, size_t header_size, const void *payload=nullptr, size_t size=0);
+        // send what can be sent without blocking, returns true if anything is left
+        bool FlushClient(Client &client);
+        void QueueDone(Client &client, uint32_t frame_id, RenderStatus status, float queued_seconds, float total_seconds);
+        void RemoveClient(const std::shared_ptr<Client> &client);
+        // these are called with m_jobs_mutex held
+        void PushTasks();
+        std::shared_ptr<Job> TakeTile(int &tile_index);
+        void FinishTile(const std::shared_ptr<Job> &job);
+        void RemoveJob(const std::shared_ptr<Job> &job, RenderStatus status);
+        // render tiles until there are none left
+        void RunTasks(int thread_id);
+    private:
+        Renderer &m_renderer;
+        Socket m_listener;
+        std::vector<std::shared_ptr<Client>> m_clients;
+        std::map<std::string, SceneLoader> m_loaders;
+        std::vector<std::shared_ptr<WarmScene>> m_warm_scenes;
+        uint64_t m_total_scene_uses{0};
+
+        std::mutex m_jobs_mutex;
+        std::vector<std::shared_ptr<Job>> m_jobs;
+        uint64_t m_total_jobs{0};
+        // tasks on the renderer's threads that are taking tiles
+        int m_total_tasks{0};
+        std::atomic<bool> m_is_stopping{false};
+};
+
+}
@@ -0,0 +1,105 @@
+#include "RenderWorker.h"
+
+#include <chrono>
+#include <thread>
+#include <map>
+#include <string.h>
+
+namespace raytracer
+{
+
+namespace {
+
+// tiles come from the network, so one that isn't inside the image or is too large is dropped before anything is allocated for it
+bool IsValidTile(const Tile &tile, const RenderJob &job) {
+    return tile.x_start >= 0 && tile.x_start < tile.x_end && tile.x_end <= job.width &&
+           tile.y_start >= 0 && tile.y_start < tile.y_end && tile.y_end <= job.height &&
+           tile.GetWidth() <= MAX_TILE_SIZE && tile.GetHeight() <= MAX_TILE_SIZE;
+}
+
+}
+
+bool RenderWorker::Run(const std::string &address) {
+    // the scene doesn't change while tiles are rendered, so its kernel scene is only built once
+    m_kernel_scene.Build(m_scene);
+
+    // the coordinator might still be starting up
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        m_socket = Socket::Connect(address);
+        if (m_socket.IsValid()) {
+            break;
+        }
+        float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed > m_connect_timeout) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    RenderHello hello;
+    hello.version = PROTOCOL_VERSION;
+    hello.total_threads = static_cast<uint32_t>(m_renderer.GetTotalThreads());
+    if (!SendMessage(m_socket, MessageType::HELLO, &hello, sizeof(hello))) {
+        return false;
+    }
+
+    m_is_stopping = false;
+    std::map<uint32_t, std::shared_ptr<Job>> jobs;
+    bool is_shutdown = false;
+
+    MessageType type;
+    std::vector<uint8_t> payload;
+    while (RecvMessage(m_socket, type, payload)) {
+        if (type == MessageType::SHUTDOWN) {
+            is_shutdown = true;
+            break;
+        }
+
+        if (type == MessageType::JOB && payload.size() == sizeof(RenderJob)) {
+            auto job = std::make_shared<Job>();
+            memcpy(&job->job, payload.data(), sizeof(RenderJob));
+            job->camera = job->job.GetCamera();
+            // tiles are only ever requested for the latest frame and any older ones still hold their job
+            jobs.clear();
+            jobs[job->job.frame_id] = job;
+            continue;
+        }
+
+        if (type == MessageType::TILE && payload.size() == sizeof(RenderTileRequest)) {
+            RenderTileRequest request;
+            memcpy(&request, payload.data(), sizeof(request));
+            auto it = jobs.find(request.frame_id);
+            if (it == jobs.end() || !IsValidTile(request.tile, it->second->job)) {
+                continue;
+            }
+
+            std::shared_ptr<Job> job = it->second;
+            m_total_pending++;
+            m_renderer.Push([this, job, request](int id) {
+                if (!m_is_stopping) {
+                    const Tile &tile = request.tile;
+                    std::vector<float> planes(static_cast<size_t>(tile.GetWidth())*tile.GetHeight()*3);
+                    const RenderJob &render_job = job->job;
+                    m_renderer.RenderTile(
+                        job->camera, m_scene, m_kernel_scene, render_job.width, render_job.height,
+                        render_job.total_samples, render_job.total_bounces, render_job.seed, tile, planes.data());
+
+                    std::unique_lock<std::mutex> lock(m_send_mutex);
+                    SendMessage(m_socket, MessageType::RESULT, &request, sizeof(request), planes.data(), planes.size()*sizeof(float));
+                }
+                m_total_pending--;
+            });
+        }
+    }
+
+    // skip the remaining tiles and wait for the ones being rendered to finish using the socket
+    m_is_stopping = true;
+    while (m_total_pending > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    m_socket.Close();
+    return is_shutdown;
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Network.h"
+#include "RenderProtocol.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Kernels.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+namespace raytracer
+{
+
+// Renders tiles for a RenderCoordinator using the worker threads of a local renderer
+// The scene must be loaded the same way as on every other node
+class RenderWorker {
+    public:
+        RenderWorker(Renderer &renderer, Scene &scene)
+        : m_renderer(renderer), m_scene(scene) {}
+        // connect to the coordinator and render tiles until it shuts down or disconnects
+        bool Run(const std::string &address);
+    public:
+        // seconds to keep retrying the connection while the coordinator starts up
+        float m_connect_timeout{10.0f};
+    private:
+        struct Job {
+            public:
+                RenderJob job;
+                Camera camera;
+        };
+    private:
+        Renderer &m_renderer;
+        Scene &m_scene;
+        // built from the scene when Run starts and shared by every tile
+        KernelScene m_kernel_scene;
+        Socket m_socket;
+        std::mutex m_send_mutex;
+        std::atomic<int> m_total_pending{0};
+        std::atomic<bool> m_is_stopping{false};
+};
+
+}
@@ -1,114 +1,752 @@
 #include "Renderer.h"
+#include "Timeline.h"
 
 #include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cmath>
 #include <assert.h>
 
 namespace raytracer
 {
 
+// pixel order for a tile, cached per thread since neighbouring tiles are usually the same size
+static const std::vector<PixelOffset> &GetTileTraversal(TraversalOrder order, int width, int height) {
+    thread_local std::vector<PixelOffset> offsets;
+    thread_local TraversalOrder cached_order{TraversalOrder::TOTAL_ORDERS};
+    thread_local int cached_width{0}, cached_height{0};
+    if (order != cached_order || width != cached_width || height != cached_height) {
+        GetTraversal(order, width, height, offsets);
+        cached_order = order;
+        cached_width = width;
+        cached_height = height;
+    }
+    return offsets;
+}
+
 Renderer::Renderer(int total_threads) 
 : m_state(Renderer::State::IDLE),
   m_thread_pool(total_threads)
 {
+    m_topology = CpuTopology::Detect();
+    m_thread_nodes.assign(m_thread_pool.size(), 0);
+}
+
+void Renderer::PinThreads(bool is_pinned) {
+    Stop();
+
+    const int total_threads = m_thread_pool.size();
+    const int total_nodes = static_cast<int>(m_topology.nodes.size());
+    m_is_pinned = is_pinned;
+    m_total_nodes = is_pinned ? std::max(1, std::min(total_nodes, total_threads)) : 1;
+
+    std::vector<int> all_cpus;
+    for (const auto &node: m_topology.nodes) {
+        all_cpus.insert(all_cpus.end(), node.cpus.begin(), node.cpus.end());
+    }
+
+    std::vector<int> node_threads(total_nodes, 0);
+    for (int i = 0; i < total_threads; i++) {
+        if (!is_pinned) {
+            m_thread_nodes[i] = 0;
+            PinThread(m_thread_pool.get_thread(i), all_cpus);
+            continue;
+        }
+        // alternate nodes so every node gets a share of the threads
+        const int node = i % m_total_nodes;
+        const auto &cpus = m_topology.nodes[node].cpus;
+        const int cpu = cpus[node_threads[node]++ % cpus.size()];
+        m_thread_nodes[i] = node;
+        PinThread(m_thread_pool.get_thread(i), {cpu});
+    }
+}
+
+void Renderer::Start(const Camera &camera, const Scene &scene, int width, int height) {
+    TimelineScope scope("Start", "render", "width", width, "height", height);
+    Stop();
+    m_views = MultiView::CreateSingle(camera, width, height);
+    Begin(scene, width, height, nullptr);
+}
 
+void Renderer::Start(const MultiView &views, const Scene &scene) {
+    TimelineScope scope("Start", "render", "width", views.GetWidth(), "height", views.GetHeight());
+    Stop();
+    m_views = views;
+    Begin(scene, views.GetWidth(), views.GetHeight(), nullptr);
 }
 
-void Renderer::Start(Camera &camera, Scene &scene, uint8_t *buffer, int width, int height) {
+bool Renderer::Resume(Camera &camera, const Scene &scene, int width, int height, const std::string &filename) {
+    TimelineScope scope("Resume", "render", "width", width, "height", height);
     Stop();
 
+    auto checkpoint = std::make_unique<Checkpoint>();
+    if (!ReadCheckpoint(filename, *checkpoint)) {
+        return false;
+    }
+
+    const RenderJob job = checkpoint->job;
+    if (job.width != width || job.height != height) {
+        return false;
+    }
+    camera = job.GetCamera();
+    m_total_samples = job.total_samples;
+    m_total_bounces = job.total_bounces;
+    m_seed = job.seed;
+    m_views = MultiView::CreateSingle(camera, width, height);
+    Begin(scene, width, height, std::move(checkpoint));
+    return true;
+}
+
+void Renderer::Begin(const Scene &scene, int display_width, int display_height, std::unique_ptr<Checkpoint> checkpoint) {
+    int width = display_width;
+    int height = display_height;
+    m_job_samples = m_total_samples;
+    const bool is_single_view = m_views.GetViews().size() == 1;
+    if (!checkpoint && m_frame_budget > 0.0f && is_single_view) {
+        ChooseResolution(display_width, display_height, width, height, m_job_samples);
+        m_views = MultiView::CreateSingle(m_views.GetViews()[0].camera, width, height);
+    }
+
+    m_scene = &scene;
+    m_width = width;
+    m_height = height;
+    m_display_width = display_width;
+    m_display_height = display_height;
+    m_generation++;
+
+    m_aov_buffer.Resize(width, height, m_aov_mask);
+    m_aov_buffer.Clear();
+    // these are left uninitialised, the worker threads write them first in InitialiseTile
+    m_hdr_buffer.Resize(width, height);
+    m_sum_buffer.Resize(width, height);
+    m_sample_counts.resize(static_cast<size_t>(width)*height);
+    // buffers keep their memory when shrinking, so changing the resolution between frames doesn't reallocate
+    m_framebuffer.Resize(display_width, display_height);
+    if (width != display_width || height != display_height) {
+        m_display_hdr.Resize(display_width, display_height);
+    }
+
+    // pixels can have different counts if the checkpoint was taken when stopping mid pass
+    uint32_t min_samples = 0;
+    if (checkpoint && !checkpoint->sample_counts.empty()) {
+        min_samples = *std::min_element(checkpoint->sample_counts.begin(), checkpoint->sample_counts.end());
+    }
+    const int samples_per_pass = std::max(1, m_samples_per_pass);
+    const int samples_remaining = std::max(0, m_job_samples - static_cast<int>(min_samples));
+    m_total_passes_remaining = (samples_remaining + samples_per_pass - 1) / samples_per_pass;
+    m_resume_checkpoint = std::move(checkpoint);
+
+    // tiles are whole cache lines wide, so side by side tiles can only share the line at their edge in each row
+    // rows aren't padded, so that line is shared whenever the width isn't a multiple of CACHE_LINE_PIXELS
+    const int tile_height = std::max(1, m_tile_size);
+    const int tile_width = (tile_height + CACHE_LINE_PIXELS - 1) / CACHE_LINE_PIXELS * CACHE_LINE_PIXELS;
+
+    const auto &views = m_views.GetViews();
+    const int total_views = static_cast<int>(views.size());
+    std::vector<std::vector<Tile>> view_tiles(total_views);
+    m_view_pixel_offsets.resize(total_views);
+    uint32_t pixel_offset = 0;
+    for (int v = 0; v < total_views; v++) {
+        const View &view = views[v];
+        for (int y = 0; y < view.height; y += tile_height) {
+            for (int x = 0; x < view.width; x += tile_width) {
+                Tile tile;
+                tile.x_start = view.x + x;
+                tile.x_end = view.x + std::min(x+tile_width, view.width);
+                tile.y_start = view.y + y;
+                tile.y_end = view.y + std::min(y+tile_height, view.height);
+                view_tiles[v].push_back(tile);
+            }
+        }
+        m_view_pixel_offsets[v] = pixel_offset;
+        pixel_offset += static_cast<uint32_t>(view.width*view.height);
+    }
+
+    // the same tile of every view is taken one after another, since nearby views see the same part of the scene
+    m_tiles.clear();
+    m_tile_views.clear();
+    for (int i = 0; ; i++) {
+        bool has_tile = false;
+        for (int v = 0; v < total_views; v++) {
+            if (i < static_cast<int>(view_tiles[v].size())) {
+                m_tiles.push_back(view_tiles[v][i]);
+                m_tile_views.push_back(v);
+                has_tile = true;
+            }
+        }
+        if (!has_tile) {
+            break;
+        }
+    }
+    AssignTiles();
+
+    if (m_is_animated && m_kernel_scene.CanRefit(scene)) {
+        m_kernel_scene.Refit();
+    } else {
+        m_kernel_scene.Build(scene, m_is_animated);
+    }
+    m_kernel = m_is_specialised ? SelectKernel(m_kernel_scene, m_total_bounces) : nullptr;
+    m_is_job_guided = m_is_guided;
+    if (m_is_job_guided) {
+        m_guide.Reset(m_kernel_scene.GetFiniteBounds());
+    }
+
+    m_last_checkpoint = std::chrono::steady_clock::now();
+    m_job_start = m_last_checkpoint;
+    m_timeline_job_start = GetTimelineTime();
+    m_total_paths = 0;
+    m_is_initialising = true;
     m_state = State::RUNNING;
+    PushPass();
+}
 
-    int total_threads = m_thread_pool.size();
-    int nb_y_slices = total_threads*2;
-    int nb_x_slices = total_threads*2;
-    int y_slice = height / nb_y_slices;
-    int x_slice = width / nb_x_slices;
+void Renderer::ChooseResolution(int display_width, int display_height, int &width, int &height, int &samples) const {
+    const float min_scale = std::min(std::max(m_min_resolution_scale, 0.01f), 1.0f);
+    float scale = min_scale;
+    samples = 1;
 
-    auto render_func = [this, &camera, &scene, buffer, width, height](int x_start, int x_end, int y_start, int y_end) {
-        RenderToBuffer(camera, scene, buffer, width, height, x_start, x_end, y_start, y_end);
-    };
+    // without a measurement start small, the first frame then measures the throughput
+    if (m_paths_per_second > 0.0f) {
+        const float total_pixels = static_cast<float>(display_width)*display_height;
+        const float total_paths = m_paths_per_second * m_frame_budget;
+        // drop samples before dropping resolution
+        samples = std::min(std::max(static_cast<int>(total_paths / total_pixels), 1), std::max(m_total_samples, 1));
+        scale = std::min(std::max(std::sqrt(total_paths / total_pixels), min_scale), 1.0f);
+    }
 
-    for (int ix = 0; ix < nb_x_slices; ix++) {
-        for (int iy = 0; iy < nb_y_slices; iy++) {
-            int y_start = y_slice*iy;
-            int y_end = (iy < nb_y_slices-1) ? y_slice*(iy+1) : height;
+    // at least 2 pixels so the camera's pixel spacing is defined
+    width = std::max(2, static_cast<int>(std::round(display_width*scale)));
+    height = std::max(2, static_cast<int>(std::round(display_height*scale)));
+}
+
+void Renderer::AssignTiles() {
+    // rows are contiguous in memory, so each node gets a band of rows
+    m_node_tiles.assign(m_total_nodes, {});
+    for (int i = 0; i < static_cast<int>(m_tiles.size()); i++) {
+        const Tile &tile = m_tiles[i];
+        const int y_centre = (tile.y_start + tile.y_end) / 2;
+        const int node = std::min(y_centre*m_total_nodes / std::max(1, m_height), m_total_nodes-1);
+        m_node_tiles[node].push_back(i);
+    }
+    m_node_next = std::vector<std::atomic<int>>(m_total_nodes);
+}
+
+void Renderer::PushPass() {
+    const uint32_t generation = m_generation;
+    for (auto &next: m_node_next) {
+        next = 0;
+    }
+    m_total_tiles_remaining = static_cast<int>(m_tiles.size());
+    m_timeline_pass_start = GetTimelineTime();
+    for (int i = 0; i < static_cast<int>(m_tiles.size()); i++) {
+        m_thread_pool.push([this, generation](int id) {
+            RunTile(generation, id);
+        });
+    }
+}
+
+int Renderer::TakeTile(int thread_id) {
+    // start with the thread's own node, then help the others once it runs out
+    const int node = m_thread_nodes[thread_id];
+    for (int k = 0; k < m_total_nodes; k++) {
+        const int n = (node + k) % m_total_nodes;
+        const int i = m_node_next[n]++;
+        if (i < static_cast<int>(m_node_tiles[n].size())) {
+            return m_node_tiles[n][i];
+        }
+    }
+    return -1;
+}
 
-            int x_start = x_slice*ix;
-            int x_end = (ix < nb_x_slices-1) ? x_slice*(ix+1) : width;
+void Renderer::RunTile(uint32_t generation, int thread_id) {
+    m_total_active++;
+    if (generation == m_generation && m_state == State::RUNNING) {
+        const int index = TakeTile(thread_id);
+        if (index >= 0) {
+            const Tile &tile = m_tiles[index];
+            bool is_finished = true;
+            if (IsTimelineEnabled()) {
+                SetTimelineThreadName("Render thread", thread_id);
+            }
+            {
+                // ends before the pass does, so the pass and frame events recorded on this thread nest around it
+                TimelineScope scope(m_is_initialising ? "Initialise tile" : "Tile", "render", "x", tile.x_start, "y", tile.y_start);
+                if (m_is_initialising) {
+                    InitialiseTile(tile);
+                } else {
+                    is_finished = RenderToBuffer(
+                        m_tile_views[index], tile.x_start, tile.x_end, tile.y_start, tile.y_end);
+                }
+            }
+            // the last tile of a pass starts the next one
+            if (is_finished && --m_total_tiles_remaining == 0) {
+                OnPassFinished();
+            }
+        }
+    }
+    m_total_active--;
+}
 
-            m_thread_pool.push([this, &camera, &scene, buffer, width, height, x_start, x_end, y_start, y_end](int id) {
-                RenderToBuffer(camera, scene, buffer, width, height, x_start, x_end, y_start, y_end);
-            });
+void Renderer::InitialiseTile(const Tile &tile) {
+    const Checkpoint *checkpoint = m_resume_checkpoint.get();
+    for (int y = tile.y_start; y < tile.y_end; y++) {
+        for (int x = tile.x_start; x < tile.x_end; x++) {
+            const size_t i = x + static_cast<size_t>(y)*m_width;
+            const glm::vec3 sum = checkpoint ? checkpoint->sums.Read(x, y) : glm::vec3{0,0,0};
+            const uint32_t count = checkpoint ? checkpoint->sample_counts[i] : 0;
+            m_sum_buffer.Write(x, y, sum);
+            m_sample_counts[i] = count;
+            m_hdr_buffer.Write(x, y, count ? sum / (float)count : glm::vec3{0,0,0});
         }
     }
+    // show the checkpointed image straight away
+    PresentRegion(tile.x_start, tile.x_end, tile.y_start, tile.y_end);
+}
+
+void Renderer::OnPassFinished() {
+    if (IsTimelineEnabled()) {
+        const int64_t now = GetTimelineTime();
+        const int64_t passes = m_is_initialising ? m_total_passes_remaining : m_total_passes_remaining-1;
+        RecordTimelineEvent({
+            m_is_initialising ? "Initialise" : "Pass", "render", m_timeline_pass_start, now - m_timeline_pass_start, 
+            {"passes remaining", nullptr}, {passes, 0}});
+        if (!m_is_initialising && m_total_passes_remaining <= 1) {
+            RecordTimelineEvent({
+                "Frame", "render", m_timeline_job_start, now - m_timeline_job_start, 
+                {"width", "height"}, {m_width, m_height}});
+        }
+    }
+    if (m_is_initialising) {
+        m_is_initialising = false;
+        m_resume_checkpoint.reset();
+        if (m_total_passes_remaining <= 0) {
+            m_state = State::IDLE;
+            return;
+        }
+        PushPass();
+        return;
+    }
+
+    m_total_passes_remaining--;
+    if (m_is_job_guided) {
+        TimelineScope scope("Train path guide", "render", "regions", m_guide.GetTotalRegions());
+        m_guide.OnPassFinished();
+    }
+    const bool has_checkpoint = !m_checkpoint_path.empty();
+
+    if (m_total_passes_remaining <= 0) {
+        UpdateThroughput();
+        m_state = State::IDLE;
+        if (has_checkpoint) {
+            SaveCheckpoint();
+        }
+        return;
+    }
+
+    // no tiles are running between passes, so the state is consistent
+    auto now = std::chrono::steady_clock::now();
+    if (has_checkpoint && std::chrono::duration<float>(now - m_last_checkpoint).count() >= m_checkpoint_interval) {
+        SaveCheckpoint();
+    }
+    PushPass();
+}
+
+void Renderer::UpdateThroughput() {
+    const float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_job_start).count();
+    m_last_frame_time = elapsed;
+    if (elapsed <= 0.0f || m_total_paths == 0) {
+        return;
+    }
+    // average with the previous frames so one slow frame doesn't swing the resolution
+    const float paths_per_second = static_cast<float>(m_total_paths) / elapsed;
+    m_paths_per_second = (m_paths_per_second > 0.0f) ? 0.5f*(m_paths_per_second + paths_per_second) : paths_per_second;
+}
+
+void Renderer::SaveCheckpoint() {
+    // a checkpoint's job holds a single perspective camera
+    const auto &views = m_views.GetViews();
+    if (views.size() != 1 || views[0].camera.m_projection != Camera::PERSPECTIVE) {
+        return;
+    }
+    TimelineScope scope("Copy checkpoint", "io");
+    m_last_checkpoint = std::chrono::steady_clock::now();
+
+    // copy the state so the next pass can start while it is written to disk
+    auto checkpoint = std::make_shared<Checkpoint>();
+    checkpoint->job = RenderJob::Create(0, views[0].camera, m_width, m_height, m_job_samples, m_total_bounces, m_seed);
+    checkpoint->sums = m_sum_buffer;
+    checkpoint->sample_counts.assign(m_sample_counts.begin(), m_sample_counts.end());
+
+    const std::string filename = m_checkpoint_path;
+    m_checkpoint_writer.Submit([checkpoint, filename]() {
+        TimelineScope scope("Write checkpoint", "io");
+        WriteCheckpoint(filename, *checkpoint);
+    });
+}
+
+void Renderer::PresentRegion(int x_start, int x_end, int y_start, int y_end) {
+    if (m_width == m_display_width && m_height == m_display_height) {
+        m_tonemapper.Apply(m_hdr_buffer, m_framebuffer.GetBackBuffer(), x_start, x_end, y_start, y_end);
+        m_framebuffer.MarkDirty(x_start, x_end, y_start, y_end);
+        return;
+    }
+
+    // the display pixels covered by the region, widened by a pixel since filtering reads across its edges
+    const float x_scale = (float)m_display_width / (float)m_width;
+    const float y_scale = (float)m_display_height / (float)m_height;
+    const int dx_start = std::max(0, static_cast<int>(std::floor((x_start-1)*x_scale)));
+    const int dx_end = std::min(m_display_width, static_cast<int>(std::ceil((x_end+1)*x_scale)));
+    const int dy_start = std::max(0, static_cast<int>(std::floor((y_start-1)*y_scale)));
+    const int dy_end = std::min(m_display_height, static_cast<int>(std::ceil((y_end+1)*y_scale)));
+
+    ResampleBilinear(m_hdr_buffer, m_display_hdr, dx_start, dx_end, dy_start, dy_end);
+    m_tonemapper.Apply(m_display_hdr, m_framebuffer.GetBackBuffer(), dx_start, dx_end, dy_start, dy_end);
+    m_framebuffer.MarkDirty(dx_start, dx_end, dy_start, dy_end);
+}
+
+void Renderer::Tonemap() {
+    const int width = m_hdr_buffer.GetWidth();
+    const int height = m_hdr_buffer.GetHeight();
+    const int total_bands = m_thread_pool.size()*4;
+    const int band_height = (height + total_bands - 1) / total_bands;
+    const uint32_t generation = m_generation;
+
+    for (int y_start = 0; y_start < height; y_start += band_height) {
+        const int y_end = std::min(y_start+band_height, height);
+        m_thread_pool.push([this, generation, width, y_start, y_end](int id) {
+            // counted as active before checking the generation, so either Stop waits for the band
+            // or the band sees that Stop has been called and leaves the buffers alone
+            m_total_active++;
+            if (generation == m_generation) {
+                PresentRegion(0, width, y_start, y_end);
+            }
+            m_total_active--;
+        });
+    }
 }
 
 void Renderer::Stop() {
+    const bool was_running = m_state == State::RUNNING;
     m_state = State::IDLE;
+    // tasks already taken from the queue skip their work once they see this
+    m_generation++;
     m_thread_pool.clear_queue();
+
+    // tiles check the state every pixel so this doesn't take long
+    while (m_total_active > 0) {
+        std::this_thread::yield();
+    }
+
+    // finish initialising here so the buffers are never left uninitialised
+    if (m_is_initialising) {
+        for (const Tile &tile: m_tiles) {
+            InitialiseTile(tile);
+        }
+        m_is_initialising = false;
+        m_resume_checkpoint.reset();
+        return;
+    }
+
+    // per-pixel sample counts keep a checkpoint taken mid pass consistent
+    if (was_running && !m_checkpoint_path.empty()) {
+        SaveCheckpoint();
+    }
+}
+
+bool Renderer::RenderToBuffer(int view_index, int x_start, int x_end, int y_start, int y_end) {
+    // kernels are given pixels in the coordinates of the view's camera
+    const View &view = m_views.GetViews()[view_index];
+    const KernelContext context{
+        &view.camera, m_scene, &m_kernel_scene, view.width, view.height, m_seed, m_total_bounces, 
+        view.camera.GetPixelSpread(view.height), m_view_pixel_offsets[view_index], 
+        m_is_job_guided ? &m_guide : nullptr};
+    if (m_mode == Mode::WAVEFRONT) {
+        return RenderToBufferWavefront(context, view, x_start, x_end, y_start, y_end);
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    const bool has_aov = m_aov_buffer.GetMask() != 0;
+    const bool has_time_aov = m_aov_buffer.IsEnabled(AOVBuffer::TIME);
+    const bool has_surface_aov = (m_aov_buffer.GetMask() & ~(
+        AOVBuffer::Flag(AOVBuffer::SAMPLE_COUNT) | AOVBuffer::Flag(AOVBuffer::TIME))) != 0;
+
+    const int samples_per_pass = std::max(1, m_samples_per_pass);
+    uint64_t total_paths = 0;
+    const auto &traversal = GetTileTraversal(m_traversal, x_end-x_start, y_end-y_start);
+
+    for (const PixelOffset &offset: traversal) {
+        const int x = x_start + offset.x;
+        const int y = y_start + offset.y;
+        if (m_state != State::RUNNING) {
+            // show whatever was finished before aborting
+            m_total_paths += total_paths;
+            PresentRegion(x_start, x_end, y_start, y_end);
+            return false;
+        }
+
+        // continue from where this pixel left off, which may differ between pixels after resuming
+        const size_t i = x + static_cast<size_t>(y)*m_width;
+        const int sample_start = static_cast<int>(m_sample_counts[i]);
+        const int sample_end = std::min(sample_start + samples_per_pass, m_job_samples);
+        if (sample_start >= sample_end) {
+            continue;
+        }
+
+        auto pixel_start = has_time_aov ? clock::now() : clock::time_point{};
+        glm::vec3 sum = m_sum_buffer.Read(x, y);
+        // the first hit of the first sample provides the surface outputs
+        Scene::SurfaceInfo info;
+        const bool write_surface_aov = has_surface_aov && sample_start == 0;
+        if (m_kernel) {
+            m_kernel(context, x-view.x, y-view.y, sample_start, sample_end, sum, write_surface_aov ? &info : nullptr);
+        } else {
+            TracePixel(context, x-view.x, y-view.y, sample_start, sample_end, sum, write_surface_aov ? &info : nullptr);
+        }
+        if (write_surface_aov) {
+            WriteSurfaceAOV((info.entity_id >= 0) ? &info : nullptr, x, y);
+        }
+        total_paths += sample_end - sample_start;
+        m_sum_buffer.Write(x, y, sum);
+        m_sample_counts[i] = static_cast<uint32_t>(sample_end);
+
+        // store linear color, it is tonemapped into the framebuffer once the tile is done
+        m_hdr_buffer.Write(x, y, sum / (float)sample_end);
+
+        if (has_aov) {
+            if (m_aov_buffer.IsEnabled(AOVBuffer::SAMPLE_COUNT)) {
+                m_aov_buffer.Write(AOVBuffer::SAMPLE_COUNT, x, y, static_cast<float>(sample_end));
+            }
+            if (has_time_aov) {
+                auto pixel_end = clock::now();
+                float ms = std::chrono::duration<float, std::milli>(pixel_end-pixel_start).count();
+                m_aov_buffer.Accumulate(AOVBuffer::TIME, x, y, ms);
+            }
+        }
+    }
+
+    m_total_paths += total_paths;
+    PresentRegion(x_start, x_end, y_start, y_end);
+    return true;
 }
 
-void Renderer::RenderToBuffer(
-    Camera &camera, Scene &scene, 
-    uint8_t *buffer, int width, int height, 
+bool Renderer::RenderToBufferWavefront(
+    const KernelContext &context, const View &view, 
     int x_start, int x_end, int y_start, int y_end)
 {
-    for (int x = x_start; x < x_end; x++) {
-        for (int y = y_start; y < y_end; y++) {
-            if (m_state != State::RUNNING) {
-                return;
+    using clock = std::chrono::high_resolution_clock;
+    const bool has_time_aov = m_aov_buffer.IsEnabled(AOVBuffer::TIME);
+    const bool has_surface_aov = (m_aov_buffer.GetMask() & ~(
+        AOVBuffer::Flag(AOVBuffer::SAMPLE_COUNT) | AOVBuffer::Flag(AOVBuffer::TIME))) != 0;
+    const int samples_per_pass = std::max(1, m_samples_per_pass);
+    const int batch_size = std::max(1, m_wavefront_batch_size);
+
+    // scratch space is kept between tiles to avoid reallocating it
+    thread_local WavefrontTracer tracer;
+    thread_local std::vector<WavefrontTracer::PathRequest> requests;
+    thread_local std::vector<glm::vec3> results;
+    thread_local std::vector<Scene::SurfaceInfo> first_hits;
+
+    auto tile_start = has_time_aov ? clock::now() : clock::time_point{};
+    const auto &traversal = GetTileTraversal(m_traversal, x_end-x_start, y_end-y_start);
+    const int tile_pixels = static_cast<int>(traversal.size());
+    int total_pixels = 0;
+    int next_pixel = 0;
+
+    // a batch holds whole pixels so that each pixel is finished in one batch
+    while (next_pixel < tile_pixels) {
+        if (m_state != State::RUNNING) {
+            PresentRegion(x_start, x_end, y_start, y_end);
+            return false;
+        }
+
+        requests.clear();
+        for (; next_pixel < tile_pixels; next_pixel++) {
+            const int x = x_start + traversal[next_pixel].x;
+            const int y = y_start + traversal[next_pixel].y;
+            const size_t i = x + static_cast<size_t>(y)*m_width;
+            const int sample_start = static_cast<int>(m_sample_counts[i]);
+            const int sample_end = std::min(sample_start + samples_per_pass, m_job_samples);
+            if (!requests.empty() && static_cast<int>(requests.size()) + sample_end - sample_start > batch_size) {
+                break;
+            }
+            // requested in the coordinates of the view's camera
+            for (int j = sample_start; j < sample_end; j++) {
+                requests.push_back({x-view.x, y-view.y, static_cast<uint32_t>(j)});
+            }
+        }
+
+        tracer.Trace(context, requests, results, has_surface_aov ? &first_hits : nullptr);
+        m_total_paths += requests.size();
+
+        // requests are grouped by pixel in sample order, so the sums match the megakernel
+        for (size_t k = 0; k < requests.size(); k++) {
+            const WavefrontTracer::PathRequest &request = requests[k];
+            const int x = request.x + view.x;
+            const int y = request.y + view.y;
+            const size_t i = x + static_cast<size_t>(y)*m_width;
+            if (request.sample == 0 && has_surface_aov) {
+                const Scene::SurfaceInfo &info = first_hits[k];
+                WriteSurfaceAOV((info.entity_id >= 0) ? &info : nullptr, x, y);
             }
 
+            glm::vec3 sum = m_sum_buffer.Read(x, y) + results[k];
+            const uint32_t total_samples = request.sample + 1;
+            m_sum_buffer.Write(x, y, sum);
+            m_sample_counts[i] = total_samples;
+            m_hdr_buffer.Write(x, y, sum / (float)total_samples);
+
+            const bool is_last_sample = (k+1 == requests.size()) || requests[k+1].x != request.x || requests[k+1].y != request.y;
+            if (is_last_sample) {
+                total_pixels++;
+                if (m_aov_buffer.IsEnabled(AOVBuffer::SAMPLE_COUNT)) {
+                    m_aov_buffer.Write(AOVBuffer::SAMPLE_COUNT, x, y, static_cast<float>(total_samples));
+                }
+            }
+        }
+    }
+
+    // paths from many pixels are traced together, so the time is spread evenly over the tile
+    if (has_time_aov && total_pixels > 0) {
+        float ms = std::chrono::duration<float, std::milli>(clock::now()-tile_start).count() / total_pixels;
+        for (int py = y_start; py < y_end; py++) {
+            for (int px = x_start; px < x_end; px++) {
+                m_aov_buffer.Accumulate(AOVBuffer::TIME, px, py, ms);
+            }
+        }
+    }
+
+    PresentRegion(x_start, x_end, y_start, y_end);
+    return true;
+}
+
+void Renderer::RenderTile(
+    const Camera &camera, const Scene &scene, const KernelScene &kernel_scene, int width, int height, 
+    int total_samples, int total_bounces, uint32_t seed, const Tile &tile, float *output)
+{
+    const int tile_width = tile.GetWidth();
+    const size_t plane_size = static_cast<size_t>(tile_width)*tile.GetHeight();
+
+    TraceKernel kernel = m_is_specialised ? SelectKernel(kernel_scene, total_bounces) : nullptr;
+    const KernelContext context{&camera, &scene, &kernel_scene, width, height, seed, total_bounces, camera.GetPixelSpread(height), 0, nullptr};
+
+    for (int y = tile.y_start; y < tile.y_end; y++) {
+        for (int x = tile.x_start; x < tile.x_end; x++) {
             glm::vec3 color{0,0,0};
+            if (kernel) {
+                kernel(context, x, y, 0, total_samples, color, nullptr);
+            } else {
+                TracePixel(context, x, y, 0, total_samples, color, nullptr);
+            }
+            color /= (float)total_samples;
+            size_t i = (x-tile.x_start) + static_cast<size_t>(y-tile.y_start)*tile_width;
+            output[i] = color.r;
+            output[i + plane_size] = color.g;
+            output[i + 2*plane_size] = color.b;
+        }
+    }
+}
+
+void Renderer::TracePixel(
+    const KernelContext &context, int x, int y, 
+    int sample_start, int sample_end, glm::vec3 &sum, Scene::SurfaceInfo *info) const
+{
+    const uint32_t pixel = context.pixel_offset + static_cast<uint32_t>(x + y*context.width);
+    const Scene &scene = *context.scene;
+    const EnvironmentMap *environment = scene.m_environment.IsEmpty() ? nullptr : &scene.m_environment;
+
+    // get N samples
+    for (int j = sample_start; j < sample_end; j++) {
+        Sampler sampler(context.seed, pixel, static_cast<uint32_t>(j));
 
-            // get N samples
-            for (int j = 0; j < m_total_samples; j++) {
-                float s = (float)x / (float)(width-1);
-                float t = 1.0f - (float)y / (float)(height-1);
-
-                Ray ray = camera.GetRay(s, t);
-                ray.color = glm::vec3{1, 1, 1};
-
-                for (int i = 0; i <= m_total_bounces; i++) {
-                    // out of bounces
-                    if (i == m_total_bounces) {
-                        ray.color *= glm::vec3{0,0,0};
-                        break;
-                    }
-
-                    // if didn't hit anything in the scene
-                    Scene::CastResult r = scene.CastRay(ray);
-                    if (!r.no_bounce) {
-                        break;
-                    }
-
-                    if (!r.hit_object) {
-                        float t = 0.5f * (ray.direction.y + 1.0f);
-                        glm::vec3 sky_color = (1.0f - t) * glm::vec3{1.0, 1.0, 1.0} + t * glm::vec3{0.5, 0.7, 1.0};
-                        ray.color *= sky_color;
-                        break;
-                    }
+        float s = (float)x / (float)(context.width-1);
+        float t = 1.0f - (float)y / (float)(context.height-1);
+
+        Ray ray = context.camera->GetRay(s, t);
+        ray.color = glm::vec3{1, 1, 1};
+        ray.cone_spread = context.pixel_spread;
+        // light sampled directly from the environment, and the density of the last bounce to weigh escapes against it
+        glm::vec3 direct{0,0,0};
+        float bounce_pdf = 0.0f;
+
+        for (int i = 0; i <= context.total_bounces; i++) {
+            // out of bounces
+            if (i == context.total_bounces) {
+                ray.color *= glm::vec3{0,0,0};
+                break;
+            }
+
+            // if didn't hit anything in the scene the ray is lit by the environment, or keeps its colour without one
+            Scene::Hit hit;
+            if (!scene.Intersect(ray, hit)) {
+                if (info && i == 0 && j == 0) {
+                    info->entity_id = -1;
+                }
+                if (environment) {
+                    ray.color *= environment->EvaluateEscape(ray.direction, bounce_pdf);
                 }
-                
-                color += ray.color;
+                break;
             }
 
-            color /= m_total_samples;
+            // first hit of the first sample provides the surface outputs
+            Collision collision = hit.shape->GetCollision(ray, hit.t);
+            if (info && i == 0 && j == 0) {
+                *info = scene.GetSurfaceInfo(hit, collision);
+            }
 
-            // store color inside our buffer
-            int i = (x + y*width) * 4;
-            color = glm::sqrt(color);
-            color = glm::clamp(color, 0.0f, 1.0f);
-            buffer[i+0] = static_cast<uint8_t>(255 * color.r);
-            buffer[i+1] = static_cast<uint8_t>(255 * color.g);
-            buffer[i+2] = static_cast<uint8_t>(255 * color.b);
-            buffer[i+3] = 255;
+            // diffuse surfaces sample the environment directly, except at the last bounce
+            const bool is_diffuse = hit.material->GetType() == MaterialType::LAMBERTIAN;
+            if (environment && is_diffuse && i+1 < context.total_bounces) {
+                const Lambertian &material = *static_cast<Lambertian*>(hit.material);
+                direct += environment->SampleDirect(material, ray, collision, sampler,
+                    [&](const glm::vec3 &direction) { return material.GetPdf(collision, direction); },
+                    [&](const Ray &shadow) {
+                        Scene::Hit shadow_hit;
+                        return scene.Intersect(shadow, shadow_hit);
+                    });
+            }
+
+            if (!hit.material->CastRay(ray, collision, sampler)) {
+                break;
+            }
+            if (environment) {
+                bounce_pdf = is_diffuse ? static_cast<Lambertian*>(hit.material)->GetPdf(collision, ray.direction) : 0.0f;
+            }
         }
+
+        if (environment) {
+            ray.color += direct;
+        }
+        // accumulate in sample order so continuing a partial sum gives the same result
+        sum += ray.color;
     }
+}
 
-    // if about to become last task to finish, trigger flag
-    if (m_thread_pool.n_idle() == m_thread_pool.size()-1) {
-        m_state = State::IDLE;
+void Renderer::WriteSurfaceAOV(const Scene::SurfaceInfo *info, int x, int y) {
+    AOVBuffer &aov = m_aov_buffer;
+    // rays that escape the scene get an infinite depth and invalid ids
+    const float depth = info ? info->t : std::numeric_limits<float>::infinity();
+    const glm::vec3 normal = info ? info->normal : glm::vec3{0,0,0};
+    const glm::vec3 albedo = info ? info->albedo : glm::vec3{0,0,0};
+
+    if (aov.IsEnabled(AOVBuffer::DEPTH)) {
+        aov.Write(AOVBuffer::DEPTH, x, y, depth);
+    }
+    if (aov.IsEnabled(AOVBuffer::NORMAL)) {
+        for (int c = 0; c < 3; c++) {
+            aov.Write(AOVBuffer::NORMAL, x, y, normal[c], c);
+        }
+    }
+    if (aov.IsEnabled(AOVBuffer::ALBEDO)) {
+        for (int c = 0; c < 3; c++) {
+            aov.Write(AOVBuffer::ALBEDO, x, y, albedo[c], c);
+        }
+    }
+    if (aov.IsEnabled(AOVBuffer::ENTITY_ID)) {
+        aov.Write(AOVBuffer::ENTITY_ID, x, y, info ? static_cast<float>(info->entity_id) : -1.0f);
+    }
+    if (aov.IsEnabled(AOVBuffer::MATERIAL_ID)) {
+        aov.Write(AOVBuffer::MATERIAL_ID, x, y, info ? static_cast<float>(info->material_id) : -1.0f);
     }
 }
 
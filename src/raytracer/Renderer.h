@@ -1,31 +1,199 @@
 #pragma once
 
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <memory>
 #include "Camera.h"
 #include "Scene.h"
+#include "Tile.h"
+#include "AOVBuffer.h"
+#include "HDRBuffer.h"
+#include "Tonemapper.h"
+#include "AsyncWriter.h"
+#include "Checkpoint.h"
+#include "Wavefront.h"
+#include "Topology.h"
+#include "Allocator.h"
+#include "Framebuffer.h"
+#include "Traversal.h"
+#include "Kernels.h"
+#include "MultiView.h"
+#include "PathGuide.h"
 #include "cptl_stl.h"
 
 namespace raytracer
 {
 
+// Renders progressively in passes of m_samples_per_pass samples
+// Each pixel keeps a running sum and sample count, which can be checkpointed and resumed
 class Renderer {
     public:
         enum State { RUNNING, IDLE };
+        // megakernel traces each path to the end, wavefront traces a tile's paths a bounce at a time
+        enum Mode { MEGAKERNEL, WAVEFRONT };
     public:
         Renderer(int total_threads=std::thread::hardware_concurrency());
-        void Start(Camera &camera, Scene &scene, uint8_t *buffer, int width, int height); 
+        // width and height are the display size, the render itself may be smaller if m_frame_budget is set
+        void Start(const Camera &camera, const Scene &scene, int width, int height); 
+        // render every view into its region of one image, always at full size and without checkpoints
+        void Start(const MultiView &views, const Scene &scene);
+        // continue a render from a checkpoint, the camera and settings are restored from it
+        // fails if the checkpoint is missing or its size doesn't match, it always renders at full size
+        bool Resume(Camera &camera, const Scene &scene, int width, int height, const std::string &filename);
+        // blocks until the worker threads have left the current tiles
         void Stop();
         State GetState() { return m_state; }
+        // outputs selected by m_aov_mask, sized to the last call to Start
+        const AOVBuffer &GetAOVBuffer() const { return m_aov_buffer; }
+        // linear colour of the last render, before tonemapping
+        const HDRBuffer &GetHDRBuffer() const { return m_hdr_buffer; }
+        // tonemapped output at the display size of the last call to Start
+        Framebuffer &GetFramebuffer() { return m_framebuffer; }
+        // reapply m_tonemapper to the last render in parallel, without re-rendering
+        void Tonemap();
+        // pin each worker thread to a CPU, spreading the threads evenly over the NUMA nodes
+        // tiles are then split into row bands per node, and each band is first written by its own node
+        // stops the current render
+        void PinThreads(bool is_pinned);
+        bool IsPinned() const { return m_is_pinned; }
+        const CpuTopology &GetTopology() const { return m_topology; }
+        // size and samples per pixel of the current render, which differ from the display in time budgeted mode
+        int GetRenderWidth() const { return m_width; }
+        int GetRenderHeight() const { return m_height; }
+        int GetRenderSamples() const { return m_job_samples; }
+        // measured over the renders that ran to completion
+        float GetPathsPerSecond() const { return m_paths_per_second; }
+        float GetLastFrameTime() const { return m_last_frame_time; }
     public:
-        void RenderToBuffer(
-            Camera &camera, Scene &scene, 
-            uint8_t *buffer, int width, int height, 
-            int x_start, int x_end, int y_start, int y_end);
+        // take the next pass of samples for a region of one of the current job's views, returns false if the render was stopped
+        // the region is in the coordinates of the whole image
+        bool RenderToBuffer(int view_index, int x_start, int x_end, int y_start, int y_end);
+        // render a tile synchronously on the calling thread, with a kernel scene built from the scene beforehand
+        // so that every tile of the scene can share it
+        // the samples, bounces and seed are the tile's own rather than the renderer's, so tiles of different jobs can be in flight at once
+        // output holds the linear colour as 3 planes of tile width*height
+        void RenderTile(
+            const Camera &camera, const Scene &scene, const KernelScene &kernel_scene, int width, int height, 
+            int total_samples, int total_bounces, uint32_t seed, const Tile &tile, float *output);
+        // queue a job onto the renderer's worker threads
+        template <typename F>
+        void Push(F &&func) { m_thread_pool.push(std::forward<F>(func)); }
+        int GetTotalThreads() { return m_thread_pool.size(); }
 
         int m_total_bounces{4};
         int m_total_samples{1};
+        int m_samples_per_pass{1};
+        // every sample is a pure function of the seed, pixel and sample index
+        uint32_t m_seed{0};
+        // combination of AOVBuffer::Flag(...) to write alongside the colour
+        uint32_t m_aov_mask{0};
+        Tonemapper m_tonemapper;
+        Mode m_mode{MEGAKERNEL};
+        // use kernels specialised for the scene and bounce count, picked at Start, instead of TracePixel
+        bool m_is_specialised{true};
+        // order of the pixels within a tile
+        TraversalOrder m_traversal{TraversalOrder::ROW_MAJOR};
+        // tiles are square, with the width rounded up to whole cache lines
+        int m_tile_size{32};
+        // maximum paths in flight per thread in wavefront mode
+        int m_wavefront_batch_size{1 << 16};
+        // checkpoints are written between passes when this is set, and when the render is stopped
+        std::string m_checkpoint_path;
+        // seconds between checkpoints
+        float m_checkpoint_interval{300.0f};
+        // seconds a render should take, 0 disables it
+        // when set, Start picks the resolution and samples per pixel from the measured paths per second
+        // and the result is upscaled to the display size
+        float m_frame_budget{0.0f};
+        // smallest fraction of the display size used with a frame budget
+        float m_min_resolution_scale{0.25f};
+        // learn where the light comes from over the passes of a render, and send diffuse bounces towards it
+        // only used by the specialised megakernels, and it learns between passes so it needs several of them
+        bool m_is_guided{false};
+        // shapes move between renders, such as in an animation
+        // Start then refits the previous render's kernel scene while the scene has the same entities, instead of building it again
+        bool m_is_animated{false};
+    private:
+        // m_views is set before this, and replaced if a frame budget shrinks a single view
+        void Begin(const Scene &scene, int width, int height, std::unique_ptr<Checkpoint> checkpoint);
+        void ChooseResolution(int display_width, int display_height, int &width, int &height, int &samples) const;
+        void AssignTiles();
+        void PushPass();
+        void RunTile(uint32_t generation, int thread_id);
+        // next tile of the pass for a thread, preferring tiles on the thread's own node
+        int TakeTile(int thread_id);
+        // clear a tile or restore it from the checkpoint, so its pages are placed on the node that renders it
+        void InitialiseTile(const Tile &tile);
+        void OnPassFinished();
+        void UpdateThroughput();
+        void SaveCheckpoint();
+        // add the samples [sample_start, sample_end) of a pixel onto sum
+        // generic version of the kernels in Kernels.h, with the same arguments
+        void TracePixel(
+            const KernelContext &context, int x, int y, 
+            int sample_start, int sample_end, glm::vec3 &sum, Scene::SurfaceInfo *info) const;
+        // RenderToBuffer in wavefront mode
+        bool RenderToBufferWavefront(
+            const KernelContext &context, const View &view, 
+            int x_start, int x_end, int y_start, int y_end);
+        // tonemap a region into the framebuffer and mark it as changed
+        void PresentRegion(int x_start, int x_end, int y_start, int y_end);
+        void WriteSurfaceAOV(const Scene::SurfaceInfo *info, int x, int y);
     private:
-        State m_state;
+        std::atomic<State> m_state;
+        AOVBuffer m_aov_buffer;
+        HDRBuffer m_hdr_buffer;
+        Framebuffer m_framebuffer;
+        // accumulation state
+        HDRBuffer m_sum_buffer;
+        std::vector<uint32_t, DefaultInitAllocator<uint32_t>> m_sample_counts;
+        // current job
+        MultiView m_views;
+        // added to the pixel indices of each view, so no two pixels of the image draw the same samples
+        std::vector<uint32_t> m_view_pixel_offsets;
+        const Scene *m_scene{nullptr};
+        int m_width{0}, m_height{0};
+        int m_display_width{0}, m_display_height{0};
+        int m_job_samples{0};
+        // render upscaled to the display size, when they differ
+        HDRBuffer m_display_hdr;
+        // throughput
+        std::chrono::steady_clock::time_point m_job_start;
+        // timeline times of the start of the job and of the current pass
+        int64_t m_timeline_job_start{0};
+        int64_t m_timeline_pass_start{0};
+        std::atomic<uint64_t> m_total_paths{0};
+        float m_paths_per_second{0.0f};
+        float m_last_frame_time{0.0f};
+        std::vector<Tile> m_tiles;
+        // view that each tile belongs to
+        std::vector<int> m_tile_views;
+        KernelScene m_kernel_scene;
+        TraceKernel m_kernel{nullptr};
+        PathGuide m_guide;
+        // m_is_guided when the job started
+        bool m_is_job_guided{false};
+        // the first pass of a job initialises the tiles instead of rendering them
+        bool m_is_initialising{false};
+        std::unique_ptr<Checkpoint> m_resume_checkpoint;
+        // thread placement
+        CpuTopology m_topology;
+        bool m_is_pinned{false};
+        int m_total_nodes{1};
+        std::vector<int> m_thread_nodes;
+        // tiles of each node, and the next one to take in the current pass
+        std::vector<std::vector<int>> m_node_tiles;
+        std::vector<std::atomic<int>> m_node_next;
+        // bumped by Stop and Begin, tasks pushed before either are ignored if they run after it
+        std::atomic<uint32_t> m_generation{0};
+        std::atomic<int> m_total_tiles_remaining{0};
+        std::atomic<int> m_total_active{0};
+        int m_total_passes_remaining{0};
+        std::chrono::steady_clock::time_point m_last_checkpoint;
+        AsyncWriter m_checkpoint_writer;
+        // destroyed first so no task outlives the state above
         ctpl::thread_pool m_thread_pool;
 };
 
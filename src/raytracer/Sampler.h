@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+#include <stdint.h>
+#include <cmath>
+#include <algorithm>
+
+namespace raytracer
+{
+
+// Random numbers that are a pure function of (seed, pixel, sample, dimension)
+// Every random decision made while tracing a sample takes the next dimension,
+// so any pixel or sample can be reproduced without replaying the ones before it
+class Sampler {
+    public:
+        // a path can be continued later by starting again from the dimension it reached
+        Sampler(uint32_t seed, uint32_t pixel, uint32_t sample, uint32_t dimension=0)
+        : m_key(Mix((static_cast<uint64_t>(seed) << 32) | pixel) ^ (static_cast<uint64_t>(sample) << 32)),
+          m_dimension(dimension)
+        {}
+
+        // uniform in [0,1)
+        inline float Next1D() {
+            uint64_t bits = Mix(m_key + m_dimension++);
+            // top 24 bits fill the float mantissa exactly
+            return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+        }
+
+        inline glm::vec2 Next2D() {
+            float u = Next1D();
+            float v = Next1D();
+            return glm::vec2{u, v};
+        }
+
+        // uniformly distributed direction, replaces glm::sphericalRand(1.0f)
+        inline glm::vec3 UnitSphere() {
+            glm::vec2 u = Next2D();
+            float z = 1.0f - 2.0f*u.x;
+            float r = std::sqrt(std::max(0.0f, 1.0f - z*z));
+            float phi = 6.28318530718f * u.y;
+            return glm::vec3{r*std::cos(phi), r*std::sin(phi), z};
+        }
+
+        inline uint32_t GetDimension() const { return m_dimension; }
+    private:
+        // splitmix64 finaliser
+        static inline uint64_t Mix(uint64_t x) {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+    private:
+        uint64_t m_key;
+        uint32_t m_dimension;
+};
+
+}
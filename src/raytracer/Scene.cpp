@@ -5,48 +5,109 @@ namespace raytracer {
 
 Scene::Scene()
 :   m_dielectric(), m_lambertian(), m_metal(),
-    m_spheres(),
-    m_entities(), m_intersection_entities(), m_difference_entities()
+    m_spheres(), m_planes(), m_boxes(), m_oriented_boxes(), m_cylinders(), m_cones(), m_discs(),
+    m_entities(), m_union_entities(), m_intersection_entities(), m_difference_entities()
 {}
 
-Scene::CastResult Scene::CastRay(Ray &ray) {
+Scene::CastResult Scene::CastRay(Ray &ray, Sampler &sampler, SurfaceInfo *info) const {
+    Hit hit;
+    // if no object was found
+    if (!Intersect(ray, hit)) {
+       return {false, false}; 
+    }
+    return Scatter(ray, hit, sampler, info);
+}
+
+bool Scene::Intersect(const Ray &ray, Hit &hit) const {
     float t_min = 0.001f;
-    float t_closest = std::numeric_limits<float>::infinity();
+    // finite, so the infinite ends of unbounded shapes are never taken as hits
+    float t_closest = std::numeric_limits<float>::max();
 
     IShape *shape = nullptr;
     IMaterial *material = nullptr;
+    int entity_id = -1;
 
-    for (auto entity: m_entities) {
+    for (int i = 0; i < (int)m_entities.size(); i++) {
+        IEntity *entity = m_entities[i];
         RayCast cast;
         // if missed the entity
-        if (!entity->CastRay(ray, cast)) {
+        if (!entity->CastRay(ray, t_min, t_closest, cast)) {
             continue;
         }
 
-        // check to see if interval is closer
-        float t = cast.t0;
-        if (t < t_min || t > t_closest) {
-            t = cast.t1;
-            if (t < t_min || t > t_closest) {
-               continue; 
-            } 
+        // check to see if its nearest surface is closer
+        RaySurface surface;
+        if (!cast.GetFirstSurface(t_min, surface) || surface.t > t_closest) {
+            continue;
         }
 
         // if it is closer, then use it
-        t_closest = t; 
-        shape = cast.shape;
-        material = cast.material;
+        t_closest = surface.t; 
+        shape = surface.shape;
+        material = surface.material;
+        entity_id = i;
     }
 
-    // if no object was found
-    if (!shape) {
-       return {false, false}; 
-    }
-    
+    hit.t = t_closest;
+    hit.shape = shape;
+    hit.material = material;
+    hit.entity_id = entity_id;
+    return shape != nullptr;
+}
+
+Scene::CastResult Scene::Scatter(Ray &ray, const Hit &hit, Sampler &sampler, SurfaceInfo *info) const {
     // find the collision against the closest entity hit by ray
-    Collision collision = shape->GetCollision(ray, t_closest); 
-    bool has_scatter = material->CastRay(ray, collision);
+    Collision collision = hit.shape->GetCollision(ray, hit.t); 
+    if (info) {
+        *info = GetSurfaceInfo(hit, collision);
+    }
+    bool has_scatter = hit.material->CastRay(ray, collision, sampler);
     return {true, has_scatter};
 }
 
+Scene::SurfaceInfo Scene::GetSurfaceInfo(const Hit &hit, const Collision &collision) const {
+    SurfaceInfo info;
+    info.t = hit.t;
+    info.normal = collision.normal;
+    info.albedo = hit.material->GetAlbedo(collision);
+    info.entity_id = hit.entity_id;
+    info.material_id = GetMaterialID(hit.material);
+    return info;
+}
+
+int Scene::GetMaterialID(const IMaterial *material) const {
+    int offset = 0;
+    // materials live inside contiguous vectors so we can find their index by their address
+    auto find_in = [&offset, material](const auto &materials) {
+        auto begin = materials.data();
+        auto end = begin + materials.size();
+        if (material >= begin && material < end) {
+            return offset + static_cast<int>(static_cast<decltype(begin)>(material) - begin);
+        }
+        offset += static_cast<int>(materials.size());
+        return -1;
+    };
+
+    int id = -1;
+    if ((id = find_in(m_lambertian)) >= 0) return id;
+    if ((id = find_in(m_metal)) >= 0) return id;
+    if ((id = find_in(m_dielectric)) >= 0) return id;
+    return -1;
+}
+
+Scene::EntityType Scene::GetEntityType(const IEntity *entity) const {
+    // entities live inside contiguous vectors so we can find their type by their address
+    auto is_in = [entity](const auto &entities) {
+        const IEntity *begin = entities.data();
+        const IEntity *end = entities.data() + entities.size();
+        return entity >= begin && entity < end;
+    };
+
+    if (is_in(m_basic_entities)) return EntityType::BASIC;
+    if (is_in(m_union_entities)) return EntityType::UNION;
+    if (is_in(m_intersection_entities)) return EntityType::INTERSECTION;
+    if (is_in(m_difference_entities)) return EntityType::DIFFERENCE;
+    return EntityType::UNKNOWN;
+}
+
 }
\ No newline at end of file
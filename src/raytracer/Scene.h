@@ -4,6 +4,10 @@
 #include "Material.h"
 #include "Ray.h"
 #include "Entity.h"
+#include "Sampler.h"
+#include "Texture.h"
+#include "TextureCache.h"
+#include "Environment.h"
 
 #include <vector>
 
@@ -20,21 +24,64 @@ class Scene {
                 bool hit_object;
                 bool no_bounce;
         };
+        // Closest entity along a ray
+        struct Hit {
+            public:
+                float t;
+                IShape *shape;
+                IMaterial *material;
+                int entity_id;
+        };
+        // Which of the entity vectors an entity lives in
+        enum class EntityType { BASIC, UNION, INTERSECTION, DIFFERENCE, UNKNOWN };
+        // Optional information about the surface that was hit, before the material scatters the ray
+        struct SurfaceInfo {
+            public:
+                float t;
+                glm::vec3 normal;
+                glm::vec3 albedo;
+                int entity_id;
+                int material_id;
+        };
     public:
         // shapes
         std::vector<Sphere> m_spheres;
+        std::vector<Plane> m_planes;
+        std::vector<Box> m_boxes;
+        std::vector<OrientedBox> m_oriented_boxes;
+        std::vector<Cylinder> m_cylinders;
+        std::vector<Cone> m_cones;
+        std::vector<Disc> m_discs;
         // materials
         std::vector<Lambertian> m_lambertian;
         std::vector<Dielectric> m_dielectric;
         std::vector<Metal> m_metal;
+        // textures
+        std::vector<CheckerTexture> m_checker_textures;
+        std::vector<NoiseTexture> m_noise_textures;
+        std::vector<ImageTexture> m_image_textures;
+        // tiles of the image textures, read in as they are sampled
+        TextureCache m_texture_cache;
+        // light arriving from around the scene, rays that escape an empty one keep their colour
+        EnvironmentMap m_environment;
         // entities
         std::vector<IEntity*> m_entities;
         std::vector<BasicEntity> m_basic_entities;
+        std::vector<UnionEntity> m_union_entities;
         std::vector<IntersectionEntity> m_intersection_entities;
         std::vector<DifferenceEntity> m_difference_entities;
     public:
         Scene();
-        CastResult CastRay(Ray& ray);
+        CastResult CastRay(Ray& ray, Sampler &sampler, SurfaceInfo *info=nullptr) const;
+        // CastRay split into its two stages, so they can be run separately over batches of rays
+        bool Intersect(const Ray &ray, Hit &hit) const;
+        CastResult Scatter(Ray &ray, const Hit &hit, Sampler &sampler, SurfaceInfo *info=nullptr) const;
+        // surface information for a hit without scattering the ray
+        SurfaceInfo GetSurfaceInfo(const Hit &hit, const Collision &collision) const;
+        // materials are numbered by their position in m_lambertian, m_metal then m_dielectric
+        int GetMaterialID(const IMaterial *material) const;
+        // UNKNOWN if the entity isn't one of this scene's
+        EntityType GetEntityType(const IEntity *entity) const;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "Sequence.h"
+#include "ImageWriter.h"
+#include "AsyncWriter.h"
+#include "Timeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+namespace raytracer
+{
+
+std::string GetFrameFilename(const std::string &pattern, int frame) {
+    std::string filename;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        if (pattern[i] != '#') {
+            filename += pattern[i++];
+            continue;
+        }
+        size_t width = 0;
+        while (i < pattern.size() && pattern[i] == '#') {
+            width++;
+            i++;
+        }
+        char number[32];
+        snprintf(number, sizeof(number), "%0*d", static_cast<int>(std::min<size_t>(width, 16)), frame);
+        filename += number;
+    }
+    return filename;
+}
+
+static bool HasExtension(const std::string &filename, const char *extension) {
+    const std::string ending = extension;
+    return filename.size() >= ending.size() && filename.compare(filename.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+static bool WriteFrame(const std::string &filename, const HDRBuffer &hdr, const Tonemapper &tonemapper) {
+    if (HasExtension(filename, ".exr")) {
+        return WriteEXR(filename, hdr);
+    }
+    if (HasExtension(filename, ".pfm")) {
+        return WritePFM(filename, hdr);
+    }
+    const int width = hdr.GetWidth();
+    const int height = hdr.GetHeight();
+    std::vector<uint8_t> ldr(static_cast<size_t>(width)*height*4);
+    tonemapper.Apply(hdr, ldr.data(), 0, width, 0, height);
+    return WritePNG(filename, ldr.data(), width, height);
+}
+
+bool RenderSequence(
+    Renderer &renderer, Camera &camera, Scene &scene, Animation &animation,
+    const SequenceSettings &settings, SequenceStats *stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const float frames_per_second = (settings.frames_per_second > 0.0f) ? settings.frames_per_second : 24.0f;
+    const int max_pending_writes = std::max(1, settings.max_pending_writes);
+    float render_seconds = 0.0f;
+    int total_frames = 0;
+    std::atomic<int> total_write_errors{0};
+
+    renderer.m_is_animated = true;
+    // declared after the counters so it finishes its jobs before they go away
+    AsyncWriter writer;
+
+    Animation::Frame frame = animation.Evaluate(static_cast<float>(settings.first_frame) / frames_per_second);
+    for (int n = settings.first_frame; n <= settings.last_frame; n++) {
+        TimelineScope scope("Sequence frame", "render", "frame", n);
+        animation.Apply(frame, camera);
+        renderer.Start(camera, scene, settings.width, settings.height);
+
+        // the next frame is set up while this one renders
+        if (n < settings.last_frame) {
+            frame = animation.Evaluate(static_cast<float>(n+1) / frames_per_second);
+        }
+        while (renderer.GetState() == Renderer::State::RUNNING) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        render_seconds += renderer.GetLastFrameTime();
+        total_frames++;
+
+        // rendering the next frame reuses the renderer's buffers, so the writer gets a copy
+        while (writer.GetPending() >= max_pending_writes) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        HDRBuffer hdr = renderer.GetHDRBuffer();
+        const std::string filename = GetFrameFilename(settings.output_pattern, n);
+        const Tonemapper tonemapper = renderer.m_tonemapper;
+        writer.Submit([hdr = std::move(hdr), filename, tonemapper, n, &total_write_errors]() {
+            TimelineScope scope("Write frame", "io", "frame", n);
+            if (!WriteFrame(filename, hdr, tonemapper)) {
+                fprintf(stderr, "Failed to write %s\n", filename.c_str());
+                total_write_errors++;
+            }
+        });
+    }
+    writer.Wait();
+
+    if (stats) {
+        stats->total_frames = total_frames;
+        stats->total_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        stats->render_seconds = render_seconds;
+        stats->total_write_errors = total_write_errors;
+    }
+    return total_write_errors == 0;
+}
+
+}
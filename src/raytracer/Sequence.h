@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Renderer.h"
+#include "Animation.h"
+#include "Camera.h"
+#include "Scene.h"
+
+#include <string>
+
+namespace raytracer
+{
+
+struct SequenceSettings {
+    public:
+        int width{1280};
+        int height{720};
+        // frames [first_frame, last_frame] are rendered, frame n is at time n / frames_per_second
+        int first_frame{0};
+        int last_frame{0};
+        float frames_per_second{24.0f};
+        // each run of # is replaced by the frame number padded to its length, such as frame_####.png
+        // .png files are tonemapped with the renderer's tonemapper, .exr and .pfm are linear
+        std::string output_pattern;
+        // frames waiting to be written before rendering waits for the writer, which bounds the memory used
+        int max_pending_writes{2};
+};
+
+struct SequenceStats {
+    public:
+        int total_frames{0};
+        // from the first frame starting to the last frame being written
+        float total_seconds{0.0f};
+        // spent by the renderer on the frames, the rest is time the render threads were idle between them
+        float render_seconds{0.0f};
+        int total_write_errors{0};
+};
+
+// filename of a frame from an output pattern
+std::string GetFrameFilename(const std::string &pattern, int frame);
+
+// Renders the frames of an animation one after another, with the renderer's settings
+// Work between frames is overlapped with rendering:
+// - the next frame's keyframes are evaluated while a frame renders, leaving only moving the shapes between frames
+// - the renderer refits its kernel scene instead of building it again
+// - finished frames are copied, then tonemapped, encoded and written on a background thread
+// The renderer is left with m_is_animated set, and the shapes at the last frame
+// returns false if any frame failed to write
+bool RenderSequence(
+    Renderer &renderer, Camera &camera, Scene &scene, Animation &animation,
+    const SequenceSettings &settings, SequenceStats *stats=nullptr);
+
+}
@@ -1,6 +1,8 @@
 #include "Shape.h"
 #include "Ray.h"
 
+#include <limits>
+
 namespace raytracer {
 
 Sphere::Sphere(glm::vec3 center, float radius)
@@ -8,80 +10,158 @@ Sphere::Sphere(glm::vec3 center, float radius)
 {
 }
 
-float square_length(const glm::vec3 &v) {
-    return glm::dot(v, v);
-}
-
-// https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-sphere-intersection
-bool Sphere::CheckHit(const Ray &ray, float &t0, float &t1) {
-    /*
-    C = circle center vector
-    r = radius
-    parametric equation of sphere: ||x-C||^2 = r^2
-
-    A = start position
-    B = direction
-    parametric equation of ray: x(t) = A + B*t
-
-    solution for t
-    ||A+B*t-C||^2 = r^2
-    (A.x+B.x*t-C.x)^2 + ... = r^2
-    (B.x^2)*(t^2) - 2*t*B.x*(A.x-C.x) + (A.x-C.x)^2 + .... = r^2
-    ||B||^2 * t^2 - 2*dot(B, A-C)*t + ||A-C||^2 = r^2
-
-    This is rewritten as a quadratic equation
-    a*t^2 + b*t + c = 0
-    a = ||B||^2
-    b = -2*dot(B, A-C) 
-    c = ||A-C||^2 - r^2
-    discriminant = b^2 - 4*a*c = 4*[(b/2)^2 - a*c]
-    
-    we first check if discriminant has solution or not
-    discriminant >= 0 means there is a solution, and our ray hits
-    t = [-b ± sqrt(discriminant)] / (2*a)
-    t = [-b/2 ± sqrt(discriminant/4)] / a
-
-    to reduce the amount of computation, we can optimise this abit
-    let D = discriminant/4
-    D = (b/2)^2 - a*c
-    t = [-b/2 ± sqrt(D)] / a
-    let G = b/2
-    D = G^2 - a*c
-    t = [-G ± sqrt(D)] / a
-    this is our final optimised equation
-    */
-
-    glm::vec3 delta_pos = ray.origin - m_center;
-
-    const float a = square_length(ray.direction);
-    const float c = square_length(delta_pos) - m_radius*m_radius;
-    const float half_b = glm::dot(delta_pos, ray.direction);
-
-    const float D = half_b*half_b - a*c;
-    if (D < 0) {
-        return false;
+Plane::Plane(glm::vec3 point, glm::vec3 normal)
+: m_normal(glm::normalize(normal))
+{
+    m_offset = glm::dot(m_normal, point);
+}
+
+Box::Box(glm::vec3 min, glm::vec3 max)
+: m_min(glm::min(min, max)), m_max(glm::max(min, max))
+{
+}
+
+OrientedBox::OrientedBox(glm::vec3 center, glm::vec3 half_size, glm::vec3 axis_x, glm::vec3 axis_y)
+: m_center(center), m_half_size(glm::abs(half_size))
+{
+    m_axes[0] = glm::normalize(axis_x);
+    m_axes[2] = glm::normalize(glm::cross(m_axes[0], axis_y));
+    m_axes[1] = glm::cross(m_axes[2], m_axes[0]);
+}
+
+Cylinder::Cylinder(glm::vec3 base, glm::vec3 top, float radius)
+: m_base(base), m_radius(radius)
+{
+    m_height = glm::length(top - base);
+    m_axis = (top - base) / m_height;
+}
+
+Cone::Cone(glm::vec3 base, glm::vec3 apex, float radius)
+: m_apex(apex), m_radius(radius)
+{
+    m_height = glm::length(base - apex);
+    m_axis = (base - apex) / m_height;
+    m_cos2_angle = (m_height*m_height) / (m_height*m_height + m_radius*m_radius);
+}
+
+Disc::Disc(glm::vec3 center, glm::vec3 normal, float radius)
+: m_center(center), m_normal(glm::normalize(normal)), m_radius(radius)
+{
+}
+
+bool Bounds::IsFinite() const {
+    const float limit = std::numeric_limits<float>::max();
+    return glm::all(glm::lessThan(glm::abs(min), glm::vec3{limit})) && glm::all(glm::lessThan(glm::abs(max), glm::vec3{limit}));
+}
+
+float Bounds::GetSurfaceArea() const {
+    if (IsEmpty()) {
+        return 0.0f;
+    }
+    const glm::vec3 size = max - min;
+    return 2.0f*(size.x*size.y + size.y*size.z + size.z*size.x);
+}
+
+Bounds Bounds::GetPadded() const {
+    if (IsEmpty()) {
+        return *this;
+    }
+    const glm::vec3 pad = 1e-4f*(glm::abs(min) + glm::abs(max)) + glm::vec3{1e-4f};
+    return {min - pad, max + pad};
+}
+
+Bounds Bounds::Union(const Bounds &a, const Bounds &b) {
+    return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+}
+
+Bounds Bounds::Intersection(const Bounds &a, const Bounds &b) {
+    return {glm::max(a.min, b.min), glm::min(a.max, b.max)};
+}
+
+// half size of the bounds of a circle with a normal along axis
+static glm::vec3 GetCircleExtent(const glm::vec3 &axis, float radius) {
+    const glm::vec3 one{1,1,1};
+    return radius * glm::sqrt(glm::max(one - axis*axis, glm::vec3{0,0,0}));
+}
+
+Bounds Sphere::GetBounds() const {
+    const glm::vec3 extent{m_radius, m_radius, m_radius};
+    return {m_center - extent, m_center + extent};
+}
+
+Bounds Plane::GetBounds() const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    Bounds bounds{glm::vec3{-infinity}, glm::vec3{infinity}};
+    // only a plane facing along an axis bounds that axis
+    for (int axis = 0; axis < 3; axis++) {
+        if (glm::abs(m_normal[axis]) != 1.0f) {
+            continue;
+        }
+        if (m_normal[axis] > 0.0f) {
+            bounds.max[axis] = m_offset;
+        } else {
+            bounds.min[axis] = -m_offset;
+        }
     }
-    const float sqrt_D = glm::sqrt(D);
-
-    // our intersection interval
-    t0 = (-half_b - sqrt_D) / a;
-    t1 = (-half_b + sqrt_D) / a;
-    return true;
-}
-
-Collision Sphere::GetCollision(const Ray &ray, float t) {
-    Collision c;
-    c.pos = ray.origin + ray.direction*t;
-    glm::vec3 out_normal = glm::normalize(c.pos - m_center);
-    
-    float cos_angle = glm::dot(ray.direction, out_normal);
-    // if bouncing against interior of sphere
-    // then out normal will radiate in same direction as ray direction
-    // cos(theta) < 0 if theta > 90' and theta < -90'   (external collision)
-    // cos(theta) > 0 if -90' < theta < 90'             (internal collision)
-    c.is_internal = cos_angle > 0;
-    c.normal = c.is_internal ? -out_normal : out_normal;
-    return c;
-}
-
-}
\ No newline at end of file
+    return bounds;
+}
+
+Bounds Box::GetBounds() const {
+    return {m_min, m_max};
+}
+
+Bounds OrientedBox::GetBounds() const {
+    const glm::vec3 extent = 
+        glm::abs(m_axes[0])*m_half_size.x + 
+        glm::abs(m_axes[1])*m_half_size.y + 
+        glm::abs(m_axes[2])*m_half_size.z;
+    return {m_center - extent, m_center + extent};
+}
+
+Bounds Cylinder::GetBounds() const {
+    const glm::vec3 extent = GetCircleExtent(m_axis, m_radius);
+    const glm::vec3 top = m_base + m_axis*m_height;
+    return {glm::min(m_base, top) - extent, glm::max(m_base, top) + extent};
+}
+
+Bounds Cone::GetBounds() const {
+    const glm::vec3 extent = GetCircleExtent(m_axis, m_radius);
+    const glm::vec3 base = m_apex + m_axis*m_height;
+    return {glm::min(m_apex, base - extent), glm::max(m_apex, base + extent)};
+}
+
+Bounds Disc::GetBounds() const {
+    const glm::vec3 extent = GetCircleExtent(m_normal, m_radius);
+    return {m_center - extent, m_center + extent};
+}
+
+void Sphere::Translate(const glm::vec3 &offset) {
+    m_center += offset;
+}
+
+void Plane::Translate(const glm::vec3 &offset) {
+    m_offset += glm::dot(m_normal, offset);
+}
+
+void Box::Translate(const glm::vec3 &offset) {
+    m_min += offset;
+    m_max += offset;
+}
+
+void OrientedBox::Translate(const glm::vec3 &offset) {
+    m_center += offset;
+}
+
+void Cylinder::Translate(const glm::vec3 &offset) {
+    m_base += offset;
+}
+
+void Cone::Translate(const glm::vec3 &offset) {
+    m_apex += offset;
+}
+
+void Disc::Translate(const glm::vec3 &offset) {
+    m_center += offset;
+}
+
+}
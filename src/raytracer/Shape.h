@@ -1,6 +1,8 @@
 #pragma once
 
 #include <glm/glm/glm.hpp>
+#include <cmath>
+#include <limits>
 #include "Ray.h"
 
 namespace raytracer {
@@ -10,12 +12,41 @@ struct Collision {
     glm::vec3 pos;
     glm::vec3 normal;
     bool is_internal; // so we can treat shapes as hollow
+    // texture coordinates, and roughly how fast they change per unit distance along the surface
+    glm::vec2 uv;
+    float uv_scale;
 };
 
+// Axis aligned bounds, unbounded shapes have infinite sides
+struct Bounds {
+    public:
+        glm::vec3 min;
+        glm::vec3 max;
+    public:
+        bool IsEmpty() const { return (min.x > max.x) || (min.y > max.y) || (min.z > max.z); }
+        bool IsFinite() const;
+        float GetSurfaceArea() const;
+        // grown a little, so rounding never makes the bounds miss a ray that hits what they bound
+        Bounds GetPadded() const;
+        // ray interval inside the bounds, which may be empty
+        bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        static Bounds Union(const Bounds &a, const Bounds &b);
+        static Bounds Intersection(const Bounds &a, const Bounds &b);
+};
+
+// Used by the render kernels to call shapes without virtual calls
+enum class ShapeType { SPHERE, PLANE, BOX, ORIENTED_BOX, CYLINDER, CONE, DISC, TOTAL_TYPES };
+
 class IShape {
     public:
-        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) = 0;
-        virtual Collision GetCollision(const Ray &ray, float t) = 0;
+        // [t0, t1] is the interval of the ray inside the shape, so shapes can be combined by entities
+        // unbounded shapes return infinite ends
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const = 0;
+        virtual Collision GetCollision(const Ray &ray, float t) const = 0;
+        virtual ShapeType GetType() const = 0;
+        virtual Bounds GetBounds() const = 0;
+        // move the shape without changing its size or orientation, used to animate it
+        virtual void Translate(const glm::vec3 &offset) = 0;
 };
 
 class Sphere: public IShape {
@@ -24,8 +55,474 @@ class Sphere: public IShape {
         float m_radius;
     public:
         Sphere(glm::vec3 center, float radius); 
-        virtual bool CheckHit(const Ray &ray, float &t0, float &t1);
-        virtual Collision GetCollision(const Ray &ray, float t);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::SPHERE; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Solid half space behind the normal, for grounds and for cutting other entities
+class Plane: public IShape {
+    private:
+        glm::vec3 m_normal;
+        float m_offset;
+    public:
+        Plane(glm::vec3 point, glm::vec3 normal);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::PLANE; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Axis aligned box
+class Box: public IShape {
+    private:
+        glm::vec3 m_min;
+        glm::vec3 m_max;
+    public:
+        Box(glm::vec3 min, glm::vec3 max);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::BOX; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Box rotated so its sides lie along axis_x and axis_y
+// the axes don't need to be normalised or perpendicular, axis_y is made perpendicular to axis_x
+class OrientedBox: public IShape {
+    private:
+        glm::vec3 m_center;
+        glm::vec3 m_half_size;
+        glm::vec3 m_axes[3];
+    public:
+        OrientedBox(glm::vec3 center, glm::vec3 half_size, glm::vec3 axis_x, glm::vec3 axis_y);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::ORIENTED_BOX; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Cylinder capped at both ends
+class Cylinder: public IShape {
+    private:
+        glm::vec3 m_base;
+        glm::vec3 m_axis;
+        float m_height;
+        float m_radius;
+    public:
+        Cylinder(glm::vec3 base, glm::vec3 top, float radius);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::CYLINDER; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Cone from an apex down to a capped circular base
+class Cone: public IShape {
+    private:
+        glm::vec3 m_apex;
+        glm::vec3 m_axis;
+        float m_height;
+        float m_radius;
+        // squared cosine of the half angle at the apex
+        float m_cos2_angle;
+    public:
+        Cone(glm::vec3 base, glm::vec3 apex, float radius);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::CONE; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
+};
+
+// Flat disc with no thickness, t0 and t1 are the same
+class Disc: public IShape {
+    private:
+        glm::vec3 m_center;
+        glm::vec3 m_normal;
+        float m_radius;
+    public:
+        Disc(glm::vec3 center, glm::vec3 normal, float radius);
+        virtual bool CheckHit(const Ray &ray, float &t0, float &t1) const;
+        virtual Collision GetCollision(const Ray &ray, float t) const;
+        virtual ShapeType GetType() const { return ShapeType::DISC; }
+        virtual Bounds GetBounds() const;
+        virtual void Translate(const glm::vec3 &offset);
 };
 
+// defined here so the specialised kernels in Kernels.cpp can inline them
+inline float square_length(const glm::vec3 &v) {
+    return glm::dot(v, v);
+}
+
+constexpr float SHAPE_PI = 3.14159265f;
+
+// https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-sphere-intersection
+inline bool Sphere::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    /*
+    C = circle center vector
+    r = radius
+    parametric equation of sphere: ||x-C||^2 = r^2
+
+    A = start position
+    B = direction
+    parametric equation of ray: x(t) = A + B*t
+
+    solution for t
+    ||A+B*t-C||^2 = r^2
+    (A.x+B.x*t-C.x)^2 + ... = r^2
+    (B.x^2)*(t^2) - 2*t*B.x*(A.x-C.x) + (A.x-C.x)^2 + .... = r^2
+    ||B||^2 * t^2 - 2*dot(B, A-C)*t + ||A-C||^2 = r^2
+
+    This is rewritten as a quadratic equation
+    a*t^2 + b*t + c = 0
+    a = ||B||^2
+    b = -2*dot(B, A-C) 
+    c = ||A-C||^2 - r^2
+    discriminant = b^2 - 4*a*c = 4*[(b/2)^2 - a*c]
+    
+    we first check if discriminant has solution or not
+    discriminant >= 0 means there is a solution, and our ray hits
+    t = [-b ± sqrt(discriminant)] / (2*a)
+    t = [-b/2 ± sqrt(discriminant/4)] / a
+
+    to reduce the amount of computation, we can optimise this abit
+    let D = discriminant/4
+    D = (b/2)^2 - a*c
+    t = [-b/2 ± sqrt(D)] / a
+    let G = b/2
+    D = G^2 - a*c
+    t = [-G ± sqrt(D)] / a
+    this is our final optimised equation
+    */
+
+    glm::vec3 delta_pos = ray.origin - m_center;
+
+    const float a = square_length(ray.direction);
+    const float c = square_length(delta_pos) - m_radius*m_radius;
+    const float half_b = glm::dot(delta_pos, ray.direction);
+
+    const float D = half_b*half_b - a*c;
+    if (D < 0) {
+        return false;
+    }
+    const float sqrt_D = glm::sqrt(D);
+
+    // our intersection interval
+    t0 = (-half_b - sqrt_D) / a;
+    t1 = (-half_b + sqrt_D) / a;
+    return true;
+}
+
+inline Collision Sphere::GetCollision(const Ray &ray, float t) const {
+    Collision c;
+    c.pos = ray.origin + ray.direction*t;
+    glm::vec3 out_normal = glm::normalize(c.pos - m_center);
+    
+    float cos_angle = glm::dot(ray.direction, out_normal);
+    // if bouncing against interior of sphere
+    // then out normal will radiate in same direction as ray direction
+    // cos(theta) < 0 if theta > 90' and theta < -90'   (external collision)
+    // cos(theta) > 0 if -90' < theta < 90'             (internal collision)
+    c.is_internal = cos_angle > 0;
+    c.normal = c.is_internal ? -out_normal : out_normal;
+    // longitude and latitude, with v going from the bottom to the top
+    c.uv = glm::vec2{
+        0.5f + std::atan2(-out_normal.z, out_normal.x) * (0.5f/SHAPE_PI),
+        std::acos(glm::clamp(-out_normal.y, -1.0f, 1.0f)) * (1.0f/SHAPE_PI)};
+    c.uv_scale = 1.0f / (SHAPE_PI*m_radius);
+    return c;
+}
+
+// collision with the normal facing the ray, and marked internal if the ray is leaving the shape
+// the uvs are left for the shape to fill in
+inline Collision FaceRay(const Ray &ray, const glm::vec3 &pos, const glm::vec3 &out_normal) {
+    Collision c;
+    c.pos = pos;
+    c.is_internal = glm::dot(ray.direction, out_normal) > 0;
+    c.normal = c.is_internal ? -out_normal : out_normal;
+    return c;
+}
+
+// two unit vectors perpendicular to a unit normal and each other
+// https://graphics.pixar.com/library/OrthonormalB/paper.pdf
+inline void GetTangents(const glm::vec3 &normal, glm::vec3 &tangent, glm::vec3 &bitangent) {
+    const float sign = (normal.z >= 0.0f) ? 1.0f : -1.0f;
+    const float a = -1.0f / (sign + normal.z);
+    const float b = normal.x * normal.y * a;
+    tangent = glm::vec3{1.0f + sign*normal.x*normal.x*a, sign*b, -sign*normal.x};
+    bitangent = glm::vec3{b, sign + normal.y*normal.y*a, -normal.y};
+}
+
+// angle of a direction perpendicular to the axis of a shape, from 0 to 1
+inline float GetAngleUV(const glm::vec3 &radial, const glm::vec3 &axis) {
+    glm::vec3 tangent, bitangent;
+    GetTangents(axis, tangent, bitangent);
+    return 0.5f + std::atan2(glm::dot(radial, bitangent), glm::dot(radial, tangent)) * (0.5f/SHAPE_PI);
+}
+
+// position on a flat circle of a radius mapped from 0 to 1 across it
+inline glm::vec2 GetCircleUV(const glm::vec3 &offset, const glm::vec3 &normal, float radius) {
+    glm::vec3 tangent, bitangent;
+    GetTangents(normal, tangent, bitangent);
+    const float scale = 0.5f/radius;
+    return glm::vec2{0.5f + glm::dot(offset, tangent)*scale, 0.5f + glm::dot(offset, bitangent)*scale};
+}
+
+// the face of a box, given its outward normal in the box's frame, is mapped from 0 to 1 along its two other axes
+inline glm::vec2 GetBoxUV(const glm::vec3 &local, const glm::vec3 &half_size, const glm::vec3 &normal, float &uv_scale) {
+    const int axis = (normal.x != 0.0f) ? 0 : ((normal.y != 0.0f) ? 1 : 2);
+    const int u_axis = (axis == 0) ? 2 : 0;
+    const int v_axis = (axis == 1) ? 2 : 1;
+    uv_scale = 0.5f / glm::min(half_size[u_axis], half_size[v_axis]);
+    return glm::vec2{0.5f + 0.5f*local[u_axis]/half_size[u_axis], 0.5f + 0.5f*local[v_axis]/half_size[v_axis]};
+}
+
+// interval of a ray inside the slabs between lower and upper along each axis
+// written without branches so it vectorises, parallel rays divide by zero and give infinite slabs
+inline bool IntersectSlabs(
+    const glm::vec3 &origin, const glm::vec3 &direction, 
+    const glm::vec3 &lower, const glm::vec3 &upper, float &t0, float &t1) 
+{
+    const glm::vec3 inv_direction = glm::vec3{1,1,1} / direction;
+    const glm::vec3 ta = (lower - origin) * inv_direction;
+    const glm::vec3 tb = (upper - origin) * inv_direction;
+    const glm::vec3 t_near = glm::min(ta, tb);
+    const glm::vec3 t_far = glm::max(ta, tb);
+    t0 = glm::max(glm::max(t_near.x, t_near.y), t_near.z);
+    t1 = glm::min(glm::min(t_far.x, t_far.y), t_far.z);
+    return t0 <= t1;
+}
+
+inline bool Bounds::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    return IntersectSlabs(ray.origin, ray.direction, min, max, t0, t1);
+}
+
+// outward normal of the face of a box centered on the origin closest to pos
+inline glm::vec3 GetBoxNormal(const glm::vec3 &pos, const glm::vec3 &half_size) {
+    const glm::vec3 local = pos / half_size;
+    const glm::vec3 distance = glm::abs(local);
+    const int axis = (distance.x > distance.y) ? 
+        ((distance.x > distance.z) ? 0 : 2) : 
+        ((distance.y > distance.z) ? 1 : 2);
+    glm::vec3 normal{0,0,0};
+    normal[axis] = (local[axis] > 0.0f) ? 1.0f : -1.0f;
+    return normal;
+}
+
+// interval along a ray between two planes perpendicular to an axis, at heights 0 and height
+inline void IntersectCaps(float origin_height, float direction_height, float height, float &t0, float &t1) {
+    const float inv_direction = 1.0f / direction_height;
+    const float ta = -origin_height * inv_direction;
+    const float tb = (height - origin_height) * inv_direction;
+    t0 = glm::min(ta, tb);
+    t1 = glm::max(ta, tb);
+}
+
+inline bool Plane::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    const float distance = glm::dot(m_normal, ray.origin) - m_offset;
+    const float rate = glm::dot(m_normal, ray.direction);
+
+    // parallel rays are either always inside or never hit
+    if (rate == 0.0f) {
+        t0 = -infinity;
+        t1 = infinity;
+        return distance < 0.0f;
+    }
+
+    // the ray enters the half space if it travels against the normal, otherwise it leaves it
+    const float t = -distance / rate;
+    const bool is_entering = rate < 0.0f;
+    t0 = is_entering ? t : -infinity;
+    t1 = is_entering ? infinity : t;
+    return true;
+}
+
+inline Collision Plane::GetCollision(const Ray &ray, float t) const {
+    Collision c = FaceRay(ray, ray.origin + ray.direction*t, m_normal);
+    // one unit of uv per unit of distance
+    glm::vec3 tangent, bitangent;
+    GetTangents(m_normal, tangent, bitangent);
+    c.uv = glm::vec2{glm::dot(c.pos, tangent), glm::dot(c.pos, bitangent)};
+    c.uv_scale = 1.0f;
+    return c;
+}
+
+inline bool Box::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    return IntersectSlabs(ray.origin, ray.direction, m_min, m_max, t0, t1);
+}
+
+inline Collision Box::GetCollision(const Ray &ray, float t) const {
+    const glm::vec3 pos = ray.origin + ray.direction*t;
+    const glm::vec3 center = (m_min + m_max) * 0.5f;
+    const glm::vec3 half_size = (m_max - m_min) * 0.5f;
+    const glm::vec3 normal = GetBoxNormal(pos - center, half_size);
+    Collision c = FaceRay(ray, pos, normal);
+    c.uv = GetBoxUV(pos - center, half_size, normal, c.uv_scale);
+    return c;
+}
+
+inline bool OrientedBox::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    // the box is axis aligned in its own frame, the axes are unit length so t is unchanged
+    const glm::vec3 delta_pos = ray.origin - m_center;
+    const glm::vec3 origin{
+        glm::dot(delta_pos, m_axes[0]), glm::dot(delta_pos, m_axes[1]), glm::dot(delta_pos, m_axes[2])};
+    const glm::vec3 direction{
+        glm::dot(ray.direction, m_axes[0]), glm::dot(ray.direction, m_axes[1]), glm::dot(ray.direction, m_axes[2])};
+    return IntersectSlabs(origin, direction, -m_half_size, m_half_size, t0, t1);
+}
+
+inline Collision OrientedBox::GetCollision(const Ray &ray, float t) const {
+    const glm::vec3 pos = ray.origin + ray.direction*t;
+    const glm::vec3 delta_pos = pos - m_center;
+    const glm::vec3 local{
+        glm::dot(delta_pos, m_axes[0]), glm::dot(delta_pos, m_axes[1]), glm::dot(delta_pos, m_axes[2])};
+    const glm::vec3 normal = GetBoxNormal(local, m_half_size);
+    Collision c = FaceRay(ray, pos, m_axes[0]*normal.x + m_axes[1]*normal.y + m_axes[2]*normal.z);
+    c.uv = GetBoxUV(local, m_half_size, normal, c.uv_scale);
+    return c;
+}
+
+inline bool Cylinder::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    const float infinity = std::numeric_limits<float>::infinity();
+    const glm::vec3 delta_pos = ray.origin - m_base;
+    const float origin_height = glm::dot(delta_pos, m_axis);
+    const float direction_height = glm::dot(ray.direction, m_axis);
+
+    // the side is the same quadratic as the sphere, using only the parts perpendicular to the axis
+    const glm::vec3 radial_pos = delta_pos - m_axis*origin_height;
+    const glm::vec3 radial_direction = ray.direction - m_axis*direction_height;
+    const float a = square_length(radial_direction);
+    const float c = square_length(radial_pos) - m_radius*m_radius;
+    const float half_b = glm::dot(radial_pos, radial_direction);
+
+    const float D = half_b*half_b - a*c;
+    if (D < 0) {
+        return false;
+    }
+    const float sqrt_D = glm::sqrt(D);
+    // rays along the axis are either always inside the side or never
+    const bool is_parallel = a == 0.0f;
+    const float side_t0 = is_parallel ? -infinity : (-half_b - sqrt_D) / a;
+    const float side_t1 = is_parallel ? infinity : (-half_b + sqrt_D) / a;
+
+    float cap_t0, cap_t1;
+    IntersectCaps(origin_height, direction_height, m_height, cap_t0, cap_t1);
+
+    t0 = glm::max(side_t0, cap_t0);
+    t1 = glm::min(side_t1, cap_t1);
+    return (!is_parallel || c <= 0.0f) && t0 <= t1;
+}
+
+inline Collision Cylinder::GetCollision(const Ray &ray, float t) const {
+    const glm::vec3 pos = ray.origin + ray.direction*t;
+    const glm::vec3 delta_pos = pos - m_base;
+    const float height = glm::dot(delta_pos, m_axis);
+    const glm::vec3 radial = delta_pos - m_axis*height;
+    const float radial_length = glm::sqrt(square_length(radial));
+
+    // use whichever surface the point is closest to
+    const float cap_distance = glm::min(glm::abs(height), glm::abs(m_height - height));
+    const float side_distance = glm::abs(m_radius - radial_length);
+    if (cap_distance < side_distance) {
+        Collision c = FaceRay(ray, pos, (height > 0.5f*m_height) ? m_axis : -m_axis);
+        c.uv = GetCircleUV(radial, m_axis, m_radius);
+        c.uv_scale = 0.5f / m_radius;
+        return c;
+    }
+    // around the side, and from the base to the top
+    Collision c = FaceRay(ray, pos, radial / radial_length);
+    c.uv = glm::vec2{GetAngleUV(radial, m_axis), height / m_height};
+    c.uv_scale = glm::max(1.0f / m_height, 0.5f / (SHAPE_PI*m_radius));
+    return c;
+}
+
+inline bool Cone::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    /*
+    with v = x - apex and the axis a pointing from the apex to the base
+    points on the surface of the double cone satisfy dot(v, a)^2 = cos^2(angle)*||v||^2
+    substituting the ray gives a quadratic in t, like the sphere
+    */
+    const float infinity = std::numeric_limits<float>::infinity();
+    const glm::vec3 delta_pos = ray.origin - m_apex;
+    const float origin_height = glm::dot(delta_pos, m_axis);
+    const float direction_height = glm::dot(ray.direction, m_axis);
+
+    const float a = direction_height*direction_height - m_cos2_angle*square_length(ray.direction);
+    const float c = origin_height*origin_height - m_cos2_angle*square_length(delta_pos);
+    const float half_b = direction_height*origin_height - m_cos2_angle*glm::dot(ray.direction, delta_pos);
+
+    const float D = half_b*half_b - a*c;
+    if (D < 0) {
+        return false;
+    }
+    const float sqrt_D = glm::sqrt(D);
+    const float root_0 = (-half_b - sqrt_D) / a;
+    const float root_1 = (-half_b + sqrt_D) / a;
+    const float root_min = glm::min(root_0, root_1);
+    const float root_max = glm::max(root_0, root_1);
+
+    // a < 0: the ray is inside the double cone between the roots
+    // a > 0: the ray is inside it outside the roots, and only the end heading towards the base is on our side
+    const bool is_between = a < 0.0f;
+    const bool is_towards_base = direction_height > 0.0f;
+    const float side_t0 = is_between ? root_min : (is_towards_base ? root_max : -infinity);
+    const float side_t1 = is_between ? root_max : (is_towards_base ? infinity : root_min);
+
+    // the caps remove the other half of the double cone
+    float cap_t0, cap_t1;
+    IntersectCaps(origin_height, direction_height, m_height, cap_t0, cap_t1);
+
+    t0 = glm::max(side_t0, cap_t0);
+    t1 = glm::min(side_t1, cap_t1);
+    return t0 <= t1;
+}
+
+inline Collision Cone::GetCollision(const Ray &ray, float t) const {
+    const glm::vec3 pos = ray.origin + ray.direction*t;
+    const glm::vec3 delta_pos = pos - m_apex;
+    const float height = glm::dot(delta_pos, m_axis);
+    const glm::vec3 radial = delta_pos - m_axis*height;
+    const float radial_length = glm::sqrt(square_length(radial));
+
+    // use whichever surface the point is closest to, the side distance is measured perpendicular to it
+    const float cap_distance = glm::abs(m_height - height);
+    const float side_distance = glm::abs(radial_length - height*m_radius/m_height) * glm::sqrt(m_cos2_angle);
+    if (cap_distance < side_distance) {
+        Collision c = FaceRay(ray, pos, m_axis);
+        c.uv = GetCircleUV(radial, m_axis, m_radius);
+        c.uv_scale = 0.5f / m_radius;
+        return c;
+    }
+    // perpendicular to the line from the apex to the rim
+    const glm::vec3 out_normal = glm::normalize((radial / radial_length)*m_height - m_axis*m_radius);
+    // around the side, and from the base to the apex
+    Collision c = FaceRay(ray, pos, out_normal);
+    c.uv = glm::vec2{GetAngleUV(radial, m_axis), 1.0f - height / m_height};
+    c.uv_scale = glm::max(1.0f / m_height, 0.5f / (SHAPE_PI*m_radius));
+    return c;
+}
+
+inline bool Disc::CheckHit(const Ray &ray, float &t0, float &t1) const {
+    // parallel rays get an infinite or NaN t, which fails the radius test
+    const float t = glm::dot(m_normal, m_center - ray.origin) / glm::dot(m_normal, ray.direction);
+    const glm::vec3 delta_pos = ray.origin + ray.direction*t - m_center;
+    t0 = t;
+    t1 = t;
+    return square_length(delta_pos) <= m_radius*m_radius;
+}
+
+inline Collision Disc::GetCollision(const Ray &ray, float t) const {
+    Collision c = FaceRay(ray, ray.origin + ray.direction*t, m_normal);
+    c.uv = GetCircleUV(c.pos - m_center, m_normal, m_radius);
+    c.uv_scale = 0.5f / m_radius;
+    return c;
+}
+
 }
\ No newline at end of file
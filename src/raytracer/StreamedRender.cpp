@@ -0,0 +1,98 @@
+#include "StreamedRender.h"
+#include "Kernels.h"
+#include "Timeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace raytracer
+{
+
+bool RenderStreamed(
+    Renderer &renderer, const Camera &camera, const Scene &scene,
+    const StreamedRenderSettings &settings, StreamedRenderStats *stats)
+{
+    const auto start = std::chrono::steady_clock::now();
+    if (renderer.GetState() == Renderer::State::RUNNING) {
+        return false;
+    }
+
+    TiledEXRWriter writer;
+    if (!writer.Open(settings.output_filename, settings.width, settings.height, settings.tile_size, settings.compression)) {
+        return false;
+    }
+    KernelScene kernel_scene;
+    kernel_scene.Build(scene);
+
+    const int tile_size = settings.tile_size;
+    const int total_samples = renderer.m_total_samples;
+    const int total_bounces = renderer.m_total_bounces;
+    const uint32_t seed = renderer.m_seed;
+    const int tiles_x = writer.GetTilesX();
+    const int total_tiles = tiles_x*writer.GetTilesY();
+    std::atomic<int> next_tile{0};
+    std::atomic<int> total_written{0};
+    std::atomic<bool> is_failed{false};
+
+    // one task per thread, each one renders tiles until there are none left
+    std::mutex mutex;
+    std::condition_variable finished;
+    int total_tasks = std::min(renderer.GetTotalThreads(), total_tiles);
+    const int total_started = total_tasks;
+    for (int i = 0; i < total_started; i++) {
+        renderer.Push([&](int id) {
+            std::vector<float> planes(static_cast<size_t>(tile_size)*tile_size*3);
+            int tile_index;
+            while (!is_failed && (tile_index = next_tile++) < total_tiles) {
+                const int tile_x = tile_index % tiles_x;
+                const int tile_y = tile_index / tiles_x;
+                Tile tile;
+                tile.x_start = tile_x*tile_size;
+                tile.y_start = tile_y*tile_size;
+                tile.x_end = std::min(tile.x_start + tile_size, settings.width);
+                tile.y_end = std::min(tile.y_start + tile_size, settings.height);
+
+                {
+                    TimelineScope scope("Streamed tile", "render", "x", tile.x_start, "y", tile.y_start);
+                    renderer.RenderTile(
+                        camera, scene, kernel_scene, settings.width, settings.height,
+                        total_samples, total_bounces, seed, tile, planes.data());
+                }
+                {
+                    TimelineScope scope("Write tile", "io", "x", tile.x_start, "y", tile.y_start);
+                    if (!writer.WriteTile(tile_x, tile_y, planes.data())) {
+                        is_failed = true;
+                    }
+                }
+                total_written++;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            total_tasks--;
+            finished.notify_one();
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (total_tasks > 0) {
+            if (!finished.wait_for(lock, std::chrono::seconds(1), [&] { return total_tasks == 0; }) && settings.on_progress) {
+                lock.unlock();
+                settings.on_progress(total_written, total_tiles);
+                lock.lock();
+            }
+        }
+    }
+    const bool is_written = writer.Close() && !is_failed;
+
+    if (stats) {
+        stats->total_tiles = total_tiles;
+        stats->total_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    }
+    return is_written;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Renderer.h"
+#include "ImageWriter.h"
+#include "Camera.h"
+#include "Scene.h"
+
+#include <functional>
+#include <string>
+
+namespace raytracer
+{
+
+struct StreamedRenderSettings {
+    public:
+        int width{32768};
+        int height{32768};
+        // tiles of the output file, each one is rendered with all of its samples by a single thread
+        int tile_size{64};
+        // tiled OpenEXR file
+        std::string output_filename;
+        EXRCompression compression{EXRCompression::ZIP};
+        // called on the calling thread about once a second while tiles are rendered
+        std::function<void(int tiles_written, int total_tiles)> on_progress;
+};
+
+struct StreamedRenderStats {
+    public:
+        int total_tiles{0};
+        float total_seconds{0.0f};
+};
+
+// Renders an image straight into a tiled OpenEXR file a tile at a time, for prints far larger than memory
+// Each of the renderer's threads takes the next tile in scanline order, renders every sample of it, then compresses
+// and appends it to the file, so only the tiles in flight are held instead of the whole frame
+// The kernel scene is built once and shared by every tile, and the pixels match a render of the same size by Renderer::Start
+// Nothing is kept for display, and there are no passes, AOVs or checkpoints
+// The renderer has to be idle, returns false if it isn't or the file couldn't be written
+bool RenderStreamed(
+    Renderer &renderer, const Camera &camera, const Scene &scene,
+    const StreamedRenderSettings &settings, StreamedRenderStats *stats=nullptr);
+
+}
@@ -0,0 +1,83 @@
+#include "Texture.h"
+
+#include <cmath>
+
+namespace raytracer
+{
+
+CheckerTexture::CheckerTexture(const glm::vec3 &even, const glm::vec3 &odd, float scale)
+: m_even(even), m_odd(odd), m_scale(scale)
+{}
+
+glm::vec3 CheckerTexture::Evaluate(const glm::vec2 &uv, float footprint) const {
+    // in floats so squares far from the origin don't overflow an int
+    const float sum = std::floor(uv.x*m_scale) + std::floor(uv.y*m_scale);
+    const bool is_odd = (sum - 2.0f*std::floor(sum*0.5f)) != 0.0f;
+    const glm::vec3 color = is_odd ? m_odd : m_even;
+
+    // starts fading once a square is less than twice the footprint, and is flat by the time it is smaller
+    const float blur = glm::clamp(2.0f*footprint*m_scale - 1.0f, 0.0f, 1.0f);
+    return glm::mix(color, 0.5f*(m_even + m_odd), blur);
+}
+
+NoiseTexture::NoiseTexture(const glm::vec3 &low, const glm::vec3 &high, float scale, int total_octaves, uint32_t seed)
+: m_low(low), m_high(high), m_scale(scale), m_total_octaves(total_octaves), m_seed(seed)
+{}
+
+// random value in [0,1) at each integer point, different for every octave
+static inline float HashLattice(int64_t x, int64_t y, uint32_t seed) {
+    // splitmix64 finaliser, like the sampler
+    uint64_t h = static_cast<uint64_t>(x)*0x9E3779B97F4A7C15ull ^ static_cast<uint64_t>(y)*0xC2B2AE3D27D4EB4Full ^ seed;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    h = h ^ (h >> 31);
+    return static_cast<float>(h >> 40) * (1.0f / 16777216.0f);
+}
+
+float NoiseTexture::GetValueNoise(const glm::vec2 &p, uint32_t octave) const {
+    const float x_floor = std::floor(p.x);
+    const float y_floor = std::floor(p.y);
+    const int64_t x = static_cast<int64_t>(x_floor);
+    const int64_t y = static_cast<int64_t>(y_floor);
+    const uint32_t seed = m_seed*31u + octave;
+
+    // smoothstep between the corners so the gradient is continuous
+    float fx = p.x - x_floor;
+    float fy = p.y - y_floor;
+    fx = fx*fx*(3.0f - 2.0f*fx);
+    fy = fy*fy*(3.0f - 2.0f*fy);
+
+    const float top = glm::mix(HashLattice(x, y, seed), HashLattice(x+1, y, seed), fx);
+    const float bottom = glm::mix(HashLattice(x, y+1, seed), HashLattice(x+1, y+1, seed), fx);
+    return glm::mix(top, bottom, fy);
+}
+
+glm::vec3 NoiseTexture::Evaluate(const glm::vec2 &uv, float footprint) const {
+    float sum = 0.0f;
+    float total_amplitude = 0.0f;
+    float amplitude = 1.0f;
+    float frequency = 1.0f / m_scale;
+    for (int i = 0; i < m_total_octaves; i++) {
+        // octaves with features smaller than the footprint are replaced by their average
+        const float detail = glm::clamp(2.0f - 2.0f*footprint*frequency, 0.0f, 1.0f);
+        const float value = (detail > 0.0f) ? GetValueNoise(uv*frequency, static_cast<uint32_t>(i)) : 0.5f;
+        sum += amplitude * glm::mix(0.5f, value, detail);
+        total_amplitude += amplitude;
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return glm::mix(m_low, m_high, sum / total_amplitude);
+}
+
+ImageTexture::ImageTexture(TextureCache *cache, int texture, const glm::vec2 &scale)
+: m_cache(cache), m_texture(texture), m_scale(scale)
+{}
+
+glm::vec3 ImageTexture::Evaluate(const glm::vec2 &uv, float footprint) const {
+    if (m_texture < 0) {
+        return glm::vec3{1,0,1};
+    }
+    return m_cache->Sample(m_texture, uv*m_scale, footprint*glm::max(m_scale.x, m_scale.y));
+}
+
+}
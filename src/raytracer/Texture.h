@@ -0,0 +1,58 @@
+#pragma once
+
+#include "TextureCache.h"
+
+#include <glm/glm/glm.hpp>
+#include <stdint.h>
+
+namespace raytracer
+{
+
+// A colour that varies over a surface, multiplied into a material's colour
+// footprint is how many uv units the ray's cone covers where it hit, so textures can filter out detail smaller than that
+class ITexture {
+    public:
+        virtual glm::vec3 Evaluate(const glm::vec2 &uv, float footprint) const = 0;
+};
+
+// Squares of two colours, scale is how many squares fit in one uv unit
+// fades to the average colour as the squares get smaller than the footprint
+class CheckerTexture: public ITexture {
+    public:
+        CheckerTexture(const glm::vec3 &even, const glm::vec3 &odd, float scale);
+        virtual glm::vec3 Evaluate(const glm::vec2 &uv, float footprint) const;
+    private:
+        glm::vec3 m_even;
+        glm::vec3 m_odd;
+        float m_scale;
+};
+
+// Fractal value noise blended between two colours, scale is the size of the largest features in uv units
+// octaves smaller than the footprint are left out
+class NoiseTexture: public ITexture {
+    public:
+        NoiseTexture(const glm::vec3 &low, const glm::vec3 &high, float scale, int total_octaves=5, uint32_t seed=0);
+        virtual glm::vec3 Evaluate(const glm::vec2 &uv, float footprint) const;
+    private:
+        float GetValueNoise(const glm::vec2 &p, uint32_t octave) const;
+    private:
+        glm::vec3 m_low;
+        glm::vec3 m_high;
+        float m_scale;
+        int m_total_octaves;
+        uint32_t m_seed;
+};
+
+// Texture held by a TextureCache, repeated scale times over one uv unit
+// a texture that failed to load has an index of -1 and shows up magenta
+class ImageTexture: public ITexture {
+    public:
+        ImageTexture(TextureCache *cache, int texture, const glm::vec2 &scale=glm::vec2{1,1});
+        virtual glm::vec3 Evaluate(const glm::vec2 &uv, float footprint) const;
+    private:
+        TextureCache *m_cache;
+        int m_texture;
+        glm::vec2 m_scale;
+};
+
+}
@@ -0,0 +1,385 @@
+#include "TextureCache.h"
+#include "Timeline.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace raytracer
+{
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *fp) const { fclose(fp); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+constexpr uint32_t TEXTURE_MAGIC = 0x58545452;
+constexpr uint32_t TEXTURE_VERSION = 1;
+
+// followed by the tiles of each level from largest to smallest, in row major order
+// every tile is (tile_size+1)^2 interleaved RGB floats, the last row and column are the border
+struct TextureHeader {
+    public:
+        uint32_t magic;
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t tile_size;
+        int32_t total_levels;
+};
+
+// a lookup pins one tile at a time, so this leaves room for every thread plus tiles worth keeping
+constexpr int MIN_SLOTS_PER_THREAD = 8;
+
+bool SeekFile(FILE *fp, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(fp, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+inline size_t GetTileFloats(int tile_size) {
+    return static_cast<size_t>(tile_size+1)*(tile_size+1)*3;
+}
+
+inline int Wrap(int x, int size) {
+    x %= size;
+    return (x < 0) ? x + size : x;
+}
+
+// sizes of each level, halving down to 1x1
+std::vector<glm::ivec2> GetLevelSizes(int width, int height) {
+    std::vector<glm::ivec2> sizes;
+    sizes.push_back({width, height});
+    while (width > 1 || height > 1) {
+        width = std::max(1, width/2);
+        height = std::max(1, height/2);
+        sizes.push_back({width, height});
+    }
+    return sizes;
+}
+
+}
+
+TextureCache::TextureCache(size_t memory_budget)
+: m_memory_budget(memory_budget)
+{}
+
+TextureCache::~TextureCache() {
+    for (auto &texture: m_textures) {
+        if (texture->file) {
+            fclose(texture->file);
+        }
+    }
+}
+
+void TextureCache::SetMemoryBudget(size_t memory_budget) {
+    m_memory_budget = memory_budget;
+    m_pool.clear();
+    m_pool.shrink_to_fit();
+    m_slots.reset();
+    m_total_slots = 0;
+    for (auto &texture: m_textures) {
+        for (int i = 0; i < texture->total_tiles; i++) {
+            texture->tile_slots[i].store(-1, std::memory_order_relaxed);
+        }
+    }
+    if (!m_textures.empty()) {
+        AllocatePool(m_tile_size);
+    }
+}
+
+void TextureCache::AllocatePool(int tile_size) {
+    m_tile_size = tile_size;
+    m_tile_floats = GetTileFloats(tile_size);
+    const int min_slots = MIN_SLOTS_PER_THREAD * std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    m_total_slots = std::max(min_slots, static_cast<int>(m_memory_budget / (m_tile_floats*sizeof(float))));
+    // pages are only touched when a tile is first loaded into them
+    m_pool.resize(m_tile_floats*m_total_slots);
+    m_slots.reset(new Slot[m_total_slots]);
+    m_clock_hand = 0;
+}
+
+int TextureCache::AddTexture(const std::string &filename) {
+    FilePtr fp(fopen(filename.c_str(), "rb"));
+    if (!fp) {
+        return -1;
+    }
+
+    TextureHeader header;
+    if (fread(&header, sizeof(header), 1, fp.get()) != 1) {
+        return -1;
+    }
+    if (header.magic != TEXTURE_MAGIC || header.version != TEXTURE_VERSION) {
+        return -1;
+    }
+    if (header.width <= 0 || header.height <= 0 || header.tile_size < 4 || header.tile_size > 1024) {
+        return -1;
+    }
+    // textures share the pool, so they must have the same tile size
+    if (m_tile_size != 0 && header.tile_size != m_tile_size) {
+        return -1;
+    }
+    const std::vector<glm::ivec2> sizes = GetLevelSizes(header.width, header.height);
+    if (header.total_levels != static_cast<int>(sizes.size())) {
+        return -1;
+    }
+
+    auto texture = std::make_unique<Texture>();
+    texture->filename = filename;
+    texture->width = header.width;
+    texture->height = header.height;
+    texture->tile_size = header.tile_size;
+    texture->data_offset = sizeof(header);
+    texture->total_tiles = 0;
+    for (const glm::ivec2 &size: sizes) {
+        Level level;
+        level.width = size.x;
+        level.height = size.y;
+        level.tiles_x = (size.x + header.tile_size - 1) / header.tile_size;
+        level.tiles_y = (size.y + header.tile_size - 1) / header.tile_size;
+        level.first_tile = texture->total_tiles;
+        texture->total_tiles += level.tiles_x*level.tiles_y;
+        texture->levels.push_back(level);
+    }
+    texture->tile_slots.reset(new std::atomic<int32_t>[texture->total_tiles]);
+    for (int i = 0; i < texture->total_tiles; i++) {
+        texture->tile_slots[i].store(-1, std::memory_order_relaxed);
+    }
+    texture->file = fp.release();
+
+    if (m_total_slots == 0) {
+        AllocatePool(header.tile_size);
+    }
+    m_textures.push_back(std::move(texture));
+    return static_cast<int>(m_textures.size()) - 1;
+}
+
+glm::vec3 TextureCache::Sample(int texture, const glm::vec2 &uv, float footprint) {
+    const Texture &info = *m_textures[texture];
+    const int max_level = static_cast<int>(info.levels.size()) - 1;
+
+    // the level where the footprint covers about one texel, blending with the next smaller one
+    const float texels = footprint * static_cast<float>(std::max(info.width, info.height));
+    const float lod = (texels > 1.0f) ? std::min(std::log2(texels), static_cast<float>(max_level)) : 0.0f;
+    const int level = static_cast<int>(lod);
+    const float blend = lod - static_cast<float>(level);
+
+    const glm::vec2 wrapped = uv - glm::floor(uv);
+    glm::vec3 color = SampleLevel(texture, level, wrapped);
+    if (blend > 0.0f && level < max_level) {
+        color = glm::mix(color, SampleLevel(texture, level+1, wrapped), blend);
+    }
+    return color;
+}
+
+glm::vec3 TextureCache::SampleLevel(int texture, int level_index, const glm::vec2 &uv) {
+    const Texture &info = *m_textures[texture];
+    const Level &level = info.levels[level_index];
+
+    // texel centres are at half integers, and the first row is the top of the image
+    const float x = uv.x*static_cast<float>(level.width) - 0.5f;
+    const float y = (1.0f - uv.y)*static_cast<float>(level.height) - 0.5f;
+    const float x_floor = std::floor(x);
+    const float y_floor = std::floor(y);
+    const float fx = x - x_floor;
+    const float fy = y - y_floor;
+    const int ix = Wrap(static_cast<int>(x_floor), level.width);
+    const int iy = Wrap(static_cast<int>(y_floor), level.height);
+
+    // the texel to the right and below is always in the tile's border
+    const int tile_x = ix / info.tile_size;
+    const int tile_y = iy / info.tile_size;
+    const int local_x = ix - tile_x*info.tile_size;
+    const int local_y = iy - tile_y*info.tile_size;
+    const int tile = level.first_tile + tile_x + tile_y*level.tiles_x;
+
+    int slot;
+    const float *texels = AcquireTile(texture, tile, slot);
+    if (!texels) {
+        return glm::vec3{0,0,0};
+    }
+    const int stride = (info.tile_size+1)*3;
+    const float *row_0 = texels + local_y*stride + local_x*3;
+    const float *row_1 = row_0 + stride;
+    glm::vec3 color;
+    for (int c = 0; c < 3; c++) {
+        const float top = row_0[c] + (row_0[c+3] - row_0[c])*fx;
+        const float bottom = row_1[c] + (row_1[c+3] - row_1[c])*fx;
+        color[c] = top + (bottom - top)*fy;
+    }
+    ReleaseTile(slot);
+    return color;
+}
+
+const float *TextureCache::AcquireTile(int texture, int tile, int &slot) {
+    std::atomic<int32_t> &entry = m_textures[texture]->tile_slots[tile];
+    for (;;) {
+        slot = entry.load(std::memory_order_acquire);
+        if (slot < 0) {
+            if (!LoadTile(texture, tile)) {
+                return nullptr;
+            }
+            continue;
+        }
+
+        // once pinned the slot can't be replaced, but it may have been replaced before that
+        Slot &s = m_slots[slot];
+        if (s.pins.fetch_add(1, std::memory_order_acquire) >= 0) {
+            if (s.texture == texture && s.tile == tile) {
+                s.is_referenced.store(1, std::memory_order_relaxed);
+                return m_pool.data() + m_tile_floats*slot;
+            }
+            ReleaseTile(slot);
+            continue;
+        }
+        // another thread is reading it in
+        ReleaseTile(slot);
+        std::this_thread::yield();
+    }
+}
+
+bool TextureCache::LoadTile(int texture, int tile) {
+    Texture &info = *m_textures[texture];
+    std::atomic<int32_t> &entry = info.tile_slots[tile];
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // someone else started loading it
+    if (entry.load(std::memory_order_relaxed) >= 0) {
+        return true;
+    }
+    const int slot = FindVictim();
+    if (slot < 0) {
+        return false;
+    }
+    Slot &s = m_slots[slot];
+    if (s.texture >= 0) {
+        m_textures[s.texture]->tile_slots[s.tile].store(-1, std::memory_order_relaxed);
+        m_total_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    s.texture = texture;
+    s.tile = tile;
+    // give the thread that asked for it a chance to use it before it can be replaced
+    s.is_referenced.store(1, std::memory_order_relaxed);
+    entry.store(slot, std::memory_order_release);
+    lock.unlock();
+
+    // other threads wait for the slot to stop loading instead of reading it again
+    ReadTile(info, tile, m_pool.data() + m_tile_floats*slot);
+    m_total_loads.fetch_add(1, std::memory_order_relaxed);
+    s.pins.fetch_sub(LOADING, std::memory_order_release);
+    return true;
+}
+
+int TextureCache::FindVictim() {
+    // second chance: a slot used since the hand last passed it is skipped once
+    for (int i = 0; i < 2*m_total_slots; i++) {
+        const int slot = m_clock_hand;
+        m_clock_hand = (m_clock_hand + 1) % m_total_slots;
+        Slot &s = m_slots[slot];
+        if (s.is_referenced.exchange(0, std::memory_order_relaxed)) {
+            continue;
+        }
+        int32_t expected = 0;
+        if (s.pins.compare_exchange_strong(expected, LOADING, std::memory_order_acquire)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+void TextureCache::ReadTile(Texture &texture, int tile, float *texels) {
+    const uint64_t tile_bytes = m_tile_floats*sizeof(float);
+    const uint64_t offset = texture.data_offset + tile_bytes*static_cast<uint64_t>(tile);
+
+    TimelineScope scope("Read texture tile", "io", "tile", tile);
+    std::lock_guard<std::mutex> lock(texture.file_mutex);
+    if (!SeekFile(texture.file, offset) || fread(texels, sizeof(float), m_tile_floats, texture.file) != m_tile_floats) {
+        // a missing tile is black rather than stopping the render
+        memset(texels, 0, tile_bytes);
+        m_total_read_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+TextureCache::Stats TextureCache::GetStats() const {
+    Stats stats;
+    stats.total_loads = m_total_loads.load(std::memory_order_relaxed);
+    stats.total_evictions = m_total_evictions.load(std::memory_order_relaxed);
+    stats.total_read_errors = m_total_read_errors.load(std::memory_order_relaxed);
+    stats.total_bytes_loaded = stats.total_loads*m_tile_floats*sizeof(float);
+    return stats;
+}
+
+bool WriteTiledTexture(const std::string &filename, const HDRBuffer &image, int tile_size) {
+    if (image.GetWidth() <= 0 || image.GetHeight() <= 0 || tile_size < 4 || tile_size > 1024) {
+        return false;
+    }
+    FilePtr fp(fopen(filename.c_str(), "wb"));
+    if (!fp) {
+        return false;
+    }
+
+    const std::vector<glm::ivec2> sizes = GetLevelSizes(image.GetWidth(), image.GetHeight());
+    TextureHeader header;
+    header.magic = TEXTURE_MAGIC;
+    header.version = TEXTURE_VERSION;
+    header.width = image.GetWidth();
+    header.height = image.GetHeight();
+    header.tile_size = tile_size;
+    header.total_levels = static_cast<int>(sizes.size());
+    if (fwrite(&header, sizeof(header), 1, fp.get()) != 1) {
+        return false;
+    }
+
+    // each level is a 2x2 box filter of the one before it
+    HDRBuffer level = image;
+    HDRBuffer next;
+    std::vector<float> tile(GetTileFloats(tile_size));
+    for (size_t l = 0; l < sizes.size(); l++) {
+        const int width = sizes[l].x;
+        const int height = sizes[l].y;
+        const int tiles_x = (width + tile_size - 1) / tile_size;
+        const int tiles_y = (height + tile_size - 1) / tile_size;
+        for (int ty = 0; ty < tiles_y; ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                // texels past the edge of the level repeat it, which also fills the border
+                float *out = tile.data();
+                for (int y = 0; y <= tile_size; y++) {
+                    const int iy = Wrap(ty*tile_size + y, height);
+                    for (int x = 0; x <= tile_size; x++) {
+                        const glm::vec3 color = level.Read(Wrap(tx*tile_size + x, width), iy);
+                        *out++ = color.r;
+                        *out++ = color.g;
+                        *out++ = color.b;
+                    }
+                }
+                if (fwrite(tile.data(), sizeof(float), tile.size(), fp.get()) != tile.size()) {
+                    return false;
+                }
+            }
+        }
+
+        if (l+1 == sizes.size()) {
+            break;
+        }
+        const int next_width = sizes[l+1].x;
+        const int next_height = sizes[l+1].y;
+        next.Resize(next_width, next_height);
+        for (int y = 0; y < next_height; y++) {
+            const int y0 = std::min(2*y, height-1), y1 = std::min(2*y+1, height-1);
+            for (int x = 0; x < next_width; x++) {
+                const int x0 = std::min(2*x, width-1), x1 = std::min(2*x+1, width-1);
+                const glm::vec3 sum = level.Read(x0, y0) + level.Read(x1, y0) + level.Read(x0, y1) + level.Read(x1, y1);
+                next.Write(x, y, sum*0.25f);
+            }
+        }
+        std::swap(level, next);
+    }
+    return fflush(fp.get()) == 0;
+}
+
+}
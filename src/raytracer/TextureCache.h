@@ -0,0 +1,114 @@
+#pragma once
+
+#include "HDRBuffer.h"
+
+#include <glm/glm/glm.hpp>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace raytracer
+{
+
+// Mip-mapped textures split into square tiles, read from tiled texture files the first time a tile is needed
+// Loaded tiles share one pool sized from a memory budget, and tiles that haven't been used recently are replaced
+// Each tile keeps a one texel border from its neighbours, so a bilinear lookup only ever reads one tile
+// Lookups are thread safe, textures must be added before rendering
+class TextureCache {
+    public:
+        struct Stats {
+            public:
+                uint64_t total_loads;
+                uint64_t total_evictions;
+                uint64_t total_read_errors;
+                size_t total_bytes_loaded;
+        };
+        static constexpr int DEFAULT_TILE_SIZE = 64;
+        static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t(256) << 20;
+    public:
+        TextureCache(size_t memory_budget=DEFAULT_MEMORY_BUDGET);
+        ~TextureCache();
+        TextureCache(const TextureCache&) = delete;
+        TextureCache& operator=(const TextureCache&) = delete;
+        // drops every loaded tile, the pool is allocated again when the next texture is added
+        // the budget is raised if it can't hold a few tiles for every thread
+        void SetMemoryBudget(size_t memory_budget);
+        size_t GetMemoryBudget() const { return m_memory_budget; }
+        // opens a file written by WriteTiledTexture and reads its header, no texels are read until they are sampled
+        // returns the texture's index, or -1 if the file couldn't be opened or isn't a tiled texture
+        int AddTexture(const std::string &filename);
+        int GetTotalTextures() const { return static_cast<int>(m_textures.size()); }
+        int GetWidth(int texture) const { return m_textures[texture]->width; }
+        int GetHeight(int texture) const { return m_textures[texture]->height; }
+        // trilinear lookup that repeats outside of [0,1]
+        // footprint is how many uv units the lookup covers, which picks the mip level
+        glm::vec3 Sample(int texture, const glm::vec2 &uv, float footprint);
+        Stats GetStats() const;
+    private:
+        struct Level {
+            public:
+                int width, height;
+                int tiles_x, tiles_y;
+                // index of the level's first tile within the texture
+                int first_tile;
+        };
+        struct Texture {
+            public:
+                std::string filename;
+                FILE *file{nullptr};
+                // reads of the same file are serialised
+                std::mutex file_mutex;
+                int width, height;
+                int tile_size;
+                std::vector<Level> levels;
+                uint64_t data_offset;
+                // slot of each loaded tile in the pool, -1 if it isn't loaded
+                std::unique_ptr<std::atomic<int32_t>[]> tile_slots;
+                int total_tiles;
+        };
+        struct Slot {
+            public:
+                // readers currently using the tile, LOADING while the slot is being refilled
+                std::atomic<int32_t> pins{0};
+                // set on every use, cleared as the clock hand passes
+                std::atomic<uint8_t> is_referenced{0};
+                int texture{-1};
+                int tile{-1};
+        };
+        static constexpr int32_t LOADING = INT32_MIN/2;
+    private:
+        void AllocatePool(int tile_size);
+        glm::vec3 SampleLevel(int texture, int level, const glm::vec2 &uv);
+        // pins a tile, loading it if needed, returns its texels or nullptr if the pool is exhausted
+        const float *AcquireTile(int texture, int tile, int &slot);
+        void ReleaseTile(int slot) { m_slots[slot].pins.fetch_sub(1, std::memory_order_release); }
+        // claims a slot for a tile and reads it, returns false if every slot is pinned
+        bool LoadTile(int texture, int tile);
+        // must hold m_mutex, returns a slot marked LOADING or -1
+        int FindVictim();
+        void ReadTile(Texture &texture, int tile, float *texels);
+    private:
+        size_t m_memory_budget;
+        std::vector<std::unique_ptr<Texture>> m_textures;
+        // every texture has the same tile size so they can share the pool
+        int m_tile_size{0};
+        size_t m_tile_floats{0};
+        int m_total_slots{0};
+        std::vector<float, DefaultInitAllocator<float>> m_pool;
+        std::unique_ptr<Slot[]> m_slots;
+        // held while picking a slot to replace
+        std::mutex m_mutex;
+        int m_clock_hand{0};
+        std::atomic<uint64_t> m_total_loads{0};
+        std::atomic<uint64_t> m_total_evictions{0};
+        std::atomic<uint64_t> m_total_read_errors{0};
+};
+
+// Writes an image as a tiled texture with every mip level down to 1x1, each half the size of the one before it
+bool WriteTiledTexture(const std::string &filename, const HDRBuffer &image, int tile_size=TextureCache::DEFAULT_TILE_SIZE);
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace raytracer
+{
+
+// rectangular region of the image, end coordinates are exclusive
+struct Tile {
+    public:
+        int x_start, x_end;
+        int y_start, y_end;
+        inline int GetWidth() const { return x_end-x_start; }
+        inline int GetHeight() const { return y_end-y_start; }
+};
+
+}
@@ -0,0 +1,197 @@
+#include "Timeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+namespace raytracer
+{
+
+namespace {
+
+struct FileCloser {
+    void operator()(FILE *fp) const { fclose(fp); }
+};
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+
+// Events are appended to a list of fixed size blocks, which is only ever grown by the thread that owns it
+// The count of a block is published after its event is written, so the events below it can be read from any thread
+struct TimelineBlock {
+    public:
+        static constexpr int SIZE = 1024;
+        TimelineEvent events[SIZE];
+        std::atomic<int> total_events{0};
+        std::atomic<TimelineBlock*> next{nullptr};
+};
+
+struct TimelineThread {
+    public:
+        std::unique_ptr<TimelineBlock> first;
+        // only used by the owning thread
+        TimelineBlock *last;
+        int id;
+        // guarded by the registry's mutex
+        const char *name{nullptr};
+        int name_index{-1};
+    public:
+        ~TimelineThread() {
+            // the first block is freed by its unique_ptr
+            TimelineBlock *block = first->next.load();
+            while (block) {
+                TimelineBlock *next = block->next.load();
+                delete block;
+                block = next;
+            }
+        }
+};
+
+// Every thread that has recorded an event, kept until the process exits
+// so its events can still be written after the thread is gone
+struct TimelineRegistry {
+    public:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<TimelineThread>> threads;
+        std::atomic<bool> is_enabled{false};
+        std::atomic<int64_t> clear_time{0};
+        const std::chrono::steady_clock::time_point epoch{std::chrono::steady_clock::now()};
+};
+
+TimelineRegistry &GetRegistry() {
+    static TimelineRegistry registry;
+    return registry;
+}
+
+TimelineThread &GetThread() {
+    thread_local TimelineThread *thread = nullptr;
+    if (thread == nullptr) {
+        auto &registry = GetRegistry();
+        auto new_thread = std::make_unique<TimelineThread>();
+        new_thread->first = std::make_unique<TimelineBlock>();
+        new_thread->last = new_thread->first.get();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        new_thread->id = static_cast<int>(registry.threads.size()) + 1;
+        thread = new_thread.get();
+        registry.threads.push_back(std::move(new_thread));
+    }
+    return *thread;
+}
+
+void WriteString(FILE *fp, const char *str) {
+    fputc('"', fp);
+    for (const char *c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', fp);
+            fputc(*c, fp);
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            fprintf(fp, "\\u%04x", static_cast<unsigned int>(*c));
+        } else {
+            fputc(*c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+}
+
+bool IsTimelineEnabled() {
+    return GetRegistry().is_enabled.load(std::memory_order_relaxed);
+}
+
+void SetTimelineEnabled(bool is_enabled) {
+    GetRegistry().is_enabled = is_enabled;
+}
+
+void ClearTimeline() {
+    GetRegistry().clear_time = GetTimelineTime();
+}
+
+void SetTimelineThreadName(const char *name, int index) {
+    TimelineThread &thread = GetThread();
+    // only this thread changes its name, so it can be checked without the lock
+    if (thread.name == name && thread.name_index == index) {
+        return;
+    }
+    auto &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    thread.name = name;
+    thread.name_index = index;
+}
+
+int64_t GetTimelineTime() {
+    const auto elapsed = std::chrono::steady_clock::now() - GetRegistry().epoch;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void RecordTimelineEvent(const TimelineEvent &event) {
+    TimelineThread &thread = GetThread();
+    TimelineBlock *block = thread.last;
+    int i = block->total_events.load(std::memory_order_relaxed);
+    if (i == TimelineBlock::SIZE) {
+        TimelineBlock *next = new TimelineBlock();
+        block->next.store(next, std::memory_order_release);
+        thread.last = block = next;
+        i = 0;
+    }
+    block->events[i] = event;
+    block->total_events.store(i+1, std::memory_order_release);
+}
+
+bool WriteTimeline(const std::string &filename) {
+    FilePtr fp(fopen(filename.c_str(), "w"));
+    if (!fp) {
+        return false;
+    }
+
+    auto &registry = GetRegistry();
+    const int64_t clear_time = registry.clear_time;
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    fprintf(fp.get(), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp.get(), "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"raytracer\"}}");
+    for (const auto &thread: registry.threads) {
+        char name[256];
+        if (thread->name == nullptr) {
+            snprintf(name, sizeof(name), "Thread %d", thread->id);
+        } else if (thread->name_index < 0) {
+            snprintf(name, sizeof(name), "%s", thread->name);
+        } else {
+            snprintf(name, sizeof(name), "%s %d", thread->name, thread->name_index);
+        }
+        fprintf(fp.get(), ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", thread->id);
+        WriteString(fp.get(), name);
+        fprintf(fp.get(), "}}");
+
+        // the owning thread only appends, so everything up to each block's published count is complete
+        for (const TimelineBlock *block = thread->first.get(); block; block = block->next.load(std::memory_order_acquire)) {
+            const int total_events = block->total_events.load(std::memory_order_acquire);
+            for (int i = 0; i < total_events; i++) {
+                const TimelineEvent &event = block->events[i];
+                if (event.start < clear_time) {
+                    continue;
+                }
+                // complete events, with times in microseconds
+                fprintf(fp.get(), ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                    thread->id, static_cast<double>(event.start)*1e-3, static_cast<double>(event.duration)*1e-3);
+                WriteString(fp.get(), event.name);
+                fprintf(fp.get(), ",\"cat\":");
+                WriteString(fp.get(), event.category);
+                if (event.arg_names[0]) {
+                    fprintf(fp.get(), ",\"args\":{");
+                    for (int k = 0; k < 2 && event.arg_names[k]; k++) {
+                        fputs((k > 0) ? "," : "", fp.get());
+                        WriteString(fp.get(), event.arg_names[k]);
+                        fprintf(fp.get(), ":%lld", static_cast<long long>(event.args[k]));
+                    }
+                    fprintf(fp.get(), "}");
+                }
+                fprintf(fp.get(), "}");
+            }
+        }
+    }
+    fprintf(fp.get(), "\n]}\n");
+    return ferror(fp.get()) == 0;
+}
+
+}
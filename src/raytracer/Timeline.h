@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+namespace raytracer
+{
+
+// Timeline of what every thread was doing, written as Chrome trace JSON which Perfetto and chrome://tracing open
+// Events are recorded by TimelineScope into a buffer per thread, which the thread appends to without taking locks
+// While the timeline is disabled a scope only checks a flag, so it is cheap enough to leave around every tile
+struct TimelineEvent {
+    public:
+        // names and categories are kept as pointers, so they have to be string literals
+        const char *name;
+        const char *category;
+        // nanoseconds since the timeline was first used
+        int64_t start;
+        int64_t duration;
+        // up to two integers shown with the event, unused ones have a null name
+        const char *arg_names[2];
+        int64_t args[2];
+};
+
+bool IsTimelineEnabled();
+// events are only recorded by scopes that start while it is enabled
+void SetTimelineEnabled(bool is_enabled);
+// events recorded before this are left out of WriteTimeline, their memory is kept for the threads still appending to it
+void ClearTimeline();
+// name shown for the calling thread, with the index appended if it isn't negative
+void SetTimelineThreadName(const char *name, int index=-1);
+int64_t GetTimelineTime();
+void RecordTimelineEvent(const TimelineEvent &event);
+// events recorded so far, including ones still being recorded by other threads
+bool WriteTimeline(const std::string &filename);
+
+// Records an event for as long as it is in scope
+class TimelineScope {
+    public:
+        TimelineScope(const char *name, const char *category)
+        : TimelineScope(name, category, nullptr, 0, nullptr, 0) {}
+        TimelineScope(const char *name, const char *category, const char *arg_name, int64_t arg)
+        : TimelineScope(name, category, arg_name, arg, nullptr, 0) {}
+        TimelineScope(
+            const char *name, const char *category,
+            const char *arg_name_0, int64_t arg_0, const char *arg_name_1, int64_t arg_1)
+        : m_is_recording(IsTimelineEnabled())
+        {
+            if (m_is_recording) {
+                m_event = TimelineEvent{name, category, GetTimelineTime(), 0, {arg_name_0, arg_name_1}, {arg_0, arg_1}};
+            }
+        }
+        ~TimelineScope() {
+            if (m_is_recording) {
+                m_event.duration = GetTimelineTime() - m_event.start;
+                RecordTimelineEvent(m_event);
+            }
+        }
+        TimelineScope(const TimelineScope&) = delete;
+        TimelineScope &operator=(const TimelineScope&) = delete;
+    private:
+        bool m_is_recording;
+        TimelineEvent m_event;
+};
+
+}
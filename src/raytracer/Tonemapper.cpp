@@ -0,0 +1,74 @@
+#include "Tonemapper.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace raytracer
+{
+
+// the same loops compiled for each instruction set
+#define TONEMAP_TARGET
+namespace generic {
+#include "Tonemapper.inl"
+}
+#undef TONEMAP_TARGET
+
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+#define TONEMAP_TARGET RAYTRACER_TARGET_SSE4
+namespace sse4 {
+#include "Tonemapper.inl"
+}
+#undef TONEMAP_TARGET
+
+#define TONEMAP_TARGET RAYTRACER_TARGET_AVX2
+namespace avx2 {
+#include "Tonemapper.inl"
+}
+#undef TONEMAP_TARGET
+
+#define TONEMAP_TARGET RAYTRACER_TARGET_AVX512
+namespace avx512 {
+#include "Tonemapper.inl"
+}
+#undef TONEMAP_TARGET
+#endif
+
+const char *Tonemapper::GetName(Operator op) {
+    switch (op) {
+    case LINEAR:    return "Linear";
+    case GAMMA:     return "Gamma";
+    case ACES:      return "ACES";
+    case REINHARD:  return "Reinhard";
+    default:        return "Unknown";
+    }
+}
+
+void Tonemapper::Apply(
+    const HDRBuffer &hdr, uint8_t *buffer,
+    int x_start, int x_end, int y_start, int y_end) const
+{
+    const int width = hdr.GetWidth();
+    const float *r = hdr.GetPlane(0);
+    const float *g = hdr.GetPlane(1);
+    const float *b = hdr.GetPlane(2);
+
+    for (int y = y_start; y < y_end; y++) {
+        const size_t i = x_start + static_cast<size_t>(y)*width;
+        ApplyRow(r+i, g+i, b+i, buffer + i*4, x_end-x_start);
+    }
+}
+
+void Tonemapper::ApplyRow(const float *r, const float *g, const float *b, uint8_t *rgba, int total_pixels) const {
+#if defined(RAYTRACER_HAS_ISA_TARGETS)
+    switch (GetActiveIsa()) {
+    case CpuIsa::SSE4:      return sse4::ApplyRow(m_operator, m_exposure, m_gamma, r, g, b, rgba, total_pixels);
+    case CpuIsa::AVX2:      return avx2::ApplyRow(m_operator, m_exposure, m_gamma, r, g, b, rgba, total_pixels);
+    case CpuIsa::AVX512:    return avx512::ApplyRow(m_operator, m_exposure, m_gamma, r, g, b, rgba, total_pixels);
+    default:                break;
+    }
+#endif
+    generic::ApplyRow(m_operator, m_exposure, m_gamma, r, g, b, rgba, total_pixels);
+}
+
+}
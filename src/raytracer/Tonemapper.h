@@ -0,0 +1,32 @@
+#pragma once
+
+#include "HDRBuffer.h"
+#include <stdint.h>
+
+namespace raytracer
+{
+
+// Converts a linear HDR image into displayable RGBA8
+// Runs as its own stage so the operator can be changed without re-rendering
+class Tonemapper {
+    public:
+        enum Operator { LINEAR, GAMMA, ACES, REINHARD, TOTAL_OPERATORS };
+        static const char *GetName(Operator op);
+    public:
+        Tonemapper() {}
+        // tonemap a region of the image into a buffer with the same dimensions
+        void Apply(
+            const HDRBuffer &hdr, uint8_t *buffer,
+            int x_start, int x_end, int y_start, int y_end) const;
+        // tonemap a contiguous run of pixels
+        void ApplyRow(const float *r, const float *g, const float *b, uint8_t *rgba, int total_pixels) const;
+
+    // have this accessible to imgui
+    public:
+        Operator m_operator{GAMMA};
+        float m_exposure{1.0f};
+        // display gamma applied after the tone curve, ignored by LINEAR
+        float m_gamma{2.0f};
+};
+
+}
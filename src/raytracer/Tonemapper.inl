@@ -0,0 +1,80 @@
+// Tonemapping loops, included by Tonemapper.cpp once per instruction set inside its own namespace
+// TONEMAP_TARGET is defined to the target attribute of that instruction set
+
+// Each operator is a branch free loop so the compiler can vectorise it
+TONEMAP_TARGET static void MapChannel(
+    Tonemapper::Operator op, float exposure, float gamma, 
+    const float *__restrict src, float *__restrict dst, int n) 
+{
+    switch (op) {
+    case Tonemapper::LINEAR:
+        for (int i = 0; i < n; i++) {
+            dst[i] = src[i]*exposure;
+        }
+        break;
+    case Tonemapper::ACES:
+        // Narkowicz's fit of the ACES filmic curve
+        for (int i = 0; i < n; i++) {
+            const float x = src[i]*exposure;
+            dst[i] = (x*(2.51f*x + 0.03f)) / (x*(2.43f*x + 0.59f) + 0.14f);
+        }
+        break;
+    case Tonemapper::REINHARD:
+        for (int i = 0; i < n; i++) {
+            const float x = src[i]*exposure;
+            dst[i] = x / (1.0f + x);
+        }
+        break;
+    case Tonemapper::GAMMA:
+    default:
+        for (int i = 0; i < n; i++) {
+            dst[i] = src[i]*exposure;
+        }
+        break;
+    }
+
+    for (int i = 0; i < n; i++) {
+        dst[i] = std::min(std::max(dst[i], 0.0f), 1.0f);
+    }
+
+    if (op == Tonemapper::LINEAR) {
+        return;
+    }
+
+    // display encoding, with a fast path for the default gamma of 2
+    if (gamma == 2.0f) {
+        for (int i = 0; i < n; i++) {
+            dst[i] = std::sqrt(dst[i]);
+        }
+    } else {
+        const float inv_gamma = 1.0f / gamma;
+        for (int i = 0; i < n; i++) {
+            dst[i] = std::pow(dst[i], inv_gamma);
+        }
+    }
+}
+
+TONEMAP_TARGET static void ApplyRow(
+    Tonemapper::Operator op, float exposure, float gamma, 
+    const float *r, const float *g, const float *b, uint8_t *rgba, int total_pixels) 
+{
+    // work in small chunks on the stack so each channel is mapped by a tight loop over contiguous floats
+    constexpr int CHUNK_SIZE = 64;
+    float mapped[3][CHUNK_SIZE];
+    const float *channels[3] = {r, g, b};
+
+    for (int offset = 0; offset < total_pixels; offset += CHUNK_SIZE) {
+        const int n = std::min(CHUNK_SIZE, total_pixels-offset);
+        for (int c = 0; c < 3; c++) {
+            MapChannel(op, exposure, gamma, channels[c] + offset, mapped[c], n);
+        }
+
+        uint8_t *dst = rgba + offset*4;
+        for (int i = 0; i < n; i++) {
+            dst[i*4+0] = static_cast<uint8_t>(255.0f * mapped[0][i]);
+            dst[i*4+1] = static_cast<uint8_t>(255.0f * mapped[1][i]);
+            dst[i*4+2] = static_cast<uint8_t>(255.0f * mapped[2][i]);
+            dst[i*4+3] = 255;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include "Topology.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace raytracer
+{
+
+static bool ReadLine(const std::string &filename, std::string &line) {
+    std::ifstream file(filename);
+    if (!file) {
+        return false;
+    }
+    return static_cast<bool>(std::getline(file, line));
+}
+
+std::vector<int> ParseCPUList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        int first = 0, last = 0;
+        const size_t dash = range.find('-');
+        try {
+            first = std::stoi(range.substr(0, dash));
+            last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash+1));
+        } catch (...) {
+            continue;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+CpuTopology CpuTopology::Detect() {
+    CpuTopology topology;
+
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool has_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::string online;
+    if (ReadLine("/sys/devices/system/node/online", online)) {
+        for (int id: ParseCPUList(online)) {
+            std::string cpulist;
+            if (!ReadLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist", cpulist)) {
+                continue;
+            }
+            Node node;
+            node.id = id;
+            for (int cpu: ParseCPUList(cpulist)) {
+                if (!has_allowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            // nodes with only memory have no CPUs to run on
+            if (!node.cpus.empty()) {
+                topology.nodes.push_back(std::move(node));
+            }
+        }
+    }
+#endif
+
+    if (topology.nodes.empty()) {
+        Node node;
+        node.id = 0;
+        const int total_cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < total_cpus; cpu++) {
+            node.cpus.push_back(cpu);
+        }
+        topology.nodes.push_back(std::move(node));
+    }
+    return topology;
+}
+
+int CpuTopology::GetTotalCPUs() const {
+    int total = 0;
+    for (const auto &node: nodes) {
+        total += static_cast<int>(node.cpus.size());
+    }
+    return total;
+}
+
+bool PinThread(std::thread &thread, const std::vector<int> &cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu: cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+}
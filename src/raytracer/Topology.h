@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <thread>
+
+namespace raytracer
+{
+
+// NUMA nodes and the CPUs that belong to each of them
+// Falls back to a single node holding every CPU when the topology can't be read
+struct CpuTopology {
+    public:
+        struct Node {
+            public:
+                int id;
+                std::vector<int> cpus;
+        };
+        std::vector<Node> nodes;
+    public:
+        // reads /sys/devices/system/node on linux, only CPUs this process may run on are kept
+        static CpuTopology Detect();
+        int GetTotalCPUs() const;
+};
+
+// parses lists such as "0-3,8,10-11"
+std::vector<int> ParseCPUList(const std::string &list);
+// restricts a thread to a set of CPUs, returns false if it isn't supported
+bool PinThread(std::thread &thread, const std::vector<int> &cpus);
+
+}
@@ -0,0 +1,93 @@
+#include "Traversal.h"
+
+namespace raytracer
+{
+
+const char *GetTraversalName(TraversalOrder order) {
+    switch (order) {
+    case TraversalOrder::ROW_MAJOR:     return "Row major";
+    case TraversalOrder::COLUMN_MAJOR:  return "Column major";
+    case TraversalOrder::MORTON:        return "Morton";
+    case TraversalOrder::HILBERT:       return "Hilbert";
+    default:                            return "Unknown";
+    }
+}
+
+// keep the even bits of a morton code
+static uint32_t CompactBits(uint32_t v) {
+    v &= 0x55555555;
+    v = (v | (v >> 1)) & 0x33333333;
+    v = (v | (v >> 2)) & 0x0F0F0F0F;
+    v = (v | (v >> 4)) & 0x00FF00FF;
+    v = (v | (v >> 8)) & 0x0000FFFF;
+    return v;
+}
+
+// position of the d-th point along a hilbert curve covering a side*side square
+static void HilbertToXY(uint32_t side, uint32_t d, uint32_t &x, uint32_t &y) {
+    x = 0;
+    y = 0;
+    for (uint32_t s = 1; s < side; s *= 2) {
+        const uint32_t rx = 1 & (d / 2);
+        const uint32_t ry = 1 & (d ^ rx);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s-1 - x;
+                y = s-1 - y;
+            }
+            const uint32_t t = x;
+            x = y;
+            y = t;
+        }
+        x += s*rx;
+        y += s*ry;
+        d /= 4;
+    }
+}
+
+void GetTraversal(TraversalOrder order, int width, int height, std::vector<PixelOffset> &offsets) {
+    offsets.clear();
+    offsets.reserve(static_cast<size_t>(width)*height);
+
+    switch (order) {
+    case TraversalOrder::COLUMN_MAJOR:
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                offsets.push_back({static_cast<uint16_t>(x), static_cast<uint16_t>(y)});
+            }
+        }
+        return;
+    case TraversalOrder::MORTON:
+    case TraversalOrder::HILBERT:
+        {
+            // walk the curve over the enclosing power of two square and skip points outside the tile
+            uint32_t side = 1;
+            while (side < static_cast<uint32_t>(width) || side < static_cast<uint32_t>(height)) {
+                side *= 2;
+            }
+            for (uint32_t d = 0; d < side*side; d++) {
+                uint32_t x, y;
+                if (order == TraversalOrder::MORTON) {
+                    x = CompactBits(d);
+                    y = CompactBits(d >> 1);
+                } else {
+                    HilbertToXY(side, d, x, y);
+                }
+                if (x < static_cast<uint32_t>(width) && y < static_cast<uint32_t>(height)) {
+                    offsets.push_back({static_cast<uint16_t>(x), static_cast<uint16_t>(y)});
+                }
+            }
+        }
+        return;
+    case TraversalOrder::ROW_MAJOR:
+    default:
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                offsets.push_back({static_cast<uint16_t>(x), static_cast<uint16_t>(y)});
+            }
+        }
+        return;
+    }
+}
+
+}
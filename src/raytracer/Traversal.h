@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace raytracer
+{
+
+// Order that pixels are visited in within a tile
+// Row major follows the memory layout of the buffers, Morton and Hilbert keep neighbouring
+// pixels close together in time so consecutive primary rays hit the same parts of the scene
+enum class TraversalOrder { ROW_MAJOR, COLUMN_MAJOR, MORTON, HILBERT, TOTAL_ORDERS };
+
+// pixels per 64 byte cache line in the framebuffer and the float planes
+constexpr int CACHE_LINE_PIXELS = 16;
+
+struct PixelOffset {
+    public:
+        uint16_t x, y;
+};
+
+const char *GetTraversalName(TraversalOrder order);
+// offsets of every pixel of a width*height tile in the given order
+void GetTraversal(TraversalOrder order, int width, int height, std::vector<PixelOffset> &offsets);
+
+}
@@ -0,0 +1,200 @@
+#include "Wavefront.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace raytracer
+{
+
+void RayQueue::Reserve(int capacity) {
+    for (int c = 0; c < 3; c++) {
+        origin[c].resize(capacity);
+        direction[c].resize(capacity);
+        color[c].resize(capacity);
+    }
+    cone_width.resize(capacity);
+    cone_spread.resize(capacity);
+    bounce_pdf.resize(capacity);
+    path.resize(capacity);
+    dimension.resize(capacity);
+}
+
+void WavefrontTracer::Trace(
+    const KernelContext &context,
+    const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+    std::vector<Scene::SurfaceInfo> *first_hits)
+{
+    const int total_paths = static_cast<int>(requests.size());
+    // paths that run out of bounces contribute nothing
+    results.assign(total_paths, glm::vec3{0,0,0});
+    if (first_hits) {
+        first_hits->resize(total_paths);
+    }
+
+    m_queue.Reserve(total_paths);
+    m_next_queue.Reserve(total_paths);
+    m_hits.resize(total_paths);
+    m_csg_surfaces.resize(total_paths);
+    m_hit_types.resize(total_paths);
+    m_order.resize(total_paths);
+
+    GenerateStage(context, requests);
+
+    for (int bounce = 0; bounce < context.total_bounces && m_queue.size > 0; bounce++) {
+        IntersectStage(*context.kernel_scene);
+        MissStage(context, results);
+        SortStage();
+        ShadeStage(context, bounce, requests, results, (bounce == 0) ? first_hits : nullptr);
+        std::swap(m_queue, m_next_queue);
+    }
+}
+
+void WavefrontTracer::GenerateStage(const KernelContext &context, const std::vector<PathRequest> &requests) {
+    m_queue.Clear();
+    for (int i = 0; i < static_cast<int>(requests.size()); i++) {
+        const PathRequest &request = requests[i];
+        float s = (float)request.x / (float)(context.width-1);
+        float t = 1.0f - (float)request.y / (float)(context.height-1);
+
+        Ray ray = context.camera->GetRay(s, t);
+        ray.color = glm::vec3{1, 1, 1};
+        ray.cone_spread = context.pixel_spread;
+        m_queue.Push(ray, static_cast<uint32_t>(i), 0, 0.0f);
+    }
+}
+
+void WavefrontTracer::IntersectStage(const KernelScene &kernel_scene) {
+    const IntersectKernel intersect = SelectIntersectKernel(kernel_scene);
+    for (int i = 0; i < m_queue.size; i++) {
+        Ray ray;
+        ray.origin = glm::vec3{m_queue.origin[0][i], m_queue.origin[1][i], m_queue.origin[2][i]};
+        ray.direction = glm::vec3{m_queue.direction[0][i], m_queue.direction[1][i], m_queue.direction[2][i]};
+        if (!intersect(kernel_scene, ray, m_hits[i], m_csg_surfaces[i])) {
+            m_hit_types[i] = 0;
+            continue;
+        }
+        // looked up now, so sorting doesn't have to go back to the entries
+        const KernelScene::Entry &entry = kernel_scene.entries[m_hits[i].entry];
+        const MaterialType type = entry.shape ? entry.material_type : m_csg_surfaces[i].material->GetType();
+        m_hit_types[i] = static_cast<uint8_t>(static_cast<int>(type) + 1);
+    }
+}
+
+void WavefrontTracer::MissStage(const KernelContext &context, std::vector<glm::vec3> &results) {
+    // rays that escape the scene finish with their current colour, times the environment's light if there is one
+    const EnvironmentMap &environment = context.scene->m_environment;
+    for (int i = 0; i < m_queue.size; i++) {
+        if (m_hit_types[i]) {
+            continue;
+        }
+        glm::vec3 color{m_queue.color[0][i], m_queue.color[1][i], m_queue.color[2][i]};
+        if (!environment.IsEmpty()) {
+            const glm::vec3 direction{m_queue.direction[0][i], m_queue.direction[1][i], m_queue.direction[2][i]};
+            color *= environment.EvaluateEscape(direction, m_queue.bounce_pdf[i]);
+        }
+        results[m_queue.path[i]] += color;
+    }
+}
+
+void WavefrontTracer::SortStage() {
+    // counting sort of the hits by material type
+    constexpr int TOTAL_TYPES = static_cast<int>(MaterialType::TOTAL_TYPES);
+    int counts[TOTAL_TYPES] = {0};
+    for (int i = 0; i < m_queue.size; i++) {
+        if (m_hit_types[i]) {
+            counts[m_hit_types[i]-1]++;
+        }
+    }
+
+    m_type_offsets[0] = 0;
+    for (int t = 0; t < TOTAL_TYPES; t++) {
+        m_type_offsets[t+1] = m_type_offsets[t] + counts[t];
+    }
+
+    int offsets[TOTAL_TYPES];
+    std::copy(m_type_offsets, m_type_offsets+TOTAL_TYPES, offsets);
+    for (int i = 0; i < m_queue.size; i++) {
+        if (m_hit_types[i]) {
+            m_order[offsets[m_hit_types[i]-1]++] = i;
+        }
+    }
+}
+
+template <typename T>
+void WavefrontTracer::ShadeMaterial(
+    MaterialType type, const KernelContext &context, int bounce,
+    const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+    std::vector<Scene::SurfaceInfo> *first_hits)
+{
+    // diffuse surfaces sample the environment directly, except at the last bounce like the kernels
+    const EnvironmentMap &environment = context.scene->m_environment;
+    const bool is_sampling_lights = !environment.IsEmpty() && bounce+1 < context.total_bounces;
+    const IntersectKernel intersect = SelectIntersectKernel(*context.kernel_scene);
+
+    // the calls are made to the concrete type so they are not dispatched virtually
+    const int t = static_cast<int>(type);
+    for (int k = m_type_offsets[t]; k < m_type_offsets[t+1]; k++) {
+        const int i = m_order[k];
+        Scene::Hit hit;
+        ShapeType shape_type;
+        MaterialType material_type;
+        ResolveHit(*context.kernel_scene, m_hits[i], m_csg_surfaces[i], hit, shape_type, material_type);
+        const uint32_t path = m_queue.path[i];
+        const PathRequest &request = requests[path];
+
+        Ray ray = m_queue.Get(i);
+        const uint32_t pixel = context.pixel_offset + static_cast<uint32_t>(request.x + request.y*context.width);
+        Sampler sampler(context.seed, pixel, request.sample, m_queue.dimension[i]);
+        Collision collision = hit.shape->GetCollision(ray, hit.t);
+        if (first_hits) {
+            (*first_hits)[path] = context.scene->GetSurfaceInfo(hit, collision);
+        }
+
+        const T &material = *static_cast<T*>(hit.material);
+        if constexpr(std::is_same<T, Lambertian>::value) {
+            if (is_sampling_lights) {
+                results[path] += environment.SampleDirect(material, ray, collision, sampler,
+                    [&](const glm::vec3 &direction) { return material.GetPdf(collision, direction); },
+                    [&](const Ray &shadow) {
+                        KernelHit shadow_hit;
+                        RaySurface shadow_surface;
+                        return intersect(*context.kernel_scene, shadow, shadow_hit, shadow_surface);
+                    });
+            }
+        }
+
+        bool has_scatter = material.T::CastRay(ray, collision, sampler);
+        if (!has_scatter) {
+            results[path] += ray.color;
+            continue;
+        }
+        float bounce_pdf = 0.0f;
+        if constexpr(std::is_same<T, Lambertian>::value) {
+            bounce_pdf = material.GetPdf(collision, ray.direction);
+        }
+        m_next_queue.Push(ray, path, sampler.GetDimension(), bounce_pdf);
+    }
+}
+
+void WavefrontTracer::ShadeStage(
+    const KernelContext &context, int bounce,
+    const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+    std::vector<Scene::SurfaceInfo> *first_hits)
+{
+    m_next_queue.Clear();
+
+    // shade every hit of one material type before moving onto the next
+    ShadeMaterial<Lambertian>(MaterialType::LAMBERTIAN, context, bounce, requests, results, first_hits);
+    ShadeMaterial<Metal>(MaterialType::METAL, context, bounce, requests, results, first_hits);
+    ShadeMaterial<Dielectric>(MaterialType::DIELECTRIC, context, bounce, requests, results, first_hits);
+
+    if (first_hits) {
+        for (int i = 0; i < m_queue.size; i++) {
+            if (!m_hit_types[i]) {
+                (*first_hits)[m_queue.path[i]].entity_id = -1;
+            }
+        }
+    }
+}
+
+}
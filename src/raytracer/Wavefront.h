@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Ray.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Sampler.h"
+#include "Kernels.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace raytracer
+{
+
+// Rays in flight stored as a structure of arrays
+struct RayQueue {
+    public:
+        std::vector<float> origin[3];
+        std::vector<float> direction[3];
+        std::vector<float> color[3];
+        std::vector<float> cone_width;
+        std::vector<float> cone_spread;
+        // density of the bounce that sent the ray, to weigh the environment's light it finds
+        std::vector<float> bounce_pdf;
+        // which path the ray belongs to, and how far along its sampler is
+        std::vector<uint32_t> path;
+        std::vector<uint32_t> dimension;
+        int size{0};
+    public:
+        void Reserve(int capacity);
+        inline void Clear() { size = 0; }
+        inline void Push(const Ray &ray, uint32_t path_index, uint32_t sampler_dimension, float ray_bounce_pdf) {
+            const int i = size++;
+            for (int c = 0; c < 3; c++) {
+                origin[c][i] = ray.origin[c];
+                direction[c][i] = ray.direction[c];
+                color[c][i] = ray.color[c];
+            }
+            cone_width[i] = ray.cone_width;
+            cone_spread[i] = ray.cone_spread;
+            bounce_pdf[i] = ray_bounce_pdf;
+            path[i] = path_index;
+            dimension[i] = sampler_dimension;
+        }
+        inline Ray Get(int i) const {
+            Ray ray;
+            ray.origin = glm::vec3{origin[0][i], origin[1][i], origin[2][i]};
+            ray.direction = glm::vec3{direction[0][i], direction[1][i], direction[2][i]};
+            ray.color = glm::vec3{color[0][i], color[1][i], color[2][i]};
+            ray.cone_width = cone_width[i];
+            ray.cone_spread = cone_spread[i];
+            return ray;
+        }
+};
+
+// Traces a batch of paths one bounce at a time, instead of one path at a time
+// Every bounce runs as separate stages over the whole queue: intersection, misses,
+// then shading with the hits grouped by material type so each material's code runs back to back
+// Paths give the same result as Renderer::TracePixel since they use the same sampler dimensions
+// Rays are intersected with the kernel scene built from the scene, and their hits are kept as compact KernelHits
+class WavefrontTracer {
+    public:
+        struct PathRequest {
+            public:
+                int x, y;
+                uint32_t sample;
+        };
+    public:
+        // results[i] is set to the colour of requests[i]
+        // first_hits[i] is set to the first surface hit by requests[i], with an entity_id of -1 for misses
+        // requests are in the coordinates of the context's camera, the same as the pixels given to the kernels
+        void Trace(
+            const KernelContext &context,
+            const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+            std::vector<Scene::SurfaceInfo> *first_hits=nullptr);
+    private:
+        void GenerateStage(const KernelContext &context, const std::vector<PathRequest> &requests);
+        void IntersectStage(const KernelScene &kernel_scene);
+        void MissStage(const KernelContext &context, std::vector<glm::vec3> &results);
+        void SortStage();
+        void ShadeStage(
+            const KernelContext &context, int bounce,
+            const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+            std::vector<Scene::SurfaceInfo> *first_hits);
+        template <typename T>
+        void ShadeMaterial(
+            MaterialType type, const KernelContext &context, int bounce,
+            const std::vector<PathRequest> &requests, std::vector<glm::vec3> &results,
+            std::vector<Scene::SurfaceInfo> *first_hits);
+    private:
+        RayQueue m_queue;
+        RayQueue m_next_queue;
+        std::vector<KernelHit> m_hits;
+        // only written for hits on CSG entries
+        std::vector<RaySurface> m_csg_surfaces;
+        // material type of each hit plus one, or 0 for a miss
+        std::vector<uint8_t> m_hit_types;
+        // indices of the rays that hit something, grouped by material type
+        std::vector<int> m_order;
+        int m_type_offsets[static_cast<int>(MaterialType::TOTAL_TYPES)+1];
+};
+
+}
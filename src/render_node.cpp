@@ -0,0 +1,818 @@
+// Headless distributed rendering of the demo scene
+// render_node coordinator <address> <output.exr> [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--spawn N]
+// render_node worker <address> [--threads N]
+// render_node bench [--width W] [--height H] [--samples N] [--bounces N] [--threads N]
+// render_node maketx <input.pfm> <output.rtx> [--tile-size N]
+// render_node sequence <frame_####.png> [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--frames N] [--fps N] [--threads N]
+// render_node regress <directory> [--update] [--tolerance P] [--threshold P] [--repeats N] [--width W] [--height H] [--samples N] [--bounces N] [--threads N]
+// render_node serve <address> [--threads N]
+// render_node submit <address> <output.exr> [--scene demo|csg|spheres] [--priority N] [--pass-samples N] [--width W] [--height H] [--samples N] [--bounces N] [--seed N]
+// render_node shutdown <address>
+// render_node views <output.exr> [--layout single|stereo|cubemap|equirect|array] [--guided] [--environment <sky.pfm>] [--scene demo|csg|spheres] [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--threads N]
+// render_node stream <output.exr> [--environment <sky.pfm>] [--scene demo|csg|spheres] [--tile-size N] [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--threads N]
+// address is either tcp:<host>:<port> or unix:<path>
+// every command also takes --trace <timeline.json>, to write a Chrome trace of what each thread was doing
+
+#include <raytracer/Renderer.h>
+#include <raytracer/Scene.h>
+#include <raytracer/Camera.h>
+#include <raytracer/RenderCoordinator.h>
+#include <raytracer/RenderWorker.h>
+#include <raytracer/ImageWriter.h>
+#include <raytracer/CpuFeatures.h>
+#include <raytracer/TextureCache.h>
+#include <raytracer/Sequence.h>
+#include <raytracer/Timeline.h>
+#include <raytracer/RenderServer.h>
+#include <raytracer/MultiView.h>
+#include <raytracer/StreamedRender.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "load_scene.h"
+
+struct Options {
+    int width{1280};
+    int height{720};
+    int total_samples{10};
+    int total_bounces{8};
+    int seed{0};
+    int total_spawn{0};
+    int total_threads{static_cast<int>(std::thread::hardware_concurrency())};
+    int tile_size{raytracer::TextureCache::DEFAULT_TILE_SIZE};
+    int total_frames{48};
+    int frames_per_second{24};
+    // regression runs
+    bool is_update{false};
+    int tolerance_percent{5};
+    int threshold_percent{10};
+    int total_repeats{3};
+    std::string trace_filename;
+    // jobs for a render server
+    std::string scene_name{"demo"};
+    int priority{0};
+    int samples_per_pass{1};
+    // multi-view renders
+    std::string layout{"stereo"};
+    bool is_guided{false};
+    // equirectangular PFM lighting the scene instead of a white sky
+    std::string environment_filename;
+};
+
+static void print_usage() {
+    fprintf(stderr, 
+        "Usage: render_node coordinator <address> <output.exr> [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--spawn N]\n"
+        "       render_node worker <address> [--threads N]\n"
+        "       render_node bench [--width W] [--height H] [--samples N] [--bounces N] [--threads N]\n"
+        "       render_node maketx <input.pfm> <output.rtx> [--tile-size N]\n"
+        "       render_node sequence <frame_####.png> [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--frames N] [--fps N] [--threads N]\n"
+        "       render_node regress <directory> [--update] [--tolerance P] [--threshold P] [--repeats N] [--width W] [--height H] [--samples N] [--bounces N] [--threads N]\n"
+        "       render_node serve <address> [--threads N]\n"
+        "       render_node submit <address> <output.exr> [--scene demo|csg|spheres] [--priority N] [--pass-samples N] [--width W] [--height H] [--samples N] [--bounces N] [--seed N]\n"
+        "       render_node shutdown <address>\n"
+        "       render_node views <output.exr> [--layout single|stereo|cubemap|equirect|array] [--guided] [--environment <sky.pfm>] [--scene demo|csg|spheres] [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--threads N]\n"
+        "       render_node stream <output.exr> [--environment <sky.pfm>] [--scene demo|csg|spheres] [--tile-size N] [--width W] [--height H] [--samples N] [--bounces N] [--seed N] [--threads N]\n"
+        "Every command also takes [--trace <timeline.json>]\n");
+}
+
+static bool parse_options(int argc, char **argv, int start, Options &options) {
+    for (int i = start; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            options.is_update = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--guided") == 0) {
+            options.is_guided = true;
+            continue;
+        }
+        if (i+1 >= argc) {
+            return false;
+        }
+        if (strcmp(argv[i], "--trace") == 0) {
+            options.trace_filename = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--scene") == 0) {
+            options.scene_name = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--layout") == 0) {
+            options.layout = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--environment") == 0) {
+            options.environment_filename = argv[++i];
+            continue;
+        }
+        int value = atoi(argv[i+1]);
+        if      (strcmp(argv[i], "--width") == 0)   options.width = value;
+        else if (strcmp(argv[i], "--height") == 0)  options.height = value;
+        else if (strcmp(argv[i], "--samples") == 0) options.total_samples = value;
+        else if (strcmp(argv[i], "--bounces") == 0) options.total_bounces = value;
+        else if (strcmp(argv[i], "--seed") == 0)    options.seed = value;
+        else if (strcmp(argv[i], "--spawn") == 0)   options.total_spawn = value;
+        else if (strcmp(argv[i], "--threads") == 0) options.total_threads = value;
+        else if (strcmp(argv[i], "--tile-size") == 0) options.tile_size = value;
+        else if (strcmp(argv[i], "--frames") == 0)  options.total_frames = value;
+        else if (strcmp(argv[i], "--fps") == 0)     options.frames_per_second = value;
+        else if (strcmp(argv[i], "--tolerance") == 0) options.tolerance_percent = value;
+        else if (strcmp(argv[i], "--threshold") == 0) options.threshold_percent = value;
+        else if (strcmp(argv[i], "--repeats") == 0) options.total_repeats = value;
+        else if (strcmp(argv[i], "--priority") == 0) options.priority = value;
+        else if (strcmp(argv[i], "--pass-samples") == 0) options.samples_per_pass = value;
+        else return false;
+        i++;
+    }
+    raytracer::SetTimelineEnabled(!options.trace_filename.empty());
+    return true;
+}
+
+// scenes that can be rendered by name, with where the camera looks at them from
+struct ReferenceScene {
+    const char *name;
+    void (*load)(raytracer::Scene &scene);
+    glm::vec3 look_from;
+};
+static const ReferenceScene REFERENCE_SCENES[] = {
+    {"demo",    [](raytracer::Scene &scene) { load_scene(scene); }, glm::vec3{13,2,3}},
+    {"csg",     load_csg_scene,    glm::vec3{8,5,10}},
+    {"spheres", load_sphere_scene, glm::vec3{6,3,8}},
+};
+constexpr int TOTAL_REFERENCE_SCENES = static_cast<int>(sizeof(REFERENCE_SCENES)/sizeof(REFERENCE_SCENES[0]));
+// exit code of a regression run without golden images, the regress test's SKIP_RETURN_CODE
+constexpr int REGRESS_NO_GOLDEN_IMAGES = 77;
+
+// null if there is no scene with the name
+static const ReferenceScene *find_reference_scene(const std::string &name) {
+    for (const auto &scene: REFERENCE_SCENES) {
+        if (name == scene.name) {
+            return &scene;
+        }
+    }
+    return nullptr;
+}
+
+static raytracer::Camera create_camera(const Options &options) {
+    raytracer::Camera camera;
+    camera.m_vertical_fov = 45.0f;
+    camera.m_aspect_ratio = (float)options.width/(float)options.height;
+    camera.m_plane_distance = 10.0f;
+    camera.m_look_from = glm::vec3{13,2,3};
+    camera.m_look_at = glm::vec3{0,0,0};
+    camera.m_up = glm::vec3{0,1,0};
+    return camera;
+}
+
+static int run_worker(const std::string &address, const Options &options) {
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto scene = new raytracer::Scene();
+    load_scene(*scene);
+
+    raytracer::RenderWorker worker(*renderer, *scene);
+    bool is_success = worker.Run(address);
+    delete renderer;
+    delete scene;
+    return is_success ? 0 : 1;
+}
+
+static int run_coordinator(const std::string &address, const std::string &output, const Options &options) {
+    raytracer::RenderCoordinator coordinator;
+    if (!coordinator.Listen(address)) {
+        fprintf(stderr, "Failed to listen on %s\n", address.c_str());
+        return 1;
+    }
+
+#ifndef _WIN32
+    // local workers for testing on a single machine
+    std::vector<pid_t> children;
+    for (int i = 0; i < options.total_spawn; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            Options worker_options = options;
+            worker_options.total_threads = 1;
+            _exit(run_worker(address, worker_options));
+        }
+        children.push_back(pid);
+    }
+#endif
+
+    raytracer::Camera camera = create_camera(options);
+
+    raytracer::HDRBuffer hdr;
+    auto start = std::chrono::steady_clock::now();
+    bool is_success = coordinator.RenderFrame(
+        camera, options.total_samples, options.total_bounces, static_cast<uint32_t>(options.seed), 
+        hdr, options.width, options.height);
+    float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %dx%d in %.3fs with %d workers\n", options.width, options.height, elapsed, coordinator.GetTotalWorkers());
+    coordinator.Shutdown();
+
+#ifndef _WIN32
+    for (pid_t pid: children) {
+        waitpid(pid, nullptr, 0);
+    }
+#endif
+
+    if (!is_success) {
+        fprintf(stderr, "Frame was not completed\n");
+        return 1;
+    }
+    if (!raytracer::WriteEXR(output, hdr)) {
+        fprintf(stderr, "Failed to write %s\n", output.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// seconds taken to render a frame with the renderer's current settings
+static float time_render(raytracer::Renderer &renderer, raytracer::Camera &camera, raytracer::Scene &scene, const Options &options) {
+    auto start = std::chrono::steady_clock::now();
+    renderer.Start(camera, scene, options.width, options.height);
+    while (renderer.GetState() == raytracer::Renderer::State::RUNNING) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+// time every instruction set, pixel order and tile size on the demo scene, to pick the defaults for a machine
+static int run_bench(const Options &options) {
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto scene = new raytracer::Scene();
+    load_scene(*scene);
+    raytracer::Camera camera = create_camera(options);
+    camera.RecalculateVirtualPlane();
+
+    renderer->m_total_samples = options.total_samples;
+    renderer->m_total_bounces = options.total_bounces;
+    renderer->m_samples_per_pass = options.total_samples;
+    const int tile_sizes[] = {16, 32, 64, 128};
+    const float total_paths = static_cast<float>(options.width)*options.height*options.total_samples;
+
+    printf("%dx%d, %d samples, %d bounces, %d threads\n", 
+        options.width, options.height, options.total_samples, options.total_bounces, renderer->GetTotalThreads());
+
+    // instruction sets with the default pixel order and tile size
+    const raytracer::CpuIsa best_isa = raytracer::DetectIsa();
+    printf("%-14s %10s %10s\n", "isa", "seconds", "Mpaths/s");
+    for (int isa = 0; isa <= static_cast<int>(best_isa); isa++) {
+        raytracer::SetActiveIsa(static_cast<raytracer::CpuIsa>(isa));
+        float elapsed = time_render(*renderer, camera, *scene, options);
+        printf("%-14s %10.3f %10.3f\n", 
+            raytracer::GetIsaName(raytracer::GetActiveIsa()), elapsed, total_paths / elapsed * 1e-6f);
+    }
+    raytracer::SetActiveIsa(best_isa);
+
+    printf("%-14s %6s %10s %10s\n", "order", "tile", "seconds", "Mpaths/s");
+    for (int order = 0; order < static_cast<int>(raytracer::TraversalOrder::TOTAL_ORDERS); order++) {
+        for (int tile_size: tile_sizes) {
+            renderer->m_traversal = static_cast<raytracer::TraversalOrder>(order);
+            renderer->m_tile_size = tile_size;
+            float elapsed = time_render(*renderer, camera, *scene, options);
+            printf("%-14s %6d %10.3f %10.3f\n", 
+                raytracer::GetTraversalName(renderer->m_traversal), tile_size, elapsed, total_paths / elapsed * 1e-6f);
+        }
+    }
+
+    delete renderer;
+    delete scene;
+    return 0;
+}
+
+// converts an image into a tiled and mip-mapped texture, which the texture cache can load a tile at a time
+static int run_maketx(const std::string &input, const std::string &output, const Options &options) {
+    raytracer::HDRBuffer image;
+    if (!raytracer::ReadPFM(input, image)) {
+        fprintf(stderr, "Failed to read %s\n", input.c_str());
+        return 1;
+    }
+    if (!raytracer::WriteTiledTexture(output, image, options.tile_size)) {
+        fprintf(stderr, "Failed to write %s\n", output.c_str());
+        return 1;
+    }
+    printf("Wrote %dx%d texture with %d pixel tiles to %s\n", image.GetWidth(), image.GetHeight(), options.tile_size, output.c_str());
+    return 0;
+}
+
+// renders the demo scene's animation while the camera circles a quarter of the way around it
+static int run_sequence(const std::string &output_pattern, const Options &options) {
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto scene = new raytracer::Scene();
+    auto animation = new raytracer::Animation();
+    load_scene(*scene, animation);
+    raytracer::Camera camera = create_camera(options);
+
+    const float total_seconds = static_cast<float>(std::max(options.total_frames-1, 1)) / std::max(options.frames_per_second, 1);
+    const glm::vec3 start = camera.m_look_from;
+    animation->m_look_from = raytracer::Track<glm::vec3>{raytracer::Interpolation::SMOOTH};
+    for (int i = 0; i <= 4; i++) {
+        // rotate around the vertical axis through the origin
+        const float angle = 0.125f*3.14159265f*static_cast<float>(i);
+        const float c = std::cos(angle);
+        const float s = std::sin(angle);
+        const glm::vec3 look_from{c*start.x + s*start.z, start.y, c*start.z - s*start.x};
+        animation->m_look_from.AddKey(total_seconds*0.25f*static_cast<float>(i), look_from);
+    }
+
+    renderer->m_total_samples = options.total_samples;
+    renderer->m_total_bounces = options.total_bounces;
+    renderer->m_samples_per_pass = options.total_samples;
+    renderer->m_seed = static_cast<uint32_t>(options.seed);
+
+    raytracer::SequenceSettings settings;
+    settings.width = options.width;
+    settings.height = options.height;
+    settings.first_frame = 0;
+    settings.last_frame = options.total_frames-1;
+    settings.frames_per_second = static_cast<float>(options.frames_per_second);
+    settings.output_pattern = output_pattern;
+
+    raytracer::SequenceStats stats;
+    const bool is_written = raytracer::RenderSequence(*renderer, camera, *scene, *animation, settings, &stats);
+    printf("Rendered %d frames in %.3f seconds, %.3f seconds rendering (%.1f%%)\n",
+        stats.total_frames, stats.total_seconds, stats.render_seconds,
+        (stats.total_seconds > 0.0f) ? 100.0f*stats.render_seconds/stats.total_seconds : 0.0f);
+
+    delete renderer;
+    delete animation;
+    delete scene;
+    return is_written ? 0 : 1;
+}
+
+// difference between two images as the root mean square of the difference between their 4x4 pixel block averages
+// relative to the mean of the reference, so the noise of single pixels is mostly averaged out
+static float get_image_error(const raytracer::HDRBuffer &image, const raytracer::HDRBuffer &reference) {
+    const int block_size = 4;
+    const int width = reference.GetWidth() / block_size;
+    const int height = reference.GetHeight() / block_size;
+    if (width == 0 || height == 0) {
+        return 0.0f;
+    }
+    double total_squared_error = 0.0;
+    double total_reference = 0.0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            glm::vec3 image_sum{0,0,0};
+            glm::vec3 reference_sum{0,0,0};
+            for (int j = 0; j < block_size; j++) {
+                for (int i = 0; i < block_size; i++) {
+                    image_sum += image.Read(x*block_size + i, y*block_size + j);
+                    reference_sum += reference.Read(x*block_size + i, y*block_size + j);
+                }
+            }
+            const glm::vec3 error = image_sum - reference_sum;
+            total_squared_error += glm::dot(error, error) / 3.0f;
+            total_reference += (reference_sum.r + reference_sum.g + reference_sum.b) / 3.0f;
+        }
+    }
+    const double mean_reference = total_reference / (static_cast<double>(width)*height);
+    const double rmse = std::sqrt(total_squared_error / (static_cast<double>(width)*height));
+    return (mean_reference > 0.0) ? static_cast<float>(rmse / mean_reference) : static_cast<float>(rmse);
+}
+
+// median paths per second of the last few passing runs in the history with the same key
+// slower or different runs are left out, so a regression never becomes the baseline it is compared against
+static bool get_history_median(const std::string &filename, const std::string &key, float &median) {
+    const int total_runs = 5;
+    FILE *file = fopen(filename.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+    std::vector<float> runs;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        // time,key...,paths_per_second,error,result
+        const char *key_start = strchr(line, ',');
+        if (key_start == nullptr || strncmp(key_start+1, key.c_str(), key.size()) != 0 || key_start[1+key.size()] != ',') {
+            continue;
+        }
+        float paths_per_second = 0.0f;
+        float error = 0.0f;
+        char result[64] = "";
+        // runs recorded before the result was added have none and are kept
+        if (sscanf(key_start + 2 + key.size(), "%f,%f,%63[^,\n]", &paths_per_second, &error, result) < 2) {
+            continue;
+        }
+        if (result[0] == '\0' || strcmp(result, "ok") == 0 || strcmp(result, "updated") == 0) {
+            runs.push_back(paths_per_second);
+        }
+    }
+    fclose(file);
+    if (runs.empty()) {
+        return false;
+    }
+    if (static_cast<int>(runs.size()) > total_runs) {
+        runs.erase(runs.begin(), runs.end() - total_runs);
+    }
+    std::sort(runs.begin(), runs.end());
+    median = runs[runs.size()/2];
+    return true;
+}
+
+// renders the reference scenes at fixed seeds, and compares them with the golden images in a directory
+// each run's throughput and result are appended to the directory's history.csv, and the run fails if it is slower
+// than the median of the last passing runs with the same settings by more than the threshold
+// --update writes the golden images instead of comparing against them
+// exits with REGRESS_NO_GOLDEN_IMAGES when the directory has none of them, which ctest counts as skipped
+static int run_regress(const std::string &directory, const Options &options) {
+    if (!options.is_update) {
+        bool has_golden_image = false;
+        for (const auto &reference_scene: REFERENCE_SCENES) {
+            const std::string golden_filename = directory + "/" + reference_scene.name + ".pfm";
+            FILE *file = fopen(golden_filename.c_str(), "rb");
+            if (file != nullptr) {
+                fclose(file);
+                has_golden_image = true;
+            }
+        }
+        if (!has_golden_image) {
+            printf("No golden images in %s, write them with --update\n", directory.c_str());
+            return REGRESS_NO_GOLDEN_IMAGES;
+        }
+    }
+
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    renderer->m_total_samples = options.total_samples;
+    renderer->m_total_bounces = options.total_bounces;
+    renderer->m_samples_per_pass = options.total_samples;
+    renderer->m_seed = 1;
+
+    const std::string history_filename = directory + "/history.csv";
+    FILE *history = fopen(history_filename.c_str(), "a");
+    if (history == nullptr) {
+        fprintf(stderr, "Failed to open %s\n", history_filename.c_str());
+        delete renderer;
+        return 1;
+    }
+    if (ftell(history) == 0) {
+        fprintf(history, "time,scene,width,height,samples,bounces,threads,isa,paths_per_second,error,result\n");
+    }
+
+    printf("%dx%d, %d samples, %d bounces, %d threads, %s\n",
+        options.width, options.height, options.total_samples, options.total_bounces, 
+        renderer->GetTotalThreads(), raytracer::GetIsaName(raytracer::GetActiveIsa()));
+    printf("%-10s %10s %10s %10s %10s  %s\n", "scene", "seconds", "Mpaths/s", "median", "error", "result");
+
+    const float total_paths = static_cast<float>(options.width)*options.height*options.total_samples;
+    const float tolerance = 0.01f*static_cast<float>(options.tolerance_percent);
+    const float threshold = 0.01f*static_cast<float>(options.threshold_percent);
+    int total_failed = 0;
+    for (const auto &reference_scene: REFERENCE_SCENES) {
+        auto scene = new raytracer::Scene();
+        reference_scene.load(*scene);
+        raytracer::Camera camera = create_camera(options);
+        camera.m_look_from = reference_scene.look_from;
+        camera.RecalculateVirtualPlane();
+
+        // the fastest of a few renders is the least disturbed by anything else running
+        float elapsed = 0.0f;
+        for (int i = 0; i < std::max(options.total_repeats, 1); i++) {
+            const float seconds = time_render(*renderer, camera, *scene, options);
+            elapsed = (i == 0) ? seconds : std::min(elapsed, seconds);
+        }
+        delete scene;
+        const float paths_per_second = total_paths / elapsed;
+
+        const std::string golden_filename = directory + "/" + reference_scene.name + ".pfm";
+        const char *result = "ok";
+        float error = 0.0f;
+        raytracer::HDRBuffer golden;
+        if (options.is_update) {
+            if (!raytracer::WritePFM(golden_filename, renderer->GetHDRBuffer())) {
+                fprintf(stderr, "Failed to write %s\n", golden_filename.c_str());
+                result = "not written";
+            } else {
+                result = "updated";
+            }
+        } else if (!raytracer::ReadPFM(golden_filename, golden)) {
+            result = "no golden image";
+        } else if (golden.GetWidth() != options.width || golden.GetHeight() != options.height) {
+            result = "wrong size";
+        } else {
+            error = get_image_error(renderer->GetHDRBuffer(), golden);
+            if (error > tolerance) {
+                result = "different";
+            }
+        }
+
+        char key[256];
+        snprintf(key, sizeof(key), "%s,%d,%d,%d,%d,%d,%s",
+            reference_scene.name, options.width, options.height, options.total_samples, options.total_bounces,
+            renderer->GetTotalThreads(), raytracer::GetIsaName(raytracer::GetActiveIsa()));
+        float median = 0.0f;
+        const bool has_history = get_history_median(history_filename, key, median);
+        if (has_history && strcmp(result, "ok") == 0 && paths_per_second < median*(1.0f - threshold)) {
+            result = "slower";
+        }
+        if (strcmp(result, "ok") != 0 && strcmp(result, "updated") != 0) {
+            total_failed++;
+        }
+        printf("%-10s %10.3f %10.3f %10.3f %10.4f  %s\n", 
+            reference_scene.name, elapsed, paths_per_second * 1e-6f, median * 1e-6f, error, result);
+
+        fprintf(history, "%lld,%s,%.0f,%.6f,%s\n", static_cast<long long>(time(nullptr)), key, paths_per_second, error, result);
+        fflush(history);
+    }
+    fclose(history);
+    delete renderer;
+
+    if (total_failed > 0) {
+        printf("%d of %d scenes failed\n", total_failed, TOTAL_REFERENCE_SCENES);
+        return 1;
+    }
+    return 0;
+}
+
+// keeps the reference scenes loaded and renders jobs from any client until told to shut down
+static int run_server(const std::string &address, const Options &options) {
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto server = new raytracer::RenderServer(*renderer);
+    server->m_is_logging = true;
+    for (const auto &reference_scene: REFERENCE_SCENES) {
+        server->AddScene(reference_scene.name, reference_scene.load);
+    }
+
+    printf("Serving on %s with %d threads\n", address.c_str(), renderer->GetTotalThreads());
+    fflush(stdout);
+    const bool is_success = server->Run(address);
+    if (!is_success) {
+        fprintf(stderr, "Failed to listen on %s\n", address.c_str());
+    }
+    delete server;
+    delete renderer;
+    return is_success ? 0 : 1;
+}
+
+// renders a job on a server, keeping the image up to date as each pass of tiles comes back
+static int run_submit(const std::string &address, const std::string &output, const Options &options) {
+    raytracer::Socket socket = raytracer::Socket::Connect(address);
+    if (!socket.IsValid()) {
+        fprintf(stderr, "Failed to connect to %s\n", address.c_str());
+        return 1;
+    }
+
+    raytracer::Camera camera = create_camera(options);
+    for (const auto &reference_scene: REFERENCE_SCENES) {
+        if (options.scene_name == reference_scene.name) {
+            camera.m_look_from = reference_scene.look_from;
+        }
+    }
+    raytracer::RenderSubmit submit;
+    submit.job = raytracer::RenderJob::Create(
+        1, camera, options.width, options.height, options.total_samples, options.total_bounces, static_cast<uint32_t>(options.seed));
+    submit.priority = options.priority;
+    submit.samples_per_pass = options.samples_per_pass;
+    if (!raytracer::SendMessage(socket, raytracer::MessageType::SUBMIT, &submit, sizeof(submit), options.scene_name.data(), options.scene_name.size())) {
+        fprintf(stderr, "Failed to submit the job\n");
+        return 1;
+    }
+
+    raytracer::HDRBuffer hdr(options.width, options.height);
+    hdr.Clear();
+    auto start = std::chrono::steady_clock::now();
+    // passes arrive one after another, so a pass is done once it has covered every pixel
+    int pass_samples = 0;
+    int64_t pass_pixels = 0;
+    raytracer::MessageType type;
+    std::vector<uint8_t> payload;
+    while (raytracer::RecvMessage(socket, type, payload)) {
+        if (type == raytracer::MessageType::PROGRESS && payload.size() >= sizeof(raytracer::RenderProgress)) {
+            raytracer::RenderProgress progress;
+            memcpy(&progress, payload.data(), sizeof(progress));
+            const raytracer::Tile &tile = progress.tile;
+            const size_t plane_size = static_cast<size_t>(tile.GetWidth())*tile.GetHeight();
+            if (payload.size() != sizeof(progress) + plane_size*3*sizeof(float) || 
+                tile.x_start < 0 || tile.y_start < 0 || tile.x_end > options.width || tile.y_end > options.height) 
+            {
+                break;
+            }
+            const float *planes = reinterpret_cast<const float*>(payload.data() + sizeof(progress));
+            for (int y = tile.y_start; y < tile.y_end; y++) {
+                for (int x = tile.x_start; x < tile.x_end; x++) {
+                    const size_t i = (x-tile.x_start) + static_cast<size_t>(y-tile.y_start)*tile.GetWidth();
+                    hdr.Write(x, y, glm::vec3{planes[i], planes[i + plane_size], planes[i + 2*plane_size]});
+                }
+            }
+            if (progress.total_samples != pass_samples) {
+                pass_samples = progress.total_samples;
+                pass_pixels = 0;
+            }
+            pass_pixels += static_cast<int64_t>(plane_size);
+            if (pass_pixels == static_cast<int64_t>(options.width)*options.height) {
+                printf("%.3fs: %d/%d samples\n", 
+                    std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(), pass_samples, options.total_samples);
+                fflush(stdout);
+            }
+            continue;
+        }
+        if (type != raytracer::MessageType::DONE || payload.size() != sizeof(raytracer::RenderDone)) {
+            break;
+        }
+        raytracer::RenderDone done;
+        memcpy(&done, payload.data(), sizeof(done));
+        if (done.status != raytracer::RenderStatus::FINISHED) {
+            fprintf(stderr, "Job was not finished: %s\n", 
+                (done.status == raytracer::RenderStatus::UNKNOWN_SCENE) ? "unknown scene" :
+                (done.status == raytracer::RenderStatus::INVALID) ? "invalid settings" : "cancelled");
+            return 1;
+        }
+        printf("Rendered %dx%d in %.3fs after %.3fs in the queue\n", options.width, options.height, done.total_seconds, done.queued_seconds);
+        if (!raytracer::WriteEXR(output, hdr)) {
+            fprintf(stderr, "Failed to write %s\n", output.c_str());
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "Lost the connection to %s\n", address.c_str());
+    return 1;
+}
+
+static int run_shutdown(const std::string &address) {
+    raytracer::Socket socket = raytracer::Socket::Connect(address);
+    if (!socket.IsValid() || !raytracer::SendMessage(socket, raytracer::MessageType::SHUTDOWN, nullptr, 0)) {
+        fprintf(stderr, "Failed to reach %s\n", address.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// renders several views of a scene as one job into a single image
+// single, stereo and array views are each width by height, cubemap faces are height square, and a panorama is width wide
+static int run_views(const std::string &output, const Options &options) {
+    const ReferenceScene *reference_scene = find_reference_scene(options.scene_name);
+    if (reference_scene == nullptr) {
+        fprintf(stderr, "Unknown scene %s\n", options.scene_name.c_str());
+        return 1;
+    }
+
+    raytracer::Camera camera = create_camera(options);
+    camera.m_look_from = reference_scene->look_from;
+    raytracer::MultiView views;
+    if (options.layout == "single") {
+        views = raytracer::MultiView::CreateSingle(camera, options.width, options.height);
+    } else if (options.layout == "stereo") {
+        views = raytracer::MultiView::CreateStereo(camera, 0.5f, options.width, options.height);
+    } else if (options.layout == "cubemap") {
+        views = raytracer::MultiView::CreateCubemap(camera, options.height);
+    } else if (options.layout == "equirect") {
+        views = raytracer::MultiView::CreateEquirectangular(camera, options.width);
+    } else if (options.layout == "array") {
+        views = raytracer::MultiView::CreateArray(camera, 3, 3, 0.5f, options.width, options.height);
+    } else {
+        fprintf(stderr, "Unknown layout %s\n", options.layout.c_str());
+        return 1;
+    }
+
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto scene = new raytracer::Scene();
+    reference_scene->load(*scene);
+    if (!options.environment_filename.empty() && !scene->m_environment.Load(options.environment_filename)) {
+        fprintf(stderr, "Failed to read %s\n", options.environment_filename.c_str());
+        delete renderer;
+        delete scene;
+        return 1;
+    }
+    renderer->m_total_samples = options.total_samples;
+    renderer->m_total_bounces = options.total_bounces;
+    renderer->m_seed = static_cast<uint32_t>(options.seed);
+    renderer->m_is_guided = options.is_guided;
+
+    auto start = std::chrono::steady_clock::now();
+    renderer->Start(views, *scene);
+    while (renderer->GetState() == raytracer::Renderer::State::RUNNING) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    printf("Rendered %d views into %dx%d in %.3fs\n", 
+        static_cast<int>(views.GetViews().size()), views.GetWidth(), views.GetHeight(), elapsed);
+
+    const bool is_written = raytracer::WriteEXR(output, renderer->GetHDRBuffer());
+    delete renderer;
+    delete scene;
+    if (!is_written) {
+        fprintf(stderr, "Failed to write %s\n", output.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// renders one image tile by tile straight into a tiled exr, for images too large to hold in memory
+static int run_stream(const std::string &output, const Options &options) {
+    const ReferenceScene *reference_scene = find_reference_scene(options.scene_name);
+    if (reference_scene == nullptr) {
+        fprintf(stderr, "Unknown scene %s\n", options.scene_name.c_str());
+        return 1;
+    }
+
+    auto renderer = new raytracer::Renderer(std::max(1, options.total_threads));
+    auto scene = new raytracer::Scene();
+    reference_scene->load(*scene);
+    if (!options.environment_filename.empty() && !scene->m_environment.Load(options.environment_filename)) {
+        fprintf(stderr, "Failed to read %s\n", options.environment_filename.c_str());
+        delete renderer;
+        delete scene;
+        return 1;
+    }
+    renderer->m_total_samples = options.total_samples;
+    renderer->m_total_bounces = options.total_bounces;
+    renderer->m_seed = static_cast<uint32_t>(options.seed);
+
+    raytracer::Camera camera = create_camera(options);
+    camera.m_look_from = reference_scene->look_from;
+    camera.RecalculateVirtualPlane();
+
+    raytracer::StreamedRenderSettings settings;
+    settings.width = options.width;
+    settings.height = options.height;
+    settings.tile_size = options.tile_size;
+    settings.output_filename = output;
+    auto start = std::chrono::steady_clock::now();
+    settings.on_progress = [&start](int tiles_written, int total_tiles) {
+        printf("%.3fs: %d/%d tiles\n", 
+            std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(), tiles_written, total_tiles);
+        fflush(stdout);
+    };
+
+    raytracer::StreamedRenderStats stats;
+    const bool is_written = raytracer::RenderStreamed(*renderer, camera, *scene, settings, &stats);
+    delete renderer;
+    delete scene;
+    if (!is_written) {
+        fprintf(stderr, "Failed to write %s\n", output.c_str());
+        return 1;
+    }
+    printf("Rendered %dx%d in %d tiles in %.3fs\n", options.width, options.height, stats.total_tiles, stats.total_seconds);
+    return 0;
+}
+
+static int run_command(int argc, char **argv, Options &options) {
+    if (argc >= 4 && strcmp(argv[1], "coordinator") == 0 && parse_options(argc, argv, 4, options)) {
+        return run_coordinator(argv[2], argv[3], options);
+    }
+    if (argc >= 3 && strcmp(argv[1], "worker") == 0 && parse_options(argc, argv, 3, options)) {
+        return run_worker(argv[2], options);
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0 && parse_options(argc, argv, 2, options)) {
+        return run_bench(options);
+    }
+    if (argc >= 4 && strcmp(argv[1], "maketx") == 0 && parse_options(argc, argv, 4, options)) {
+        return run_maketx(argv[2], argv[3], options);
+    }
+    if (argc >= 3 && strcmp(argv[1], "sequence") == 0 && parse_options(argc, argv, 3, options)) {
+        return run_sequence(argv[2], options);
+    }
+    if (argc >= 3 && strcmp(argv[1], "serve") == 0 && parse_options(argc, argv, 3, options)) {
+        return run_server(argv[2], options);
+    }
+    if (argc >= 4 && strcmp(argv[1], "submit") == 0 && parse_options(argc, argv, 4, options)) {
+        return run_submit(argv[2], argv[3], options);
+    }
+    if (argc == 3 && strcmp(argv[1], "shutdown") == 0) {
+        return run_shutdown(argv[2]);
+    }
+    if (argc >= 3 && strcmp(argv[1], "views") == 0 && parse_options(argc, argv, 3, options)) {
+        return run_views(argv[2], options);
+    }
+    if (argc >= 3 && strcmp(argv[1], "stream") == 0 && parse_options(argc, argv, 3, options)) {
+        return run_stream(argv[2], options);
+    }
+    if (argc >= 3 && strcmp(argv[1], "regress") == 0) {
+        // small enough to run after every change
+        options.width = 320;
+        options.height = 180;
+        options.total_samples = 4;
+        if (parse_options(argc, argv, 3, options)) {
+            return run_regress(argv[2], options);
+        }
+    }
+    print_usage();
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    const int result = run_command(argc, argv, options);
+    if (!options.trace_filename.empty()) {
+        raytracer::SetTimelineThreadName("Main");
+        if (!raytracer::WriteTimeline(options.trace_filename)) {
+            fprintf(stderr, "Failed to write %s\n", options.trace_filename.c_str());
+            return 1;
+        }
+        printf("Wrote timeline to %s\n", options.trace_filename.c_str());
+    }
+    return result;
+}